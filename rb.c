@@ -5,16 +5,192 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#ifdef RB_RCU
+#include <sched.h>
+#endif
+#ifdef RB_PARALLEL
+#include <pthread.h>
+#endif
 #include "rb.h"
 
+/* hint the cache about a node the cursor is about to visit */
+#ifdef __GNUC__
+#define PREFETCH(p) __builtin_prefetch(p)
+#else
+#define PREFETCH(p)
+#endif
+
+/*
+ * publication for lock-free readers (RB_RCU)
+ * a node's fields are stored before the release store that links it, readers load links with acquire
+ */
+#ifdef RB_RCU
+#define LOAD(p) __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define PUBLISH(p, v) __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+/* seqcount around each restructuring, so that readers can tell a miss from a rotation */
+#define WRITE_BEGIN(rbt) (__atomic_store_n(&(rbt)->seq, (rbt)->seq + 1, __ATOMIC_RELAXED), __atomic_thread_fence(__ATOMIC_RELEASE))
+#define WRITE_END(rbt) __atomic_store_n(&(rbt)->seq, (rbt)->seq + 1, __ATOMIC_RELEASE)
+#else
+#define PUBLISH(p, v) ((p) = (v))
+#define WRITE_BEGIN(rbt)
+#define WRITE_END(rbt)
+#endif
+
+/*
+ * operation counters (RB_STATS), relaxed atomics as lock-free readers and parallel builds count from other threads
+ * compiled out, they take no code and no comparison goes through anything but the pointer
+ */
+#ifdef RB_STATS
+#define STAT(rbt, field) __atomic_fetch_add(&(rbt)->stats.field, 1, __ATOMIC_RELAXED)
+#define COMPARE(rbt, d1, d2) (STAT(rbt, compares), (rbt)->compare((d1), (d2)))
+#define STAT_SEARCH(rbt, depth) stat_search((rbt), (depth))
+#define STAT_MERGE(rbt, part) stat_merge((rbt), (part))
+#else
+#define STAT(rbt, field) ((void) 0)
+#define COMPARE(rbt, d1, d2) ((rbt)->compare((d1), (d2)))
+#define STAT_SEARCH(rbt, depth) ((void) (depth))
+#define STAT_MERGE(rbt, part) ((void) 0)
+#endif
+
+#ifndef RB_RCU_BATCH
+#define RB_RCU_BATCH 64 /* try to reclaim after this many nodes are retired */
+#endif
+
+/* rb_insert_batch strategy by batch size relative to tree size, see rb_bench.c */
+#ifndef RB_BATCH_FINGER
+#define RB_BATCH_FINGER 32 /* search from the previous key if the batch holds at least 1/32 of the tree */
+#endif
+#ifndef RB_BATCH_REBUILD
+#define RB_BATCH_REBUILD 1 /* merge and rebuild if the batch is at least as large as the tree */
+#endif
+
+#ifdef RB_PARALLEL
+#ifndef RB_PARALLEL_TASKS
+#define RB_PARALLEL_TASKS 8 /* subtrees per thread, so that a thread done early takes more */
+#endif
+#ifndef RB_PARALLEL_MIN
+#define RB_PARALLEL_MIN 4096 /* a smaller build is not worth the threads */
+#endif
+
+/*
+ * work shared by threads, each takes the next task until none is left or one fails
+ * a task is a subtree, or a single node above the subtrees
+ */
+struct rbtask {
+	rbnode *node; /* subtree root or single node, the parent of a subtree to build */
+	rbnode **link; /* where a built subtree goes */
+	int whole; /* the subtree under node, or node alone */
+	int depth;
+	size_t lo; /* data and nodes lo .. lo + n - 1 */
+	size_t n;
+};
+
+struct rbjob {
+	rbtree *rbt;
+	void (*run)(struct rbjob *, struct rbtask *);
+	struct rbtask *tasks;
+	size_t count;
+	size_t next; /* next task to take */
+	int split; /* depth of the subtrees */
+	int err; /* first error, the tasks left are skipped */
+	int (*func)(void *, void *);
+	void *cookie;
+	void **data;
+	rbnode **nodes;
+	int red_depth;
+};
+#endif
+
+/*
+ * node pool
+ * nodes are carved out of slabs of chunk nodes, free nodes are linked through left
+ */
+typedef struct rbslab {
+	struct rbslab *next;
+	rbnode nodes[];
+} rbslab;
+
+struct rbpool {
+	size_t chunk;
+	rbnode *free;
+	rbslab *slabs;
+	int refs; /* trees sharing the pool after rb_split */
+};
+
+rbnode rb_nil = {
+	.left = &rb_nil,
+	.right = &rb_nil,
+	#ifdef RB_COMPACT
+	.parent_color = (uintptr_t) &rb_nil + BLACK,
+	#else
+	.parent = &rb_nil,
+	.color = BLACK,
+	#endif
+	.data = NULL,
+	#ifdef RB_RANK
+	.size = 0,
+	#endif
+};
+
+static rbnode *node_alloc(rbtree *rbt, void *data);
+static void node_free(rbtree *rbt, rbnode *node);
+static void pool_destroy(struct rbpool *pool);
+static void detach(rbtree *rbt, rbnode *node);
+#ifdef RB_RCU
+static void retire(rbtree *rbt, rbnode *node, int discard);
+static void release(rbtree *rbt, rbnode *list);
+#endif
+static void replace_node(rbtree *rbt, rbnode *old, rbnode *node);
+static void augment_path(rbtree *rbt, rbnode *node, rbnode *stop);
+static rbnode *insert(rbtree *rbt, rbnode *current, rbnode *parent, void *data);
+static rbnode *insert_at(rbtree *rbt, rbnode *parent, int left, void *data);
+static rbnode *climb(rbtree *rbt, rbnode *node, void *data, int after);
+#ifndef RB_DUP
+static rbnode *update(rbtree *rbt, rbnode *node, void *data);
+#endif
 static void insert_repair(rbtree *rbt, rbnode *current);
 static void delete_repair(rbtree *rbt, rbnode *current);
+static rbnode *build(rbtree *rbt, rbnode **list, size_t n, int depth, int red_depth, rbnode *parent);
+static void rebuild(rbtree *rbt, rbnode *list, size_t n);
+static rbnode *flatten(rbtree *rbt, rbnode *node, rbnode *list, size_t *n);
+static void sort(rbtree *rbt, void *data[], void *tmp[], size_t n);
+static size_t size_estimate(rbtree *rbt);
+static rbnode *bound(rbtree *rbt, void *data, int upper);
+static rbtree *create_shared(rbtree *rbt);
+static void init_part(rbtree *rbt, rbtree *part);
+static void split(rbtree *rbt, rbnode *node, rbtree *lo, rbtree *hi);
+static int join(rbtree *rbt, rbnode *left, int lbh, rbnode *pivot, rbnode *right, int rbh);
+static int black_height(rbtree *rbt, rbnode *node);
+static rbnode *leftmost(rbtree *rbt);
+static rbnode *rightmost(rbtree *rbt);
+static rbnode *descend(rbcursor *cursor, rbnode *node, int right);
+#ifdef RB_STATS
+static void stat_search(rbtree *rbt, unsigned long depth);
+static void stat_merge(rbtree *rbt, rbtree *part);
+#endif
 static void rotate_left(rbtree *, rbnode *);
 static void rotate_right(rbtree *, rbnode *);
 static int check_order(rbtree *rbt, rbnode *n, void *min, void *max);
 static int check_black_height(rbtree *rbt, rbnode *node);
+#ifdef RB_RANK
+static size_t check_size(rbtree *rbt, rbnode *node);
+#endif
 static void print(rbtree *rbt, rbnode *node, void (*print_func)(void *), int depth, char *label);
-static void destroy(rbtree *rbt, rbnode *node);
+static size_t destroy(rbtree *rbt, rbnode *node);
+static size_t drop(rbtree *part, void (*take)(void *, void *), void *cookie);
+#ifdef RB_PARALLEL
+static int job_init(struct rbjob *job, rbtree *rbt, int threads);
+static void job_fail(struct rbjob *job, int err);
+static void parallel(struct rbjob *job, int threads);
+static void *worker(void *arg);
+static void divide(struct rbjob *job, rbnode *node, int depth);
+static void build_top(struct rbjob *job, size_t lo, size_t n, int depth, rbnode *parent, rbnode **link);
+static void alloc_task(struct rbjob *job, struct rbtask *task);
+static void build_task(struct rbjob *job, struct rbtask *task);
+static void apply_task(struct rbjob *job, struct rbtask *task);
+static void destroy_task(struct rbjob *job, struct rbtask *task);
+static void discard(rbtree *rbt, rbnode *node);
+#endif
 
 /*
  * construction
@@ -30,51 +206,409 @@ rbtree *rb_create(int (*compare)(const void *, const void *), void (*destroy)(vo
 
 	rbt->compare = compare;
 	rbt->destroy = destroy;
-
-	/* sentinel node nil */
-	rbt->nil.left = rbt->nil.right = rbt->nil.parent = RB_NIL(rbt);
-	rbt->nil.color = BLACK;
-	rbt->nil.data = NULL;
+	rbt->augment = NULL;
 
 	/* sentinel node root */
-	rbt->root.left = rbt->root.right = rbt->root.parent = RB_NIL(rbt);
-	rbt->root.color = BLACK;
+	rbt->root.left = rbt->root.right = RB_NIL(rbt);
+	RB_SET_PARENT_COLOR(RB_ROOT(rbt), RB_NIL(rbt), BLACK);
 	rbt->root.data = NULL;
 
 	#ifdef RB_MIN
 	rbt->min = NULL;
 	#endif
+
+	#ifdef RB_MAX
+	rbt->max = NULL;
+	#endif
+
+	rbt->pool = NULL;
+	rbt->intrusive = 0;
+
+	#ifdef RB_RCU
+	rbt->seq = 0;
+	rbt->epoch = 1;
+	rbt->readers = NULL;
+	rbt->readers_lock = 0;
+	rbt->retired[0] = rbt->retired[1] = NULL;
+	rbt->retired_count = 0;
+	#endif
+
+	#ifdef RB_STATS
+	rb_stats_reset(rbt);
+	#endif
 	
 	return rbt;
 }
 
+/*
+ * construction of an intrusive tree
+ * nodes are embedded in the caller's records, compare and destroy receive rbnode pointers
+ * return NULL if out of memory
+ */
+rbtree *rb_create_intrusive(int (*compare)(const void *, const void *), void (*destroy)(void *))
+{
+	rbtree *rbt;
+
+	if ((rbt = rb_create(compare, destroy)) == NULL)
+		return NULL; /* out of memory */
+
+	rbt->intrusive = 1;
+
+	return rbt;
+}
+
+/*
+ * construction with an augment callback, called on every node whose subtree changes
+ * the callback may also be set on any other empty tree
+ * return NULL if out of memory
+ */
+rbtree *rb_create_augment(int (*compare)(const void *, const void *), void (*destroy)(void *), int (*augment)(rbnode *))
+{
+	rbtree *rbt;
+
+	if ((rbt = rb_create(compare, destroy)) == NULL)
+		return NULL; /* out of memory */
+
+	rbt->augment = augment;
+
+	return rbt;
+}
+
+/*
+ * construction with a node pool of chunk nodes per slab
+ * return NULL if out of memory, or chunk is 0 or too large for a slab's size to fit in a size_t
+ */
+rbtree *rb_create_pool(int (*compare)(const void *, const void *), void (*destroy)(void *), size_t chunk)
+{
+	rbtree *rbt;
+
+	if (chunk == 0 || chunk > (SIZE_MAX - sizeof(rbslab)) / sizeof(rbnode))
+		return NULL; /* bad chunk */
+
+	if ((rbt = rb_create(compare, destroy)) == NULL)
+		return NULL; /* out of memory */
+
+	rbt->pool = (struct rbpool *) malloc(sizeof(struct rbpool));
+	if (rbt->pool == NULL) {
+		free(rbt);
+		return NULL; /* out of memory */
+	}
+
+	rbt->pool->chunk = chunk;
+	rbt->pool->free = NULL;
+	rbt->pool->slabs = NULL;
+	rbt->pool->refs = 1;
+
+	return rbt;
+}
+
 /*
  * destruction
+ * a pooled tree only walks the nodes if there is data to destroy or the pool is shared, then releases whole slabs
  */
 void rb_destroy(rbtree *rbt)
 {
-	destroy(rbt, RB_FIRST(rbt));
+	#ifdef RB_RCU
+	/* no reader may be left */
+	release(rbt, rbt->retired[0]);
+	release(rbt, rbt->retired[1]);
+	#endif
+
+	if ((rbt->pool == NULL && !rbt->intrusive) || rbt->destroy != NULL || (rbt->pool != NULL && rbt->pool->refs > 1))
+		destroy(rbt, RB_FIRST(rbt));
+	if (rbt->pool != NULL && --rbt->pool->refs == 0)
+		pool_destroy(rbt->pool);
 	free(rbt);
 }
 
+/*
+ * allocate node from pool or malloc, an intrusive node is the data itself
+ * return NULL if out of memory
+ */
+rbnode *node_alloc(rbtree *rbt, void *data)
+{
+	struct rbpool *pool;
+	rbnode *node;
+	rbslab *slab;
+	size_t i;
+
+	if (rbt->intrusive)
+		return (rbnode *) data;
+
+	STAT(rbt, allocs);
+
+	if ((pool = rbt->pool) == NULL)
+		return (rbnode *) malloc(sizeof(rbnode));
+
+	if (pool->free == NULL) {
+		slab = (rbslab *) malloc(sizeof(rbslab) + pool->chunk * sizeof(rbnode));
+		if (slab == NULL)
+			return NULL; /* out of memory */
+
+		slab->next = pool->slabs;
+		pool->slabs = slab;
+
+		/* thread the new slab onto the free list, lowest address first */
+		for (i = pool->chunk; i > 0; i--) {
+			slab->nodes[i - 1].left = pool->free;
+			pool->free = &slab->nodes[i - 1];
+		}
+	}
+
+	node = pool->free;
+	pool->free = node->left;
+
+	return node;
+}
+
+/*
+ * release node to pool or free
+ */
+void node_free(rbtree *rbt, rbnode *node)
+{
+	if (rbt->intrusive) {
+		/* owned by the caller */
+	} else if (rbt->pool == NULL) {
+		free(node);
+	} else {
+		node->left = rbt->pool->free;
+		rbt->pool->free = node;
+	}
+}
+
+/*
+ * release all slabs
+ */
+void pool_destroy(struct rbpool *pool)
+{
+	rbslab *slab;
+
+	while ((slab = pool->slabs) != NULL) {
+		pool->slabs = slab->next;
+		free(slab);
+	}
+
+	free(pool);
+}
+
+#ifdef RB_RCU
+/*
+ * defer freeing an unlinked node until no reader can be on it, discard its data too if discard
+ * retired nodes are linked through the parent field, which readers never follow, the color says discard
+ */
+void retire(rbtree *rbt, rbnode *node, int discard)
+{
+	if (rbt->intrusive && !discard)
+		return; /* the record is the caller's */
+
+	RB_SET_PARENT_COLOR(node, rbt->retired[1], discard ? RED : BLACK);
+	rbt->retired[1] = node;
+
+	if (++rbt->retired_count % RB_RCU_BATCH == 0)
+		rb_rcu_reclaim(rbt);
+}
+
+/*
+ * free a list of retired nodes
+ */
+void release(rbtree *rbt, rbnode *list)
+{
+	rbnode *node;
+
+	while ((node = list) != NULL) {
+		list = RB_PARENT(node);
+		if (RB_COLOR(node) == RED)
+			rbt->destroy(node->data);
+		node_free(rbt, node);
+	}
+}
+#endif
+
 /*
  * look up
  * return NULL if not found
  */
 rbnode *rb_find(rbtree *rbt, void *data)
 {
+	unsigned long depth;
 	rbnode *p;
 
 	p = RB_FIRST(rbt);
 
-	while (p != RB_NIL(rbt)) {
+	for (depth = 1; p != RB_NIL(rbt); depth++) {
 		int cmp;
-		cmp = rbt->compare(data, p->data);
-		if (cmp == 0)
+		cmp = COMPARE(rbt, data, p->data);
+		if (cmp == 0) {
+			STAT_SEARCH(rbt, depth);
+			return p; /* found */
+		}
+		p = cmp < 0 ? p->left : p->right;
+	}
+
+	STAT_SEARCH(rbt, depth - 1);
+	return NULL; /* not found */
+}
+
+#ifdef RB_RCU
+/*
+ * register reader with rbt, may be called from the reader's thread
+ */
+void rb_rcu_register(rbtree *rbt, rbreader *reader)
+{
+	reader->rbt = rbt;
+	reader->epoch = 0;
+
+	while (__atomic_exchange_n(&rbt->readers_lock, 1, __ATOMIC_ACQUIRE))
+		sched_yield();
+	reader->next = rbt->readers;
+	rbt->readers = reader;
+	__atomic_store_n(&rbt->readers_lock, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * unregister reader, which must be outside a read section
+ */
+void rb_rcu_unregister(rbreader *reader)
+{
+	rbtree *rbt = reader->rbt;
+	rbreader **link;
+
+	while (__atomic_exchange_n(&rbt->readers_lock, 1, __ATOMIC_ACQUIRE))
+		sched_yield();
+	for (link = &rbt->readers; *link != reader; link = &(*link)->next)
+		;
+	*link = reader->next;
+	__atomic_store_n(&rbt->readers_lock, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * enter a read section, nodes found in it are not freed before rb_rcu_read_unlock
+ */
+void rb_rcu_read_lock(rbreader *reader)
+{
+	__atomic_store_n(&reader->epoch, __atomic_load_n(&reader->rbt->epoch, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
+
+	/* the writer either sees the epoch or has unlinked whatever it is about to free */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+/*
+ * leave a read section
+ */
+void rb_rcu_read_unlock(rbreader *reader)
+{
+	__atomic_store_n(&reader->epoch, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * look up without locks while one writer thread modifies the tree, inside a read section
+ * a hit is always a node with an equal key, a miss is trusted only if no restructuring overlapped it
+ * return NULL if not found
+ */
+rbnode *rb_find_rcu(rbtree *rbt, void *data)
+{
+	unsigned long seq;
+	size_t depth;
+	rbnode *p;
+
+	for (;;) {
+		seq = __atomic_load_n(&rbt->seq, __ATOMIC_ACQUIRE);
+
+		p = LOAD(RB_FIRST(rbt));
+		for (depth = 0; p != RB_NIL(rbt) && depth < RB_CURSOR_DEPTH; depth++) {
+			int cmp;
+			cmp = COMPARE(rbt, data, LOAD(p->data));
+			if (cmp == 0) {
+				STAT_SEARCH(rbt, depth + 1);
+				return p; /* found */
+			}
+			p = cmp < 0 ? LOAD(p->left) : LOAD(p->right);
+		}
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (p == RB_NIL(rbt) && (seq & 1) == 0 && __atomic_load_n(&rbt->seq, __ATOMIC_RELAXED) == seq) {
+			STAT_SEARCH(rbt, depth);
+			return NULL; /* not found */
+		}
+
+		/* a rotation may have moved the key out of the path, retry */
+	}
+}
+
+/*
+ * free the nodes retired in the previous epoch and start a new one, called by the writer
+ * this is only possible once every reader inside a read section has entered the current epoch
+ * return non-zero if the epoch advanced
+ */
+int rb_rcu_reclaim(rbtree *rbt)
+{
+	rbreader *reader;
+	unsigned long epoch;
+	int lagging;
+
+	/* the nodes are unlinked before the readers are looked at */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	lagging = 0;
+	while (__atomic_exchange_n(&rbt->readers_lock, 1, __ATOMIC_ACQUIRE))
+		sched_yield();
+	for (reader = rbt->readers; reader != NULL && !lagging; reader = reader->next) {
+		epoch = __atomic_load_n(&reader->epoch, __ATOMIC_ACQUIRE);
+		lagging = epoch != 0 && epoch != rbt->epoch;
+	}
+	__atomic_store_n(&rbt->readers_lock, 0, __ATOMIC_RELEASE);
+
+	if (lagging)
+		return 0; /* a reader may still be on a node retired in the previous epoch */
+
+	release(rbt, rbt->retired[0]);
+	rbt->retired[0] = rbt->retired[1];
+	rbt->retired[1] = NULL;
+	rbt->retired_count = 0;
+
+	__atomic_store_n(&rbt->epoch, rbt->epoch + 1, __ATOMIC_SEQ_CST);
+
+	return 1;
+}
+
+/*
+ * wait until every reader inside a read section has left it, then free all retired nodes
+ * data kept by rb_delete may be freed by the caller afterwards
+ */
+void rb_rcu_synchronize(rbtree *rbt)
+{
+	int i;
+
+	/* the first epoch waits out readers of the previous one, the second those of the current one */
+	for (i = 0; i < 2; i++) {
+		while (!rb_rcu_reclaim(rbt))
+			sched_yield();
+	}
+}
+#endif
+
+/*
+ * look up in an intrusive tree, key is an rbnode embedded in a record
+ * return NULL if not found
+ */
+rbnode *rb_find_node(rbtree *rbt, rbnode *key)
+{
+	unsigned long depth;
+	rbnode *p;
+
+	p = RB_FIRST(rbt);
+
+	for (depth = 1; p != RB_NIL(rbt); depth++) {
+		int cmp;
+		cmp = COMPARE(rbt, key, p);
+		if (cmp == 0) {
+			STAT_SEARCH(rbt, depth);
 			return p; /* found */
+		}
 		p = cmp < 0 ? p->left : p->right;
 	}
 
+	STAT_SEARCH(rbt, depth - 1);
 	return NULL; /* not found */
 }
 
@@ -93,7 +627,7 @@ rbnode *rb_successor(rbtree *rbt, rbnode *node)
 		for ( ; p->left != RB_NIL(rbt); p = p->left) ;
 	} else {
 		/* move up until we find it or hit the root */
-		for (p = node->parent; node == p->right; node = p, p = p->parent) ;
+		for (p = RB_PARENT(node); node == p->right; node = p, p = RB_PARENT(p)) ;
 
 		if (p == RB_ROOT(rbt))
 			p = NULL; /* not found */
@@ -103,412 +637,2178 @@ rbnode *rb_successor(rbtree *rbt, rbnode *node)
 }
 
 /*
- * apply func
- * return non-zero if error
+ * in-order predecessor
+ * return NULL if node is the first
  */
-int rb_apply(rbtree *rbt, rbnode *node, int (*func)(void *, void *), void *cookie, enum rbtraversal order)
+rbnode *rb_predecessor(rbtree *rbt, rbnode *node)
 {
-	int err;
+	rbnode *p;
 
-	if (node != RB_NIL(rbt)) {
-		if (order == PREORDER && (err = func(node->data, cookie)) != 0) /* preorder */
-			return err;
-		if ((err = rb_apply(rbt, node->left, func, cookie, order)) != 0) /* left */
-			return err;
-		if (order == INORDER && (err = func(node->data, cookie)) != 0) /* inorder */
-			return err;
-		if ((err = rb_apply(rbt, node->right, func, cookie, order)) != 0) /* right */
-			return err;
-		if (order == POSTORDER && (err = func(node->data, cookie)) != 0) /* postorder */
-			return err;
+	p = node->left;
+
+	if (p != RB_NIL(rbt)) {
+		/* move down until we find it */
+		for ( ; p->right != RB_NIL(rbt); p = p->right) ;
+	} else {
+		/* move up until we find it or hit the root */
+		for (p = RB_PARENT(node); node == p->left; node = p, p = RB_PARENT(p)) {
+			if (p == RB_ROOT(rbt))
+				return NULL; /* not found */
+		}
 	}
 
-	return 0;
+	return p;
 }
 
 /*
- * rotate left about x
+ * first node not less than data
+ * return NULL if none
  */
-void rotate_left(rbtree *rbt, rbnode *x)
+rbnode *rb_lower_bound(rbtree *rbt, void *data)
 {
-	rbnode *y;
-
-	y = x->right; /* child */
+	return bound(rbt, data, 0);
+}
 
-	/* tree x */
-	x->right = y->left;
-	if (x->right != RB_NIL(rbt))
-		x->right->parent = x;
+/*
+ * first node greater than data
+ * return NULL if none
+ */
+rbnode *rb_upper_bound(rbtree *rbt, void *data)
+{
+	return bound(rbt, data, 1);
+}
 
-	/* tree y */
-	y->parent = x->parent;
-	if (x == x->parent->left)
-		x->parent->left = y;
-	else
-		x->parent->right = y;
+/*
+ * start a cursor over the nodes with lo <= key < hi, NULL lo or hi for no bound
+ */
+void rb_range_init(rbrange *range, rbtree *rbt, void *lo, void *hi)
+{
+	range->rbt = rbt;
+	range->hi = hi;
 
-	/* assemble tree x and tree y */
-	y->left = x;
-	x->parent = y;
+	if (lo != NULL) {
+		range->node = bound(rbt, lo, 0);
+	} else {
+		range->node = leftmost(rbt);
+	}
 }
 
 /*
- * rotate right about x
+ * next node of the range, amortized O(1)
+ * return NULL at the end
  */
-void rotate_right(rbtree *rbt, rbnode *x)
+rbnode *rb_range_next(rbrange *range)
 {
-	rbnode *y;
+	rbnode *node;
 
-	y = x->left; /* child */
+	node = range->node;
+	if (node == NULL || (range->hi != NULL && COMPARE(range->rbt, node->data, range->hi) >= 0))
+		return range->node = NULL; /* end of range */
 
-	/* tree x */
-	x->left = y->right;
-	if (x->left != RB_NIL(rbt))
-		x->left->parent = x;
+	range->node = rb_successor(range->rbt, node);
 
-	/* tree y */
-	y->parent = x->parent;
-	if (x == x->parent->left)
-		x->parent->left = y;
-	else
-		x->parent->right = y;
+	return node;
+}
 
-	/* assemble tree x and tree y */
-	y->right = x;
-	x->parent = y;
+/*
+ * position cursor on the first node
+ * return NULL if the tree is empty
+ */
+rbnode *rb_cursor_begin(rbcursor *cursor, rbtree *rbt)
+{
+	cursor->rbt = rbt;
+	cursor->depth = 0;
+
+	return cursor->node = RB_FIRST(rbt) != RB_NIL(rbt) ? descend(cursor, RB_FIRST(rbt), 0) : NULL;
 }
 
+/*
+ * position cursor on the last node
+ * return NULL if the tree is empty
+ */
+rbnode *rb_cursor_end(rbcursor *cursor, rbtree *rbt)
+{
+	cursor->rbt = rbt;
+	cursor->depth = 0;
+
+	return cursor->node = RB_FIRST(rbt) != RB_NIL(rbt) ? descend(cursor, RB_FIRST(rbt), 1) : NULL;
+}
 
 /*
- * insert (or update) data
- * return NULL if out of memory
+ * step to the next node, amortized O(1)
+ * ancestors come off the cursor's own stack instead of through parent links, so climbing touches no nodes
+ * return NULL past the last node
  */
-rbnode *rb_insert(rbtree *rbt, void *data)
+rbnode *rb_cursor_next(rbcursor *cursor)
 {
-	rbnode *current, *parent;
-	rbnode *new_node;
+	rbnode *node;
 
-	/* do a binary search to find where it should be */
+	if ((node = cursor->node) == NULL)
+		return NULL;
 
-	current = RB_FIRST(rbt);
-	parent = RB_ROOT(rbt);
+	if (node->right != RB_NIL(cursor->rbt)) {
+		/* leftmost node of the right subtree */
+		cursor->path[cursor->depth] = node;
+		cursor->right[cursor->depth++] = 1;
+		return cursor->node = descend(cursor, node->right, 0);
+	}
 
-	while (current != RB_NIL(rbt)) {
-		int cmp;
-		cmp = rbt->compare(data, current->data);
+	/* nearest ancestor with node down its left */
+	while (cursor->depth > 0 && cursor->right[cursor->depth - 1])
+		cursor->depth--;
+	if (cursor->depth == 0)
+		return cursor->node = NULL; /* past the last node */
 
-		#ifndef RB_DUP
-		if (cmp == 0) {
-			rbt->destroy(current->data);
-			current->data = data;
-			return current; /* updated */
-		}
-		#endif
+	node = cursor->path[--cursor->depth];
+	PREFETCH(node->right);
+
+	return cursor->node = node;
+}
+
+/*
+ * step to the previous node, amortized O(1)
+ * return NULL past the first node
+ */
+rbnode *rb_cursor_prev(rbcursor *cursor)
+{
+	rbnode *node;
+
+	if ((node = cursor->node) == NULL)
+		return NULL;
+
+	if (node->left != RB_NIL(cursor->rbt)) {
+		/* rightmost node of the left subtree */
+		cursor->path[cursor->depth] = node;
+		cursor->right[cursor->depth++] = 0;
+		return cursor->node = descend(cursor, node->left, 1);
+	}
+
+	/* nearest ancestor with node down its right */
+	while (cursor->depth > 0 && !cursor->right[cursor->depth - 1])
+		cursor->depth--;
+	if (cursor->depth == 0)
+		return cursor->node = NULL; /* past the first node */
+
+	node = cursor->path[--cursor->depth];
+	PREFETCH(node->left);
+
+	return cursor->node = node;
+}
+
+/*
+ * follow left (or right) links from node to the end, stacking the nodes passed
+ * each node's data is prefetched on the way down, it is needed when the cursor comes back up
+ */
+rbnode *descend(rbcursor *cursor, rbnode *node, int right)
+{
+	rbnode *next;
+
+	for (;;) {
+		PREFETCH(node->data);
+		if ((next = right ? node->right : node->left) == RB_NIL(cursor->rbt))
+			return node;
+		cursor->path[cursor->depth] = node;
+		cursor->right[cursor->depth++] = right;
+		node = next;
+	}
+}
+
+#ifdef RB_RANK
+/*
+ * number of nodes less than data
+ */
+size_t rb_rank(rbtree *rbt, void *data)
+{
+	unsigned long depth;
+	rbnode *p;
+	size_t rank;
+
+	rank = 0;
+	for (depth = 0, p = RB_FIRST(rbt); p != RB_NIL(rbt); depth++) {
+		if (COMPARE(rbt, data, p->data) <= 0) {
+			p = p->left;
+		} else {
+			rank += p->left->size + 1;
+			p = p->right;
+		}
+	}
+
+	STAT_SEARCH(rbt, depth);
+	return rank;
+}
+
+/*
+ * k-th smallest node, counting from 0
+ * return NULL if k is out of range
+ */
+rbnode *rb_select(rbtree *rbt, size_t k)
+{
+	rbnode *p;
+
+	if (k >= RB_COUNT(rbt))
+		return NULL; /* out of range */
+
+	for (p = RB_FIRST(rbt); k != p->left->size; ) {
+		if (k < p->left->size) {
+			p = p->left;
+		} else {
+			k -= p->left->size + 1;
+			p = p->right;
+		}
+	}
+
+	return p;
+}
+#endif
+
+/*
+ * apply func
+ * return non-zero if error
+ */
+int rb_apply_node(rbtree *rbt, rbnode *node, int (*func)(void *, void *), void *cookie, enum rbtraversal order)
+{
+	int err;
+
+	if (node != RB_NIL(rbt)) {
+		if (order == PREORDER && (err = func(node->data, cookie)) != 0) /* preorder */
+			return err;
+		if ((err = rb_apply_node(rbt, node->left, func, cookie, order)) != 0) /* left */
+			return err;
+		if (order == INORDER && (err = func(node->data, cookie)) != 0) /* inorder */
+			return err;
+		if ((err = rb_apply_node(rbt, node->right, func, cookie, order)) != 0) /* right */
+			return err;
+		if (order == POSTORDER && (err = func(node->data, cookie)) != 0) /* postorder */
+			return err;
+	}
+
+	return 0;
+}
+
+/*
+ * rotate left about x
+ */
+void rotate_left(rbtree *rbt, rbnode *x)
+{
+	rbnode *y;
+
+	STAT(rbt, rotations);
+
+	y = x->right; /* child */
+
+	/*
+	 * links change in an order that never forms a loop
+	 * a lock-free reader may miss a node meanwhile, but not loop or leave the tree
+	 */
+
+	/* tree x */
+	PUBLISH(x->right, y->left);
+	if (x->right != RB_NIL(rbt))
+		RB_SET_PARENT(x->right, x);
+
+	/* assemble tree x and tree y */
+	PUBLISH(y->left, x);
+
+	/* tree y */
+	RB_SET_PARENT(y, RB_PARENT(x));
+	if (x == RB_PARENT(x)->left)
+		PUBLISH(RB_PARENT(x)->left, y);
+	else
+		PUBLISH(RB_PARENT(x)->right, y);
+	RB_SET_PARENT(x, y);
+
+	#ifdef RB_RANK
+	y->size = x->size;
+	x->size = x->left->size + x->right->size + 1;
+	#endif
+
+	if (rbt->augment != NULL) {
+		rbt->augment(x);
+		rbt->augment(y);
+	}
+}
+
+/*
+ * rotate right about x
+ */
+void rotate_right(rbtree *rbt, rbnode *x)
+{
+	rbnode *y;
+
+	STAT(rbt, rotations);
+
+	y = x->left; /* child */
+
+	/* links change in the order of rotate_left */
+
+	/* tree x */
+	PUBLISH(x->left, y->right);
+	if (x->left != RB_NIL(rbt))
+		RB_SET_PARENT(x->left, x);
+
+	/* assemble tree x and tree y */
+	PUBLISH(y->right, x);
+
+	/* tree y */
+	RB_SET_PARENT(y, RB_PARENT(x));
+	if (x == RB_PARENT(x)->left)
+		PUBLISH(RB_PARENT(x)->left, y);
+	else
+		PUBLISH(RB_PARENT(x)->right, y);
+	RB_SET_PARENT(x, y);
+
+	#ifdef RB_RANK
+	y->size = x->size;
+	x->size = x->left->size + x->right->size + 1;
+	#endif
+
+	if (rbt->augment != NULL) {
+		rbt->augment(x);
+		rbt->augment(y);
+	}
+}
+
+
+/*
+ * insert (or update) data
+ * keys before the first node are placed with one comparison, and with RB_MAX keys past the last node with one or two
+ * return NULL if out of memory
+ */
+rbnode *rb_insert(rbtree *rbt, void *data)
+{
+	#ifdef RB_MAX
+	int cmp;
+
+	/* a full descent would end right of the last node anyway */
+	if (rbt->max != NULL && (cmp = COMPARE(rbt, data, rbt->max->data)) >= 0) {
+		#ifndef RB_DUP
+		if (cmp == 0)
+			return update(rbt, rbt->max, data); /* updated */
+		#endif
+		return insert_at(rbt, rbt->max, 0, data);
+	}
+	#endif
+
+	#ifdef RB_MIN
+	/* or left of the first node, the end checks cost a random insert up to two compares */
+	if (rbt->min != NULL && COMPARE(rbt, data, rbt->min->data) < 0)
+		return insert_at(rbt, rbt->min, 1, data);
+	#endif
+
+	return insert(rbt, RB_FIRST(rbt), RB_ROOT(rbt), data);
+}
+
+/*
+ * insert (or update) data near hint, a node expected to be close to data's place
+ * O(log d) comparisons for a key d nodes away from hint
+ * return NULL if out of memory
+ */
+rbnode *rb_insert_hint(rbtree *rbt, rbnode *hint, void *data)
+{
+	rbnode *current;
+	int cmp;
+
+	if (hint == NULL)
+		return rb_insert(rbt, data);
+
+	cmp = COMPARE(rbt, data, hint->data);
+
+	#ifndef RB_DUP
+	if (cmp == 0)
+		return update(rbt, hint, data); /* updated */
+	#endif
+
+	current = climb(rbt, hint, data, cmp >= 0);
+
+	return insert(rbt, current, RB_PARENT(current), data);
+}
+
+/*
+ * root of the smallest subtree around node whose key range takes data, data is after node or before it
+ * only the ancestors bounding the range on that side are compared with data
+ */
+rbnode *climb(rbtree *rbt, rbnode *node, void *data, int after)
+{
+	rbnode *current, *parent;
+	int cmp;
+
+	for (current = node; node != RB_FIRST(rbt); node = parent) {
+		parent = RB_PARENT(node);
+		if (after ? node == parent->left : node == parent->right) {
+			/* parent bounds the subtree, an equal key goes right of it */
+			cmp = COMPARE(rbt, data, parent->data);
+			#ifdef RB_DUP
+			if (after ? cmp < 0 : cmp >= 0)
+			#else
+			if (after ? cmp < 0 : cmp > 0)
+			#endif
+				break;
+			current = parent;
+		}
+	}
+
+	return current;
+}
+
+/*
+ * insert (or update) data into the subtree current, whose parent is parent
+ * return NULL if out of memory
+ */
+rbnode *insert(rbtree *rbt, rbnode *current, rbnode *parent, void *data)
+{
+	unsigned long depth;
+	int cmp;
+
+	/* do a binary search to find where it should be */
+
+	cmp = -1;
+
+	for (depth = 0; current != RB_NIL(rbt); depth++) {
+		cmp = COMPARE(rbt, data, current->data);
+
+		#ifndef RB_DUP
+		if (cmp == 0) {
+			STAT_SEARCH(rbt, depth + 1);
+			return update(rbt, current, data); /* updated */
+		}
+		#endif
+
+		parent = current;
+		current = cmp < 0 ? current->left : current->right;
+	}
+
+	STAT_SEARCH(rbt, depth);
+	return insert_at(rbt, parent, cmp < 0, data);
+}
+
+#ifndef RB_DUP
+/*
+ * replace the data of node
+ */
+rbnode *update(rbtree *rbt, rbnode *node, void *data)
+{
+	rbnode *new_node;
+	#ifndef RB_RCU
+	void *swap;
+	#endif
+
+	if (rbt->intrusive) {
+		/* the new record takes the place of the old one */
+		new_node = (rbnode *) data;
+		new_node->data = data;
+		replace_node(rbt, node, new_node);
+		data = node->data;
+	} else {
+		new_node = node;
+		#ifdef RB_RCU
+		/* readers may still compare with the old data, a spare node carries it until they have left */
+		if (rbt->destroy != NULL) {
+			if ((node = node_alloc(rbt, NULL)) == NULL)
+				return NULL; /* out of memory */
+			node->data = new_node->data;
+		}
+		PUBLISH(new_node->data, data);
+		#else
+		swap = node->data;
+		node->data = data;
+		data = swap;
+		#endif
+	}
+
+	if (rbt->augment != NULL)
+		augment_path(rbt, new_node, new_node);
+
+	#ifdef RB_RCU
+	if (node != new_node)
+		retire(rbt, node, rbt->destroy != NULL);
+	#else
+	if (rbt->destroy != NULL)
+		rbt->destroy(data);
+	#endif
+
+	return new_node;
+}
+#endif
+
+/*
+ * attach data as the left (or right) child of parent, which is NIL there, and rebalance
+ * return NULL if out of memory
+ */
+rbnode *insert_at(rbtree *rbt, rbnode *parent, int left, void *data)
+{
+	rbnode *current, *new_node;
+
+	/* replace the termination NIL pointer with the new node pointer */
+
+	current = new_node = node_alloc(rbt, data);
+	if (current == NULL)
+		return NULL; /* out of memory */
+
+	current->left = current->right = RB_NIL(rbt);
+	RB_SET_PARENT_COLOR(current, parent, RED);
+	current->data = data;
+	
+	WRITE_BEGIN(rbt);
+
+	if (left)
+		PUBLISH(parent->left, current);
+	else
+		PUBLISH(parent->right, current);
+
+	/* only the left child of the first node can come before it, no comparison needed */
+	#ifdef RB_MIN
+	if (parent == RB_ROOT(rbt) || (parent == rbt->min && left))
+		rbt->min = current;
+	#endif
+
+	#ifdef RB_MAX
+	if (parent == RB_ROOT(rbt) || (parent == rbt->max && !left))
+		rbt->max = current;
+	#endif
+
+	#ifdef RB_RANK
+	current->size = 1;
+	for (; parent != RB_ROOT(rbt); parent = RB_PARENT(parent))
+		parent->size++;
+	#endif
+
+	if (rbt->augment != NULL)
+		augment_path(rbt, current, current);
+	
+	/*
+	 * insertion into a red-black tree:
+	 *   0-children root cluster (parent node is BLACK) becomes 2-children root cluster (new root node)
+	 *     paint root node BLACK, and done
+	 *   2-children cluster (parent node is BLACK) becomes 3-children cluster
+	 *     done
+	 *   3-children cluster (parent node is BLACK) becomes 4-children cluster
+	 *     done
+	 *   3-children cluster (parent node is RED) becomes 4-children cluster
+	 *     rotate, and done
+	 *   4-children cluster (parent node is RED) splits into 2-children cluster and 3-children cluster
+	 *     split, and insert grandparent node into parent cluster
+	 */
+	if (RB_COLOR(RB_PARENT(current)) == RED) {
+		/* insertion into 3-children cluster (parent node is RED) */
+		/* insertion into 4-children cluster (parent node is RED) */
+		insert_repair(rbt, current);
+	} else {
+		/* insertion into 0-children root cluster (parent node is BLACK) */
+		/* insertion into 2-children cluster (parent node is BLACK) */
+		/* insertion into 3-children cluster (parent node is BLACK) */
+	}
+
+	/*
+	 * the root is always BLACK
+	 * insertion into 0-children root cluster or insertion into 4-children root cluster require this recoloring
+	 */
+	RB_SET_COLOR(RB_FIRST(rbt), BLACK);
+
+	WRITE_END(rbt);
+	
+	return new_node;
+}
+
+/*
+ * rebalance after insertion
+ * RB_ROOT(rbt) is always BLACK, thus never reach beyond RB_FIRST(rbt)
+ * after insert_repair, RB_FIRST(rbt) might be RED
+ */
+void insert_repair(rbtree *rbt, rbnode *current)
+{
+	rbnode *uncle;
+
+	do {
+		/* current node is RED and parent node is RED */
+		STAT(rbt, insert_repairs);
+
+		if (RB_PARENT(current) == RB_PARENT(RB_PARENT(current))->left) {
+			uncle = RB_PARENT(RB_PARENT(current))->right;
+			if (RB_COLOR(uncle) == RED) {
+				/* insertion into 4-children cluster */
+
+				/* split */
+				RB_SET_COLOR(RB_PARENT(current), BLACK);
+				RB_SET_COLOR(uncle, BLACK);
+
+				/* send grandparent node up the tree */
+				current = RB_PARENT(RB_PARENT(current)); /* goto loop or break */
+				RB_SET_COLOR(current, RED);
+			} else {
+				/* insertion into 3-children cluster */
+
+				/* equivalent BST */
+				if (current == RB_PARENT(current)->right) {
+					current = RB_PARENT(current);
+					rotate_left(rbt, current);
+				}
+
+				/* 3-children cluster has two representations */
+				RB_SET_COLOR(RB_PARENT(current), BLACK); /* thus goto break */
+				RB_SET_COLOR(RB_PARENT(RB_PARENT(current)), RED);
+				rotate_right(rbt, RB_PARENT(RB_PARENT(current)));
+			}
+		} else {
+			uncle = RB_PARENT(RB_PARENT(current))->left;
+			if (RB_COLOR(uncle) == RED) {
+				/* insertion into 4-children cluster */
+
+				/* split */
+				RB_SET_COLOR(RB_PARENT(current), BLACK);
+				RB_SET_COLOR(uncle, BLACK);
+
+				/* send grandparent node up the tree */
+				current = RB_PARENT(RB_PARENT(current)); /* goto loop or break */
+				RB_SET_COLOR(current, RED);
+			} else {
+				/* insertion into 3-children cluster */
+
+				/* equivalent BST */
+				if (current == RB_PARENT(current)->left) {
+					current = RB_PARENT(current);
+					rotate_right(rbt, current);
+				}
+
+				/* 3-children cluster has two representations */
+				RB_SET_COLOR(RB_PARENT(current), BLACK); /* thus goto break */
+				RB_SET_COLOR(RB_PARENT(RB_PARENT(current)), RED);
+				rotate_left(rbt, RB_PARENT(RB_PARENT(current)));
+			}
+		}
+	} while (RB_COLOR(RB_PARENT(current)) == RED);
+}
+
+/*
+ * delete node
+ * node is unlinked itself, so other nodes (and intrusive records) never move
+ * return NULL if keep is zero (already freed)
+ */
+void *rb_delete(rbtree *rbt, rbnode *node, int keep)
+{
+	void *data;
+	
+	data = node->data;
+
+	detach(rbt, node);
+
+	#ifdef RB_RCU
+	/* readers may still be on node, it (and discarded data) goes once they have left */
+	retire(rbt, node, keep == 0 && rbt->destroy != NULL);
+	#else
+	node_free(rbt, node);
+	#endif
+	
+	/* keep or discard data */
+	if (keep == 0) {
+		#ifndef RB_RCU
+		if (rbt->destroy != NULL)
+			rbt->destroy(data);
+		#endif
+		data = NULL;
+	}
+
+	return data;
+}
+
+/*
+ * delete the first node, O(1) to find it with RB_MIN
+ * return its data, NULL if the tree is empty
+ */
+void *rb_pop_min(rbtree *rbt)
+{
+	rbnode *node;
+
+	if ((node = leftmost(rbt)) == NULL)
+		return NULL; /* empty */
+
+	return rb_delete(rbt, node, 1);
+}
+
+/*
+ * delete the last node, O(1) to find it with RB_MAX
+ * return its data, NULL if the tree is empty
+ */
+void *rb_pop_max(rbtree *rbt)
+{
+	rbnode *node;
+
+	#ifdef RB_MAX
+	node = rbt->max;
+	#else
+	node = rightmost(rbt);
+	#endif
+	if (node == NULL)
+		return NULL; /* empty */
+
+	return rb_delete(rbt, node, 1);
+}
+
+/*
+ * delete the k first nodes at once, storing their data in order
+ * the k smallest are split off in O(log n) and released in one pass, no repair per node
+ * return the number of nodes deleted
+ */
+size_t rb_pop_min_n(rbtree *rbt, void *data[], size_t k)
+{
+	rbtree left, rest;
+	rbnode *node, *list;
+	size_t i, n;
+
+	/* the node that becomes the first */
+	#ifdef RB_RANK
+	node = rb_select(rbt, k);
+	#else
+	for (node = leftmost(rbt), i = 0; node != NULL && i < k; i++)
+		node = rb_successor(rbt, node);
+	#endif
+
+	n = 0;
+	if (node == NULL) {
+		/* everything goes */
+		list = flatten(rbt, RB_FIRST(rbt), NULL, &n);
+		RB_FIRST(rbt) = RB_NIL(rbt);
+		#ifdef RB_MAX
+		rbt->max = NULL;
+		#endif
+	} else {
+		init_part(rbt, &left);
+		init_part(rbt, &rest);
+		split(rbt, node, &left, &rest);
+		list = flatten(&left, RB_FIRST(&left), NULL, &n);
+
+		RB_FIRST(rbt) = RB_FIRST(&rest);
+		RB_SET_PARENT(RB_FIRST(rbt), RB_ROOT(rbt));
+		STAT_MERGE(rbt, &left);
+		STAT_MERGE(rbt, &rest);
+	}
+
+	#ifdef RB_MIN
+	rbt->min = node;
+	#endif
+
+	for (i = 0; (node = list) != NULL; i++) {
+		list = node->right;
+		data[i] = node->data;
+		node_free(rbt, node);
+	}
+
+	return n;
+}
+
+/*
+ * unlink node from the tree and rebalance, node itself is left alone
+ */
+void detach(rbtree *rbt, rbnode *node)
+{
+	rbnode *target, *child, *parent;
+
+	WRITE_BEGIN(rbt);
+
+	/* choose node's in-order successor if it has two children */
+	
+	if (node->left == RB_NIL(rbt) || node->right == RB_NIL(rbt)) {
+		target = node;
+
+		#ifdef RB_MIN
+		if (rbt->min == target)
+			rbt->min = rb_successor(rbt, target); /* deleted, thus min = successor */
+		#endif
+
+		#ifdef RB_MAX
+		if (rbt->max == target)
+			rbt->max = rb_predecessor(rbt, target); /* deleted, thus max = predecessor */
+		#endif
+	} else {
+		target = rb_successor(rbt, node); /* node->right must not be NIL, thus move down */
+
+		/* target is unlinked from its own position, then takes node's place */
+
+		#ifdef RB_MIN
+		/* if min == node or min == target, then node->left is not NIL, thus impossible */
+		#endif
+
+		#ifdef RB_MAX
+		/* max == node is impossible, if max == target, it stays the last node in node's place */
+		#endif
+	}
+
+	child = (target->left == RB_NIL(rbt)) ? target->right : target->left; /* child may be NIL */
+
+	/*
+	 * deletion from red-black tree
+	 *   4-children cluster (RED target node) becomes 3-children cluster
+	 *     done
+	 *   3-children cluster (RED target node) becomes 2-children cluster
+	 *     done
+	 *   3-children cluster (BLACK target node, RED child node) becomes 2-children cluster
+	 *     paint child node BLACK, and done
+	 *
+	 *	 2-children root cluster (BLACK target node, BLACK child node) becomes 0-children root cluster
+	 *     done
+	 *
+	 *   2-children cluster (BLACK target node, 4-children sibling cluster) becomes 3-children cluster
+	 *     transfer, and done
+	 *   2-children cluster (BLACK target node, 3-children sibling cluster) becomes 2-children cluster
+	 *     transfer, and done
+	 *
+	 *   2-children cluster (BLACK target node, 2-children sibling cluster, 3/4-children parent cluster) becomes 3-children cluster
+	 *     fuse, paint parent node BLACK, and done
+	 *   2-children cluster (BLACK target node, 2-children sibling cluster, 2-children parent cluster) becomes 3-children cluster
+	 *     fuse, and delete parent node from parent cluster
+	 */
+	if (RB_COLOR(target) == BLACK) {
+		if (RB_COLOR(child) == RED) {
+			/* deletion from 3-children cluster (BLACK target node, RED child node) */
+			RB_SET_COLOR(child, BLACK);
+		} else if (target == RB_FIRST(rbt)) {
+			/* deletion from 2-children root cluster (BLACK target node, BLACK child node) */
+		} else {
+			/* deletion from 2-children cluster (BLACK target node, ...) */
+			delete_repair(rbt, target);
+		}
+	} else {
+		/* deletion from 4-children cluster (RED target node) */
+		/* deletion from 3-children cluster (RED target node) */
+	}
+
+	if (child != RB_NIL(rbt))
+		RB_SET_PARENT(child, RB_PARENT(target));
+
+	if (target == RB_PARENT(target)->left)
+		PUBLISH(RB_PARENT(target)->left, child);
+	else
+		PUBLISH(RB_PARENT(target)->right, child);
+
+	#ifdef RB_RANK
+	for (child = RB_PARENT(target); child != RB_ROOT(rbt); child = RB_PARENT(child))
+		child->size--;
+	#endif
+
+	parent = RB_PARENT(target);
+
+	if (target != node)
+		replace_node(rbt, node, target);
+
+	/* target's aggregate is stale in node's place, recompute at least up to there */
+	if (rbt->augment != NULL && parent != RB_ROOT(rbt))
+		augment_path(rbt, parent == node ? target : parent, target != node ? target : NULL);
+
+	WRITE_END(rbt);
+}
+
+/*
+ * recompute aggregates from node up to the root
+ * stop at the first unchanged node once stop, if any, has been recomputed
+ */
+void augment_path(rbtree *rbt, rbnode *node, rbnode *stop)
+{
+	for (; node != RB_ROOT(rbt); node = RB_PARENT(node)) {
+		if (!rbt->augment(node) && stop == NULL)
+			break;
+		if (node == stop)
+			stop = NULL;
+	}
+}
+
+/*
+ * insert record node into an intrusive tree
+ */
+rbnode *rb_insert_node(rbtree *rbt, rbnode *node)
+{
+	return rb_insert(rbt, node);
+}
+
+/*
+ * unlink record node from an intrusive tree, the record is not destroyed
+ */
+void rb_delete_node(rbtree *rbt, rbnode *node)
+{
+	rb_delete(rbt, node, 1);
+}
+
+/*
+ * put node in old's place, taking over its links and color
+ */
+void replace_node(rbtree *rbt, rbnode *old, rbnode *node)
+{
+	PUBLISH(node->left, old->left);
+	PUBLISH(node->right, old->right);
+	RB_SET_PARENT_COLOR(node, RB_PARENT(old), RB_COLOR(old));
+	#ifdef RB_RANK
+	node->size = old->size;
+	#endif
+
+	if (old == RB_PARENT(old)->left)
+		PUBLISH(RB_PARENT(old)->left, node);
+	else
+		PUBLISH(RB_PARENT(old)->right, node);
+
+	if (node->left != RB_NIL(rbt))
+		RB_SET_PARENT(node->left, node);
+	if (node->right != RB_NIL(rbt))
+		RB_SET_PARENT(node->right, node);
+
+	#ifdef RB_MIN
+	if (rbt->min == old)
+		rbt->min = node;
+	#endif
+
+	#ifdef RB_MAX
+	if (rbt->max == old)
+		rbt->max = node;
+	#endif
+}
+
+/*
+ * rebalance after deletion
+ */
+void delete_repair(rbtree *rbt, rbnode *current)
+{
+	rbnode *sibling;
+	do {
+		STAT(rbt, delete_repairs);
+		if (current == RB_PARENT(current)->left) {
+			sibling = RB_PARENT(current)->right;
+
+			if (RB_COLOR(sibling) == RED) {
+				/* perform an adjustment (3-children parent cluster has two representations) */
+				RB_SET_COLOR(sibling, BLACK);
+				RB_SET_COLOR(RB_PARENT(current), RED);
+				rotate_left(rbt, RB_PARENT(current));
+				sibling = RB_PARENT(current)->right;
+			}
+
+			/* sibling node must be BLACK now */
+
+			if (RB_COLOR(sibling->right) == BLACK && RB_COLOR(sibling->left) == BLACK) {
+				/* 2-children sibling cluster, fuse by recoloring */
+				RB_SET_COLOR(sibling, RED);
+				if (RB_COLOR(RB_PARENT(current)) == RED) { /* 3/4-children parent cluster */
+					RB_SET_COLOR(RB_PARENT(current), BLACK);
+					break; /* goto break */
+				} else { /* 2-children parent cluster */
+					current = RB_PARENT(current); /* goto loop */
+				}
+			} else {
+				/* 3/4-children sibling cluster */
+				
+				/* perform an adjustment (3-children sibling cluster has two representations) */
+				if (RB_COLOR(sibling->right) == BLACK) {
+					RB_SET_COLOR(sibling->left, BLACK);
+					RB_SET_COLOR(sibling, RED);
+					rotate_right(rbt, sibling);
+					sibling = RB_PARENT(current)->right;
+				}
+
+				/* transfer by rotation and recoloring */
+				RB_SET_COLOR(sibling, RB_COLOR(RB_PARENT(current)));
+				RB_SET_COLOR(RB_PARENT(current), BLACK);
+				RB_SET_COLOR(sibling->right, BLACK);
+				rotate_left(rbt, RB_PARENT(current));
+				break; /* goto break */
+			}
+		} else {
+			sibling = RB_PARENT(current)->left;
+
+			if (RB_COLOR(sibling) == RED) {
+				/* perform an adjustment (3-children parent cluster has two representations) */
+				RB_SET_COLOR(sibling, BLACK);
+				RB_SET_COLOR(RB_PARENT(current), RED);
+				rotate_right(rbt, RB_PARENT(current));
+				sibling = RB_PARENT(current)->left;
+			}
+
+			/* sibling node must be BLACK now */
+
+			if (RB_COLOR(sibling->right) == BLACK && RB_COLOR(sibling->left) == BLACK) {
+				/* 2-children sibling cluster, fuse by recoloring */
+				RB_SET_COLOR(sibling, RED);
+				if (RB_COLOR(RB_PARENT(current)) == RED) { /* 3/4-children parent cluster */
+					RB_SET_COLOR(RB_PARENT(current), BLACK);
+					break; /* goto break */
+				} else { /* 2-children parent cluster */
+					current = RB_PARENT(current); /* goto loop */
+				}
+			} else {
+				/* 3/4-children sibling cluster */
+
+				/* perform an adjustment (3-children sibling cluster has two representations) */
+				if (RB_COLOR(sibling->left) == BLACK) {
+					RB_SET_COLOR(sibling->right, BLACK);
+					RB_SET_COLOR(sibling, RED);
+					rotate_left(rbt, sibling);
+					sibling = RB_PARENT(current)->left;
+				}
+
+				/* transfer by rotation and recoloring */
+				RB_SET_COLOR(sibling, RB_COLOR(RB_PARENT(current)));
+				RB_SET_COLOR(RB_PARENT(current), BLACK);
+				RB_SET_COLOR(sibling->left, BLACK);
+				rotate_right(rbt, RB_PARENT(current));
+				break; /* goto break */
+			}
+		}
+	} while (current != RB_FIRST(rbt));
+}
+
+/*
+ * build tree from n data sorted in ascending order in linear time, tree must be empty
+ * return non-zero if error (tree not empty, data not sorted or out of memory)
+ */
+int rb_build_sorted(rbtree *rbt, void *data[], size_t n)
+{
+	rbnode *list, *tail, *node;
+	size_t i;
+
+	if (!RB_ISEMPTY(rbt))
+		return 1;
+
+	for (i = 1; i < n; i++) {
+		#ifdef RB_DUP
+		if (COMPARE(rbt, data[i - 1], data[i]) > 0)
+		#else
+		if (COMPARE(rbt, data[i - 1], data[i]) >= 0)
+		#endif
+			return 1; /* not sorted */
+	}
+
+	/* allocate all nodes first, chained in order through right */
+	list = tail = NULL;
+	for (i = 0; i < n; i++) {
+		if ((node = node_alloc(rbt, data[i])) == NULL) {
+			while ((node = list) != NULL) {
+				list = node->right;
+				node_free(rbt, node);
+			}
+			return 1; /* out of memory */
+		}
+		node->data = data[i];
+		node->right = NULL;
+		if (tail == NULL)
+			list = node;
+		else
+			tail->right = node;
+		tail = node;
+	}
+
+	rebuild(rbt, list, n);
+
+	return 0;
+}
+
+/*
+ * replace the tree with n nodes chained in order through right
+ */
+void rebuild(rbtree *rbt, rbnode *list, size_t n)
+{
+	int red_depth;
+
+	/* a balanced tree with all levels full except the deepest one, which is painted RED */
+	for (red_depth = 0; ((size_t) 2 << red_depth) <= n + 1; red_depth++) ;
+
+	#ifdef RB_MIN
+	rbt->min = n > 0 ? list : NULL;
+	#endif
+
+	RB_FIRST(rbt) = build(rbt, &list, n, 0, red_depth, RB_ROOT(rbt));
+
+	#ifdef RB_MAX
+	rbt->max = rightmost(rbt);
+	#endif
+}
+
+/*
+ * build subtree of n nodes taken in order from list
+ */
+rbnode *build(rbtree *rbt, rbnode **list, size_t n, int depth, int red_depth, rbnode *parent)
+{
+	rbnode *left, *node;
+
+	if (n == 0)
+		return RB_NIL(rbt);
+
+	left = build(rbt, list, (n - 1) / 2, depth + 1, red_depth, NULL);
+
+	node = *list;
+	*list = node->right;
+
+	node->left = left;
+	if (left != RB_NIL(rbt))
+		RB_SET_PARENT(left, node);
+	RB_SET_PARENT_COLOR(node, parent, depth == red_depth ? RED : BLACK);
+
+	node->right = build(rbt, list, n - 1 - (n - 1) / 2, depth + 1, red_depth, node);
+
+	#ifdef RB_RANK
+	node->size = n;
+	#endif
+
+	if (rbt->augment != NULL)
+		rbt->augment(node);
+
+	return node;
+}
+
+#ifdef RB_PARALLEL
+/*
+ * rb_build_sorted with threads
+ * the nodes are allocated and the subtrees below the top levels built in parallel, a pooled tree allocates in one thread
+ * return non-zero if error (tree not empty, data not sorted or out of memory)
+ */
+int rb_build_sorted_parallel(rbtree *rbt, void *data[], size_t n, int threads)
+{
+	struct rbjob job;
+	struct rbtask *task;
+	size_t i, chunk;
+
+	if (!RB_ISEMPTY(rbt))
+		return 1;
+
+	if (n < RB_PARALLEL_MIN || job_init(&job, rbt, threads) != 0)
+		return rb_build_sorted(rbt, data, n);
+
+	if ((job.nodes = (rbnode **) calloc(n, sizeof(rbnode *))) == NULL) {
+		free(job.tasks);
+		return 1; /* out of memory */
+	}
+
+	/* check the order and allocate the nodes in chunks, each chained in order through right */
+	job.run = alloc_task;
+	job.data = data;
+	chunk = (n + ((size_t) 1 << job.split) - 1) >> job.split;
+	for (i = 0; i < n; i += chunk) {
+		task = &job.tasks[job.count++];
+		task->lo = i;
+		task->n = n - i < chunk ? n - i : chunk;
+	}
+	parallel(&job, rbt->pool == NULL ? threads : 1);
+
+	if (job.err != 0) {
+		for (i = 0; i < n; i++) {
+			if (job.nodes[i] != NULL)
+				node_free(rbt, job.nodes[i]);
+		}
+		free(job.nodes);
+		free(job.tasks);
+		return 1; /* not sorted or out of memory */
+	}
+
+	for (i = chunk; i < n; i += chunk)
+		job.nodes[i - 1]->right = job.nodes[i];
+
+	/* the same shape as rebuild, the top levels here and the subtrees below them in parallel */
+	for (job.red_depth = 0; ((size_t) 2 << job.red_depth) <= n + 1; job.red_depth++) ;
+
+	job.run = build_task;
+	job.count = 0;
+	build_top(&job, 0, n, 0, RB_ROOT(rbt), &RB_FIRST(rbt));
+	parallel(&job, threads);
+
+	/* the top levels come in preorder, so backwards every node comes after its subtrees */
+	if (rbt->augment != NULL) {
+		for (i = job.count; i > 0; i--) {
+			if (!job.tasks[i - 1].whole)
+				rbt->augment(job.tasks[i - 1].node);
+		}
+	}
+
+	#ifdef RB_MIN
+	rbt->min = job.nodes[0];
+	#endif
+
+	#ifdef RB_MAX
+	rbt->max = job.nodes[n - 1];
+	#endif
+
+	free(job.nodes);
+	free(job.tasks);
+
+	return 0;
+}
+
+/*
+ * apply func to all data with threads, in no particular order
+ * func is called from several threads at once
+ * return non-zero if func does, the first error stops the threads at their next subtree
+ */
+int rb_apply_parallel(rbtree *rbt, int (*func)(void *, void *), void *cookie, int threads)
+{
+	struct rbjob job;
+
+	if (job_init(&job, rbt, threads) != 0)
+		return RB_APPLY(rbt, func, cookie, INORDER);
+
+	job.run = apply_task;
+	job.func = func;
+	job.cookie = cookie;
+	divide(&job, RB_FIRST(rbt), 0);
+	parallel(&job, threads);
+
+	free(job.tasks);
+
+	return job.err;
+}
+
+/*
+ * rb_destroy with threads, the destroy function is called from several threads at once
+ * subtrees are destroyed in parallel when rb_destroy would walk them, except into a pool shared after rb_split
+ */
+void rb_destroy_parallel(rbtree *rbt, int threads)
+{
+	struct rbjob job;
+
+	if (((rbt->pool == NULL && !rbt->intrusive) || rbt->destroy != NULL) && (rbt->pool == NULL || rbt->pool->refs == 1) && \
+		job_init(&job, rbt, threads) == 0) {
+		job.run = destroy_task;
+		divide(&job, RB_FIRST(rbt), 0);
+		parallel(&job, threads);
+		free(job.tasks);
+		RB_FIRST(rbt) = RB_NIL(rbt);
+	}
+
+	rb_destroy(rbt);
+}
+
+/*
+ * prepare a job, split deep enough for RB_PARALLEL_TASKS subtrees per thread
+ * return non-zero if not worth threads or out of memory
+ */
+int job_init(struct rbjob *job, rbtree *rbt, int threads)
+{
+	if (threads <= 1)
+		return 1;
+
+	for (job->split = 0; ((size_t) 1 << job->split) < (size_t) threads * RB_PARALLEL_TASKS; job->split++) ;
+
+	/* subtrees at depth split and the nodes above them */
+	if ((job->tasks = (struct rbtask *) malloc(((size_t) 2 << job->split) * sizeof(struct rbtask))) == NULL)
+		return 1; /* out of memory */
+
+	job->rbt = rbt;
+	job->count = 0;
+	job->err = 0;
+
+	return 0;
+}
+
+/*
+ * record the first error
+ */
+void job_fail(struct rbjob *job, int err)
+{
+	int none = 0;
+
+	__atomic_compare_exchange_n(&job->err, &none, err, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+/*
+ * run the tasks with threads, the caller being one of them
+ * if no thread can be started, the caller runs them all
+ */
+void parallel(struct rbjob *job, int threads)
+{
+	pthread_t *tids;
+	int i, started;
+
+	job->next = 0;
+
+	started = 0;
+	if ((tids = (pthread_t *) malloc((threads - 1) * sizeof(pthread_t))) != NULL) {
+		while (started < threads - 1 && pthread_create(&tids[started], NULL, worker, job) == 0)
+			started++;
+	}
+
+	worker(job);
+
+	for (i = 0; i < started; i++)
+		pthread_join(tids[i], NULL);
+	free(tids);
+}
+
+/*
+ * take tasks until none is left or one has failed
+ */
+void *worker(void *arg)
+{
+	struct rbjob *job = (struct rbjob *) arg;
+	size_t i;
+
+	while (__atomic_load_n(&job->err, __ATOMIC_RELAXED) == 0 && (i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED)) < job->count)
+		job->run(job, &job->tasks[i]);
+
+	return NULL;
+}
+
+/*
+ * a task for each subtree at depth split and each node above them, before threads start
+ */
+void divide(struct rbjob *job, rbnode *node, int depth)
+{
+	struct rbtask *task;
+
+	if (node == RB_NIL(job->rbt))
+		return;
+
+	task = &job->tasks[job->count++];
+	task->node = node;
+	task->whole = depth == job->split;
+
+	if (!task->whole) {
+		divide(job, node->left, depth + 1);
+		divide(job, node->right, depth + 1);
+	}
+}
+
+/*
+ * link the top levels of the tree over nodes lo .. lo + n - 1, leaving a task for each subtree at depth split
+ * the top nodes are recorded in preorder for augment
+ */
+void build_top(struct rbjob *job, size_t lo, size_t n, int depth, rbnode *parent, rbnode **link)
+{
+	struct rbtask *task;
+	rbnode *node;
+	size_t left;
+
+	if (n == 0) {
+		*link = RB_NIL(job->rbt);
+		return;
+	}
+
+	task = &job->tasks[job->count++];
+	task->whole = depth == job->split;
+
+	if (task->whole) {
+		task->node = parent;
+		task->link = link;
+		task->depth = depth;
+		task->lo = lo;
+		task->n = n;
+		return;
+	}
+
+	left = (n - 1) / 2;
+	node = job->nodes[lo + left];
+	task->node = node;
+	*link = node;
+	RB_SET_PARENT_COLOR(node, parent, depth == job->red_depth ? RED : BLACK);
+	#ifdef RB_RANK
+	node->size = n;
+	#endif
+
+	build_top(job, lo, left, depth + 1, node, &node->left);
+	build_top(job, lo + left + 1, n - 1 - left, depth + 1, node, &node->right);
+}
+
+/*
+ * check the order of a chunk of data and allocate its nodes
+ */
+void alloc_task(struct rbjob *job, struct rbtask *task)
+{
+	rbtree *rbt = job->rbt;
+	rbnode *node;
+	size_t i;
+
+	for (i = task->lo; i < task->lo + task->n; i++) {
+		#ifdef RB_DUP
+		if (i > 0 && COMPARE(rbt, job->data[i - 1], job->data[i]) > 0)
+		#else
+		if (i > 0 && COMPARE(rbt, job->data[i - 1], job->data[i]) >= 0)
+		#endif
+		{
+			job_fail(job, 1); /* not sorted */
+			return;
+		}
+
+		if ((node = node_alloc(rbt, job->data[i])) == NULL) {
+			job_fail(job, 1); /* out of memory */
+			return;
+		}
+		node->data = job->data[i];
+		job->nodes[i] = node;
+		if (i > task->lo)
+			job->nodes[i - 1]->right = node;
+	}
+}
+
+/*
+ * build a subtree below the top levels
+ */
+void build_task(struct rbjob *job, struct rbtask *task)
+{
+	rbnode *list;
+
+	if (task->whole) {
+		list = job->nodes[task->lo];
+		*task->link = build(job->rbt, &list, task->n, task->depth, job->red_depth, task->node);
+	}
+}
+
+void apply_task(struct rbjob *job, struct rbtask *task)
+{
+	int err;
+
+	if (task->whole)
+		err = rb_apply_node(job->rbt, task->node, job->func, job->cookie, INORDER);
+	else
+		err = job->func(task->node->data, job->cookie);
+
+	if (err != 0)
+		job_fail(job, err);
+}
+
+void destroy_task(struct rbjob *job, struct rbtask *task)
+{
+	rbtree *rbt = job->rbt;
+
+	if (task->whole) {
+		discard(rbt, task->node);
+	} else {
+		if (rbt->destroy != NULL)
+			rbt->destroy(task->node->data);
+		if (rbt->pool == NULL && !rbt->intrusive)
+			free(task->node);
+	}
+}
+
+/*
+ * destroy subtree without touching the pool, which is not shared between threads
+ * pooled nodes go with their slabs
+ */
+void discard(rbtree *rbt, rbnode *n)
+{
+	if (n == RB_NIL(rbt))
+		return;
+
+	discard(rbt, n->left);
+	discard(rbt, n->right);
+	if (rbt->destroy != NULL)
+		rbt->destroy(n->data);
+	if (rbt->pool == NULL && !rbt->intrusive)
+		free(n);
+}
+#endif
+
+/*
+ * insert n data, data may be reordered
+ *   a small batch is inserted one by one
+ *   a larger batch is sorted, and each key searched from the previous key's node instead of the root
+ *   a batch as large as the tree is sorted and merged, and the tree rebuilt
+ * return non-zero if out of memory, data inserted so far stay in the tree
+ */
+int rb_insert_batch(rbtree *rbt, void *data[], size_t n)
+{
+	rbnode *last, *current, *parent, *list, *batch, *tail, **link, *node;
+	#ifndef RB_DUP
+	rbnode **tail_link;
+	#endif
+	void **tmp;
+	size_t i, size, estimate;
+
+	estimate = size_estimate(rbt);
+
+	if (n * RB_BATCH_FINGER < estimate) {
+		/* keys are far apart, nothing to share between searches */
+		for (i = 0; i < n; i++) {
+			if (rb_insert(rbt, data[i]) == NULL)
+				return 1; /* out of memory */
+		}
+		return 0;
+	}
+
+	/* stable sort, skipped if already sorted */
+	for (i = 1; i < n && COMPARE(rbt, data[i - 1], data[i]) <= 0; i++) ;
+	if (i < n) {
+		if ((tmp = (void **) malloc(n * sizeof(void *))) == NULL)
+			return 1; /* out of memory */
+		sort(rbt, data, tmp, n);
+		free(tmp);
+	}
+
+	if (n >= estimate * RB_BATCH_REBUILD) {
+		/* allocate all nodes first, chained in order through right */
+		batch = tail = NULL;
+		for (i = 0; i < n; i++) {
+			if ((node = node_alloc(rbt, data[i])) == NULL) {
+				while ((node = batch) != NULL) {
+					batch = node->right;
+					node_free(rbt, node);
+				}
+				return 1; /* out of memory */
+			}
+			node->data = data[i];
+			node->right = NULL;
+			if (tail == NULL)
+				batch = node;
+			else
+				tail->right = node;
+			tail = node;
+		}
+
+		size = 0;
+		list = flatten(rbt, RB_FIRST(rbt), NULL, &size);
+
+		/* merge, the tree's node first among equal keys */
+		link = &list;
+		tail = NULL;
+		while (batch != NULL) {
+			if (*link != NULL && COMPARE(rbt, (*link)->data, batch->data) <= 0) {
+				node = *link;
+			} else {
+				node = batch;
+				batch = batch->right;
+				node->right = *link;
+				*link = node;
+				size++;
+			}
+
+			#ifndef RB_DUP
+			if (tail != NULL && COMPARE(rbt, tail->data, node->data) == 0) {
+				/* the later one replaces the earlier one */
+				*tail_link = node;
+				if (rbt->destroy != NULL)
+					rbt->destroy(tail->data);
+				node_free(rbt, tail);
+				size--;
+			} else {
+				tail_link = link;
+			}
+			#endif
+
+			tail = node;
+			link = &node->right;
+		}
+
+		rebuild(rbt, list, size);
+
+		return 0;
+	}
+
+	last = NULL;
+	for (i = 0; i < n; i++) {
+		if (last == NULL) {
+			current = RB_FIRST(rbt);
+			parent = RB_ROOT(rbt);
+		} else {
+			/* climb from the previous node until data falls inside the subtree */
+			current = climb(rbt, last, data[i], 1);
+			parent = RB_PARENT(current);
+		}
+
+		if ((last = insert(rbt, current, parent, data[i])) == NULL)
+			return 1; /* out of memory */
+	}
+
+	return 0;
+}
+
+/*
+ * chain the nodes of subtree in order through right, in front of list
+ */
+rbnode *flatten(rbtree *rbt, rbnode *node, rbnode *list, size_t *n)
+{
+	while (node != RB_NIL(rbt)) {
+		list = flatten(rbt, node->right, list, n);
+		node->right = list;
+		list = node;
+		(*n)++;
+		node = node->left;
+	}
+
+	return list;
+}
+
+/*
+ * stable merge sort of data by compare, tmp holds n pointers
+ */
+void sort(rbtree *rbt, void *data[], void *tmp[], size_t n)
+{
+	size_t width, lo, mid, hi, i, j, k;
+
+	for (width = 1; width < n; width *= 2) {
+		for (lo = 0; lo < n; lo += 2 * width) {
+			mid = lo + width < n ? lo + width : n;
+			hi = mid + width < n ? mid + width : n;
+			for (i = lo, j = mid, k = lo; k < hi; k++) {
+				if (i < mid && (j >= hi || COMPARE(rbt, data[i], data[j]) <= 0))
+					tmp[k] = data[i++];
+				else
+					tmp[k] = data[j++];
+			}
+		}
+		for (k = 0; k < n; k++)
+			data[k] = tmp[k];
+	}
+}
+
+/*
+ * join other into rbt around pivot, every key in rbt <= pivot <= every key in other
+ * both trees must share compare, augment, destroy and node allocation, other is left empty
+ * return non-zero if error
+ */
+int rb_join(rbtree *rbt, void *pivot, rbtree *other)
+{
+	rbnode *max, *min, *node;
+
+	if (rbt == other || rbt->compare != other->compare || rbt->pool != other->pool || rbt->intrusive != other->intrusive || \
+		rbt->augment != other->augment || rbt->destroy != other->destroy)
+		return 1; /* incompatible trees */
+
+	for (max = RB_FIRST(rbt); max != RB_NIL(rbt) && max->right != RB_NIL(rbt); max = max->right) ;
+	for (min = RB_FIRST(other); min != RB_NIL(other) && min->left != RB_NIL(other); min = min->left) ;
+
+	#ifdef RB_DUP
+	if ((max != RB_NIL(rbt) && COMPARE(rbt, max->data, pivot) > 0) || (min != RB_NIL(other) && COMPARE(rbt, pivot, min->data) > 0))
+	#else
+	if ((max != RB_NIL(rbt) && COMPARE(rbt, max->data, pivot) >= 0) || (min != RB_NIL(other) && COMPARE(rbt, pivot, min->data) >= 0))
+	#endif
+		return 1; /* out of order */
+
+	if ((node = node_alloc(rbt, pivot)) == NULL)
+		return 1; /* out of memory */
+	node->data = pivot;
+
+	#ifdef RB_MIN
+	if (rbt->min == NULL)
+		rbt->min = node;
+	other->min = NULL;
+	#endif
+
+	#ifdef RB_MAX
+	rbt->max = RB_ISEMPTY(other) ? node : other->max;
+	other->max = NULL;
+	#endif
+
+	join(rbt, RB_FIRST(rbt), black_height(rbt, RB_FIRST(rbt)), node, RB_FIRST(other), black_height(other, RB_FIRST(other)));
+	RB_FIRST(other) = RB_NIL(other);
+
+	return 0;
+}
+
+/*
+ * join other into rbt, every key in rbt <= every key in other
+ * other's first node becomes the pivot, so unlike rb_join nothing is allocated
+ * both trees must share compare, augment, destroy and node allocation, other is left empty
+ * return non-zero if error
+ */
+int rb_concat(rbtree *rbt, rbtree *other)
+{
+	rbnode *max, *pivot;
+
+	if (rbt == other || rbt->compare != other->compare || rbt->pool != other->pool || rbt->intrusive != other->intrusive || \
+		rbt->augment != other->augment || rbt->destroy != other->destroy)
+		return 1; /* incompatible trees */
+
+	if ((pivot = leftmost(other)) == NULL)
+		return 0; /* nothing to join */
+
+	for (max = RB_FIRST(rbt); max != RB_NIL(rbt) && max->right != RB_NIL(rbt); max = max->right) ;
+
+	#ifdef RB_DUP
+	if (max != RB_NIL(rbt) && COMPARE(rbt, max->data, pivot->data) > 0)
+	#else
+	if (max != RB_NIL(rbt) && COMPARE(rbt, max->data, pivot->data) >= 0)
+	#endif
+		return 1; /* out of order */
+
+	detach(other, pivot);
+
+	#ifdef RB_MIN
+	if (rbt->min == NULL)
+		rbt->min = pivot;
+	other->min = NULL;
+	#endif
+
+	#ifdef RB_MAX
+	rbt->max = RB_ISEMPTY(other) ? pivot : other->max;
+	other->max = NULL;
+	#endif
+
+	join(rbt, RB_FIRST(rbt), black_height(rbt, RB_FIRST(rbt)), pivot, RB_FIRST(other), black_height(other, RB_FIRST(other)));
+	RB_FIRST(other) = RB_NIL(other);
+
+	return 0;
+}
+
+/*
+ * split rbt into *lo with keys less than data and *hi with the rest, rbt is left empty
+ * lo and hi share rbt's compare, destroy and node allocation
+ * return non-zero if out of memory
+ */
+int rb_split(rbtree *rbt, void *data, rbtree **lo, rbtree **hi)
+{
+	rbnode *node;
+
+	if ((*lo = create_shared(rbt)) == NULL)
+		return 1; /* out of memory */
+	if ((*hi = create_shared(rbt)) == NULL) {
+		rb_destroy(*lo);
+		*lo = NULL;
+		return 1; /* out of memory */
+	}
+
+	if ((node = bound(rbt, data, 0)) != NULL) {
+		split(rbt, node, *lo, *hi);
+		/* the split is rbt's work, lo and hi count from zero */
+		STAT_MERGE(rbt, *lo);
+		STAT_MERGE(rbt, *hi);
+	} else if (!RB_ISEMPTY(rbt)) {
+		/* everything is less than data */
+		RB_FIRST(*lo) = RB_FIRST(rbt);
+		RB_SET_PARENT(RB_FIRST(*lo), RB_ROOT(*lo));
+		#ifdef RB_MIN
+		(*lo)->min = rbt->min;
+		#endif
+		#ifdef RB_MAX
+		(*lo)->max = rbt->max;
+		#endif
+	}
+
+	RB_FIRST(rbt) = RB_NIL(rbt);
+	#ifdef RB_MIN
+	rbt->min = NULL;
+	#endif
+	#ifdef RB_MAX
+	rbt->max = NULL;
+	#endif
+
+	return 0;
+}
+
+/*
+ * delete all nodes with lo <= key <= hi, their data is handed to take in order, or destroyed if take is NULL
+ * the range is split off and released, then the rest is joined back, O(k + log n) for k nodes
+ * return the number of nodes deleted
+ */
+size_t rb_delete_range(rbtree *rbt, void *lo, void *hi, void (*take)(void *, void *), void *cookie)
+{
+	rbtree left, middle, rest, right;
+	rbnode *first, *last, *pivot;
+	size_t count;
+
+	if ((first = bound(rbt, lo, 0)) == NULL || COMPARE(rbt, first->data, hi) > 0)
+		return 0; /* nothing in range */
+
+	init_part(rbt, &left);
+	init_part(rbt, &middle);
+	init_part(rbt, &rest);
+	init_part(rbt, &right);
+
+	split(rbt, first, &left, &rest);
+	if ((last = bound(&rest, hi, 1)) != NULL) {
+		split(&rest, last, &middle, &right);
+		count = drop(&middle, take, cookie);
+	} else {
+		count = drop(&rest, take, cookie);
+	}
+	STAT_MERGE(rbt, &middle);
+	STAT_MERGE(rbt, &rest);
+
+	#ifdef RB_MIN
+	rbt->min = left.min;
+	#endif
+
+	if (RB_ISEMPTY(&right)) {
+		RB_FIRST(rbt) = RB_FIRST(&left);
+		if (RB_FIRST(rbt) != RB_NIL(rbt))
+			RB_SET_PARENT(RB_FIRST(rbt), RB_ROOT(rbt));
+	} else {
+		/* the first node of right becomes the pivot */
+		for (pivot = RB_FIRST(&right); pivot->left != RB_NIL(rbt); pivot = pivot->left) ;
+		detach(&right, pivot);
+		join(rbt, RB_FIRST(&left), black_height(&left, RB_FIRST(&left)), pivot, RB_FIRST(&right), black_height(&right, RB_FIRST(&right)));
+
+		#ifdef RB_MIN
+		if (rbt->min == NULL)
+			rbt->min = pivot;
+		#endif
+	}
+	STAT_MERGE(rbt, &left);
+	STAT_MERGE(rbt, &right);
+
+	#ifdef RB_MAX
+	rbt->max = rightmost(rbt);
+	#endif
+
+	return count;
+}
+
+/*
+ * free every node of part, handing its data to take in order, or to the tree's destroy if take is NULL
+ * return the number of nodes
+ */
+size_t drop(rbtree *part, void (*take)(void *, void *), void *cookie)
+{
+	rbnode *node, *list;
+	size_t n;
+
+	if (take == NULL)
+		return destroy(part, RB_FIRST(part));
+
+	n = 0;
+	list = flatten(part, RB_FIRST(part), NULL, &n);
+	while ((node = list) != NULL) {
+		list = node->right;
+		take(node->data, cookie);
+		node_free(part, node);
+	}
+
+	return n;
+}
+
+/*
+ * the first node greater than data if upper, otherwise the first node not less than data
+ * return NULL if none
+ */
+rbnode *bound(rbtree *rbt, void *data, int upper)
+{
+	unsigned long depth;
+	rbnode *p, *node;
+	int cmp;
+
+	node = NULL;
+	for (depth = 0, p = RB_FIRST(rbt); p != RB_NIL(rbt); depth++) {
+		cmp = COMPARE(rbt, data, p->data);
+		if (cmp < 0 || (cmp == 0 && !upper)) {
+			node = p;
+			p = p->left;
+		} else {
+			p = p->right;
+		}
+	}
+
+	STAT_SEARCH(rbt, depth);
+	return node;
+}
+
+/*
+ * empty tree sharing compare, destroy and node allocation with rbt
+ * return NULL if out of memory
+ */
+rbtree *create_shared(rbtree *rbt)
+{
+	rbtree *shared;
 
-		parent = current;
-		current = cmp < 0 ? current->left : current->right;
-	}
+	if ((shared = (rbtree *) malloc(sizeof(rbtree))) == NULL)
+		return NULL; /* out of memory */
 
-	/* replace the termination NIL pointer with the new node pointer */
+	init_part(rbt, shared);
+	if (shared->pool != NULL)
+		shared->pool->refs++;
 
-	current = new_node = (rbnode *) malloc(sizeof(rbnode));
-	if (current == NULL)
-		return NULL; /* out of memory */
+	return shared;
+}
 
-	current->left = current->right = RB_NIL(rbt);
-	current->parent = parent;
-	current->color = RED;
-	current->data = data;
-	
-	if (parent == RB_ROOT(rbt) || rbt->compare(data, parent->data) < 0)
-		parent->left = current;
-	else
-		parent->right = current;
+/*
+ * empty tree with rbt's settings, for the pieces of a split
+ */
+void init_part(rbtree *rbt, rbtree *part)
+{
+	*part = *rbt;
+
+	part->root.left = part->root.right = RB_NIL(rbt);
+	RB_SET_PARENT_COLOR(RB_ROOT(part), RB_NIL(rbt), BLACK);
+	part->root.data = NULL;
 
 	#ifdef RB_MIN
-	if (rbt->min == NULL || rbt->compare(current->data, rbt->min->data) < 0)
-		rbt->min = current;
+	part->min = NULL;
 	#endif
-	
-	/*
-	 * insertion into a red-black tree:
-	 *   0-children root cluster (parent node is BLACK) becomes 2-children root cluster (new root node)
-	 *     paint root node BLACK, and done
-	 *   2-children cluster (parent node is BLACK) becomes 3-children cluster
-	 *     done
-	 *   3-children cluster (parent node is BLACK) becomes 4-children cluster
-	 *     done
-	 *   3-children cluster (parent node is RED) becomes 4-children cluster
-	 *     rotate, and done
-	 *   4-children cluster (parent node is RED) splits into 2-children cluster and 3-children cluster
-	 *     split, and insert grandparent node into parent cluster
-	 */
-	if (current->parent->color == RED) {
-		/* insertion into 3-children cluster (parent node is RED) */
-		/* insertion into 4-children cluster (parent node is RED) */
-		insert_repair(rbt, current);
-	} else {
-		/* insertion into 0-children root cluster (parent node is BLACK) */
-		/* insertion into 2-children cluster (parent node is BLACK) */
-		/* insertion into 3-children cluster (parent node is BLACK) */
-	}
 
-	/*
-	 * the root is always BLACK
-	 * insertion into 0-children root cluster or insertion into 4-children root cluster require this recoloring
-	 */
-	RB_FIRST(rbt)->color = BLACK;
-	
-	return new_node;
+	#ifdef RB_MAX
+	part->max = NULL;
+	#endif
+
+	#ifdef RB_RCU
+	part->readers = NULL;
+	part->readers_lock = 0;
+	part->retired[0] = part->retired[1] = NULL;
+	part->retired_count = 0;
+	#endif
+
+	#ifdef RB_STATS
+	rb_stats_reset(part);
+	#endif
 }
 
 /*
- * rebalance after insertion
- * RB_ROOT(rbt) is always BLACK, thus never reach beyond RB_FIRST(rbt)
- * after insert_repair, RB_FIRST(rbt) might be RED
+ * split rbt before node, the nodes in order before node go to lo and the rest to hi
+ * climbing from node, each ancestor and its other subtree are joined to the side they belong to
+ * the joins cost the difference of black heights, which adds up to O(log n)
  */
-void insert_repair(rbtree *rbt, rbnode *current)
+void split(rbtree *rbt, rbnode *node, rbtree *lo, rbtree *hi)
 {
-	rbnode *uncle;
+	rbnode *parent, *next, *left;
+	int h, lh, rh, color;
 
-	do {
-		/* current node is RED and parent node is RED */
+	/* read the links before join rewrites them */
+	h = black_height(rbt, node);
+	color = RB_COLOR(node);
+	parent = RB_PARENT(node);
+	left = node->left;
 
-		if (current->parent == current->parent->parent->left) {
-			uncle = current->parent->parent->right;
-			if (uncle->color == RED) {
-				/* insertion into 4-children cluster */
+	lh = h - (color == BLACK);
+	rh = join(hi, RB_NIL(hi), 0, node, node->right, lh);
 
-				/* split */
-				current->parent->color = BLACK;
-				uncle->color = BLACK;
+	#ifdef RB_MIN
+	hi->min = node;
+	#endif
 
-				/* send grandparent node up the tree */
-				current = current->parent->parent; /* goto loop or break */
-				current->color = RED;
-			} else {
-				/* insertion into 3-children cluster */
+	#ifdef RB_MAX
+	hi->max = rbt->max;
+	#endif
 
-				/* equivalent BST */
-				if (current == current->parent->right) {
-					current = current->parent;
-					rotate_left(rbt, current);
-				}
+	/* h is the black height of the subtree just left behind, the same as its sibling's */
+	for (; parent != RB_ROOT(rbt); node = parent, parent = next) {
+		next = RB_PARENT(parent);
+		color = RB_COLOR(parent);
 
-				/* 3-children cluster has two representations */
-				current->parent->color = BLACK; /* thus goto break */
-				current->parent->parent->color = RED;
-				rotate_right(rbt, current->parent->parent);
-			}
+		if (node == parent->left) {
+			rh = join(hi, RB_FIRST(hi), rh, parent, parent->right, h);
 		} else {
-			uncle = current->parent->parent->left;
-			if (uncle->color == RED) {
-				/* insertion into 4-children cluster */
-
-				/* split */
-				current->parent->color = BLACK;
-				uncle->color = BLACK;
+			lh = join(lo, parent->left, h, parent, left, lh);
+			left = RB_FIRST(lo);
+		}
 
-				/* send grandparent node up the tree */
-				current = current->parent->parent; /* goto loop or break */
-				current->color = RED;
-			} else {
-				/* insertion into 3-children cluster */
+		h += color == BLACK;
+	}
 
-				/* equivalent BST */
-				if (current == current->parent->left) {
-					current = current->parent;
-					rotate_right(rbt, current);
-				}
+	RB_FIRST(lo) = left;
+	if (left != RB_NIL(lo)) {
+		RB_SET_PARENT_COLOR(left, RB_ROOT(lo), BLACK);
+		#ifdef RB_MIN
+		lo->min = rbt->min;
+		#endif
+	}
 
-				/* 3-children cluster has two representations */
-				current->parent->color = BLACK; /* thus goto break */
-				current->parent->parent->color = RED;
-				rotate_left(rbt, current->parent->parent);
-			}
-		}
-	} while (current->parent->color == RED);
+	#ifdef RB_MAX
+	lo->max = rightmost(lo);
+	#endif
 }
 
 /*
- * delete node
- * return NULL if keep is zero (already freed)
+ * link left subtree, pivot and right subtree of black heights lbh and rbh as the whole of rbt
+ * return the black height of the result
  */
-void *rb_delete(rbtree *rbt, rbnode *node, int keep)
+int join(rbtree *rbt, rbnode *left, int lbh, rbnode *pivot, rbnode *right, int rbh)
 {
-	rbnode *target, *child;
-	void *data;
-	
-	data = node->data;
-
-	/* choose node's in-order successor if it has two children */
-	
-	if (node->left == RB_NIL(rbt) || node->right == RB_NIL(rbt)) {
-		target = node;
-
-		#ifdef RB_MIN
-		if (rbt->min == target)
-			rbt->min = rb_successor(rbt, target); /* deleted, thus min = successor */
-		#endif
-	} else {
-		target = rb_successor(rbt, node); /* node->right must not be NIL, thus move down */
+	rbnode *current, *parent;
+	int h;
 
-		node->data = target->data; /* data swapped */
+	/* a RED root painted BLACK adds one to the black height */
+	if (RB_COLOR(left) == RED) {
+		RB_SET_COLOR(left, BLACK);
+		lbh++;
+	}
+	if (RB_COLOR(right) == RED) {
+		RB_SET_COLOR(right, BLACK);
+		rbh++;
+	}
 
-		#ifdef RB_MIN
-		/* if min == node, then min = successor = node (swapped), thus idle */
-		/* if min == target, then min = successor, which is not the minimal, thus impossible */
+	if (lbh == rbh) {
+		/* pivot on top as a BLACK root */
+		pivot->left = left;
+		pivot->right = right;
+		if (left != RB_NIL(rbt))
+			RB_SET_PARENT(left, pivot);
+		if (right != RB_NIL(rbt))
+			RB_SET_PARENT(right, pivot);
+		RB_SET_PARENT_COLOR(pivot, RB_ROOT(rbt), BLACK);
+		#ifdef RB_RANK
+		pivot->size = left->size + right->size + 1;
 		#endif
+		if (rbt->augment != NULL)
+			rbt->augment(pivot);
+		RB_FIRST(rbt) = pivot;
+		return lbh + 1;
 	}
 
-	child = (target->left == RB_NIL(rbt)) ? target->right : target->left; /* child may be NIL */
-
 	/*
-	 * deletion from red-black tree
-	 *   4-children cluster (RED target node) becomes 3-children cluster
-	 *     done
-	 *   3-children cluster (RED target node) becomes 2-children cluster
-	 *     done
-	 *   3-children cluster (BLACK target node, RED child node) becomes 2-children cluster
-	 *     paint child node BLACK, and done
-	 *
-	 *	 2-children root cluster (BLACK target node, BLACK child node) becomes 0-children root cluster
-	 *     done
-	 *
-	 *   2-children cluster (BLACK target node, 4-children sibling cluster) becomes 3-children cluster
-	 *     transfer, and done
-	 *   2-children cluster (BLACK target node, 3-children sibling cluster) becomes 2-children cluster
-	 *     transfer, and done
-	 *
-	 *   2-children cluster (BLACK target node, 2-children sibling cluster, 3/4-children parent cluster) becomes 3-children cluster
-	 *     fuse, paint parent node BLACK, and done
-	 *   2-children cluster (BLACK target node, 2-children sibling cluster, 2-children parent cluster) becomes 3-children cluster
-	 *     fuse, and delete parent node from parent cluster
+	 * descend the spine of the taller tree facing the shorter one to a BLACK node of the same black height,
+	 * then pivot takes its place as a RED node with it and the shorter tree as children
 	 */
-	if (target->color == BLACK) {
-		if (child->color == RED) {
-			/* deletion from 3-children cluster (BLACK target node, RED child node) */
-			child->color = BLACK;
-		} else if (target == RB_FIRST(rbt)) {
-			/* deletion from 2-children root cluster (BLACK target node, BLACK child node) */
-		} else {
-			/* deletion from 2-children cluster (BLACK target node, ...) */
-			delete_repair(rbt, target);
+	if (lbh > rbh) {
+		RB_FIRST(rbt) = left;
+		RB_SET_PARENT(left, RB_ROOT(rbt));
+		for (h = lbh, parent = left, current = left; RB_COLOR(current) == RED || h > rbh; current = current->right) {
+			h -= RB_COLOR(current) == BLACK;
+			#ifdef RB_RANK
+			current->size += right->size + 1;
+			#endif
+			parent = current;
 		}
+		parent->right = pivot;
+		pivot->left = current;
+		pivot->right = right;
+		if (right != RB_NIL(rbt))
+			RB_SET_PARENT(right, pivot);
+		h = lbh;
 	} else {
-		/* deletion from 4-children cluster (RED target node) */
-		/* deletion from 3-children cluster (RED target node) */
+		RB_FIRST(rbt) = right;
+		RB_SET_PARENT(right, RB_ROOT(rbt));
+		for (h = rbh, parent = right, current = right; RB_COLOR(current) == RED || h > lbh; current = current->left) {
+			h -= RB_COLOR(current) == BLACK;
+			#ifdef RB_RANK
+			current->size += left->size + 1;
+			#endif
+			parent = current;
+		}
+		parent->left = pivot;
+		pivot->left = left;
+		pivot->right = current;
+		if (left != RB_NIL(rbt))
+			RB_SET_PARENT(left, pivot);
+		h = rbh;
 	}
 
-	if (child != RB_NIL(rbt))
-		child->parent = target->parent;
+	if (current != RB_NIL(rbt))
+		RB_SET_PARENT(current, pivot);
+	RB_SET_PARENT_COLOR(pivot, parent, RED);
+	#ifdef RB_RANK
+	pivot->size = pivot->left->size + pivot->right->size + 1;
+	#endif
+	if (rbt->augment != NULL)
+		augment_path(rbt, pivot, pivot);
 
-	if (target == target->parent->left)
-		target->parent->left = child;
-	else
-		target->parent->right = child;
+	/* as if pivot were inserted there */
+	if (RB_COLOR(parent) == RED)
+		insert_repair(rbt, pivot);
 
-	free(target);
-	
-	/* keep or discard data */
-	if (keep == 0) {
-		rbt->destroy(data);
-		data = NULL;
+	if (RB_COLOR(RB_FIRST(rbt)) == RED) {
+		RB_SET_COLOR(RB_FIRST(rbt), BLACK);
+		h++;
 	}
 
-	return data;
+	return h;
 }
 
 /*
- * rebalance after deletion
+ * leftmost node
+ * return NULL if the tree is empty
  */
-void delete_repair(rbtree *rbt, rbnode *current)
+rbnode *leftmost(rbtree *rbt)
 {
-	rbnode *sibling;
-	do {
-		if (current == current->parent->left) {
-			sibling = current->parent->right;
+	#ifdef RB_MIN
+	return rbt->min;
+	#else
+	rbnode *p;
 
-			if (sibling->color == RED) {
-				/* perform an adjustment (3-children parent cluster has two representations) */
-				sibling->color = BLACK;
-				current->parent->color = RED;
-				rotate_left(rbt, current->parent);
-				sibling = current->parent->right;
-			}
+	for (p = RB_FIRST(rbt); p != RB_NIL(rbt) && p->left != RB_NIL(rbt); p = p->left) ;
 
-			/* sibling node must be BLACK now */
+	return p != RB_NIL(rbt) ? p : NULL;
+	#endif
+}
 
-			if (sibling->right->color == BLACK && sibling->left->color == BLACK) {
-				/* 2-children sibling cluster, fuse by recoloring */
-				sibling->color = RED;
-				if (current->parent->color == RED) { /* 3/4-children parent cluster */
-					current->parent->color = BLACK;
-					break; /* goto break */
-				} else { /* 2-children parent cluster */
-					current = current->parent; /* goto loop */
-				}
-			} else {
-				/* 3/4-children sibling cluster */
-				
-				/* perform an adjustment (3-children sibling cluster has two representations) */
-				if (sibling->right->color == BLACK) {
-					sibling->left->color = BLACK;
-					sibling->color = RED;
-					rotate_right(rbt, sibling);
-					sibling = current->parent->right;
-				}
+/*
+ * rightmost node
+ * return NULL if the tree is empty
+ */
+rbnode *rightmost(rbtree *rbt)
+{
+	rbnode *p;
 
-				/* transfer by rotation and recoloring */
-				sibling->color = current->parent->color;
-				current->parent->color = BLACK;
-				sibling->right->color = BLACK;
-				rotate_left(rbt, current->parent);
-				break; /* goto break */
-			}
-		} else {
-			sibling = current->parent->left;
+	for (p = RB_FIRST(rbt); p != RB_NIL(rbt) && p->right != RB_NIL(rbt); p = p->right) ;
 
-			if (sibling->color == RED) {
-				/* perform an adjustment (3-children parent cluster has two representations) */
-				sibling->color = BLACK;
-				current->parent->color = RED;
-				rotate_right(rbt, current->parent);
-				sibling = current->parent->left;
-			}
+	return p != RB_NIL(rbt) ? p : NULL;
+}
 
-			/* sibling node must be BLACK now */
+/*
+ * number of BLACK nodes from node down to a leaf, node included
+ */
+int black_height(rbtree *rbt, rbnode *node)
+{
+	int h;
 
-			if (sibling->right->color == BLACK && sibling->left->color == BLACK) {
-				/* 2-children sibling cluster, fuse by recoloring */
-				sibling->color = RED;
-				if (current->parent->color == RED) { /* 3/4-children parent cluster */
-					current->parent->color = BLACK;
-					break; /* goto break */
-				} else { /* 2-children parent cluster */
-					current = current->parent; /* goto loop */
-				}
-			} else {
-				/* 3/4-children sibling cluster */
+	(void) rbt;
+	for (h = 0; node != RB_NIL(rbt); node = node->left)
+		h += RB_COLOR(node) == BLACK;
 
-				/* perform an adjustment (3-children sibling cluster has two representations) */
-				if (sibling->left->color == BLACK) {
-					sibling->right->color = BLACK;
-					sibling->color = RED;
-					rotate_left(rbt, sibling);
-					sibling = current->parent->left;
-				}
+	return h;
+}
 
-				/* transfer by rotation and recoloring */
-				sibling->color = current->parent->color;
-				current->parent->color = BLACK;
-				sibling->left->color = BLACK;
-				rotate_right(rbt, current->parent);
-				break; /* goto break */
-			}
-		}
-	} while (current != RB_FIRST(rbt));
+/*
+ * rough number of nodes, from the depth of the shorter of the two spines
+ * exact with RB_RANK
+ */
+size_t size_estimate(rbtree *rbt)
+{
+	#ifdef RB_RANK
+	return RB_COUNT(rbt);
+	#else
+	rbnode *l, *r;
+	int depth;
+
+	l = r = RB_FIRST(rbt);
+	for (depth = 0; l != RB_NIL(rbt) && r != RB_NIL(rbt); depth++) {
+		l = l->left;
+		r = r->right;
+	}
+
+	return depth == 0 ? 0 : ((size_t) 2 << depth) - 1;
+	#endif
+}
+
+#ifdef RB_STATS
+/*
+ * counters since the tree was created or last reset, each read on its own while other threads may still count
+ */
+void rb_stats_get(rbtree *rbt, rbstats *stats)
+{
+	stats->compares = __atomic_load_n(&rbt->stats.compares, __ATOMIC_RELAXED);
+	stats->rotations = __atomic_load_n(&rbt->stats.rotations, __ATOMIC_RELAXED);
+	stats->insert_repairs = __atomic_load_n(&rbt->stats.insert_repairs, __ATOMIC_RELAXED);
+	stats->delete_repairs = __atomic_load_n(&rbt->stats.delete_repairs, __ATOMIC_RELAXED);
+	stats->allocs = __atomic_load_n(&rbt->stats.allocs, __ATOMIC_RELAXED);
+	stats->searches = __atomic_load_n(&rbt->stats.searches, __ATOMIC_RELAXED);
+	stats->depth = __atomic_load_n(&rbt->stats.depth, __ATOMIC_RELAXED);
+	stats->max_depth = __atomic_load_n(&rbt->stats.max_depth, __ATOMIC_RELAXED);
+}
+
+void rb_stats_reset(rbtree *rbt)
+{
+	__atomic_store_n(&rbt->stats.compares, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&rbt->stats.rotations, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&rbt->stats.insert_repairs, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&rbt->stats.delete_repairs, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&rbt->stats.allocs, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&rbt->stats.searches, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&rbt->stats.depth, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&rbt->stats.max_depth, 0, __ATOMIC_RELAXED);
+}
+
+/*
+ * count a search that compared depth nodes on its way down
+ */
+void stat_search(rbtree *rbt, unsigned long depth)
+{
+	unsigned long max;
+
+	__atomic_fetch_add(&rbt->stats.searches, 1, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&rbt->stats.depth, depth, __ATOMIC_RELAXED);
+
+	max = __atomic_load_n(&rbt->stats.max_depth, __ATOMIC_RELAXED);
+	while (depth > max && !__atomic_compare_exchange_n(&rbt->stats.max_depth, &max, depth, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) ;
+}
+
+/*
+ * add the counts of part, a tree that took over some of rbt's nodes for a while, to rbt and clear them
+ */
+void stat_merge(rbtree *rbt, rbtree *part)
+{
+	unsigned long max;
+
+	__atomic_fetch_add(&rbt->stats.compares, part->stats.compares, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&rbt->stats.rotations, part->stats.rotations, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&rbt->stats.insert_repairs, part->stats.insert_repairs, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&rbt->stats.delete_repairs, part->stats.delete_repairs, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&rbt->stats.allocs, part->stats.allocs, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&rbt->stats.searches, part->stats.searches, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&rbt->stats.depth, part->stats.depth, __ATOMIC_RELAXED);
+
+	max = __atomic_load_n(&rbt->stats.max_depth, __ATOMIC_RELAXED);
+	while (part->stats.max_depth > max && !__atomic_compare_exchange_n(&rbt->stats.max_depth, &max, part->stats.max_depth, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) ;
+
+	rb_stats_reset(part);
 }
+#endif
 
 /*
  * check order of tree
@@ -527,9 +2827,9 @@ int check_order(rbtree *rbt, rbnode *n, void *min, void *max)
 		return 1;
 
 	#ifdef RB_DUP
-	if (rbt->compare(n->data, min) < 0 || rbt->compare(n->data, max) > 0)
+	if (COMPARE(rbt, n->data, min) < 0 || COMPARE(rbt, n->data, max) > 0)
 	#else
-	if (rbt->compare(n->data, min) <= 0 || rbt->compare(n->data, max) >= 0)
+	if (COMPARE(rbt, n->data, min) <= 0 || COMPARE(rbt, n->data, max) >= 0)
 	#endif
 		return 0;
 
@@ -541,7 +2841,7 @@ int check_order(rbtree *rbt, rbnode *n, void *min, void *max)
  */
 int rb_check_black_height(rbtree *rbt)
 {
-	if (RB_ROOT(rbt)->color == RED || RB_FIRST(rbt)->color == RED || RB_NIL(rbt)->color == RED)
+	if (RB_COLOR(RB_ROOT(rbt)) == RED || RB_COLOR(RB_FIRST(rbt)) == RED || RB_COLOR(RB_NIL(rbt)) == RED)
 		return 0;
 
 	return check_black_height(rbt, RB_FIRST(rbt));
@@ -557,7 +2857,7 @@ int check_black_height(rbtree *rbt, rbnode *n)
 	if (n == RB_NIL(rbt))
 		return 1;
 
-	if (n->color == RED && (n->left->color == RED || n->right->color == RED || n->parent->color == RED))
+	if (RB_COLOR(n) == RED && (RB_COLOR(n->left) == RED || RB_COLOR(n->right) == RED || RB_COLOR(RB_PARENT(n)) == RED))
 		return 0;
 
 	if ((lbh = check_black_height(rbt, n->left)) == 0)
@@ -569,8 +2869,34 @@ int check_black_height(rbtree *rbt, rbnode *n)
 	if (lbh != rbh)
 		return 0;
 
-	return lbh + (n->color == BLACK ? 1 : 0);
+	return lbh + (RB_COLOR(n) == BLACK ? 1 : 0);
+}
+
+#ifdef RB_RANK
+/*
+ * check subtree sizes
+ */
+int rb_check_size(rbtree *rbt)
+{
+	return RB_NIL(rbt)->size == 0 && check_size(rbt, RB_FIRST(rbt)) != (size_t) -1;
+}
+
+/*
+ * return the size of subtree n, (size_t) -1 if invalid
+ */
+size_t check_size(rbtree *rbt, rbnode *n)
+{
+	size_t l, r;
+
+	if (n == RB_NIL(rbt))
+		return 0;
+
+	if ((l = check_size(rbt, n->left)) == (size_t) -1 || (r = check_size(rbt, n->right)) == (size_t) -1)
+		return (size_t) -1;
+
+	return n->size == l + r + 1 ? n->size : (size_t) -1;
 }
+#endif
 
 /*
  * print tree
@@ -593,20 +2919,26 @@ void print(rbtree *rbt, rbnode *n, void (*print_func)(void *), int depth, char *
 		if (label)
 			printf("%s: ", label);
 		print_func(n->data);
-		printf(" (%s)\n", n->color == RED ? "r" : "b");
+		printf(" (%s)\n", RB_COLOR(n) == RED ? "r" : "b");
 		print(rbt, n->left, print_func, depth + 1, "L");
 	}
 }
 
 /*
  * destroy node recursively
+ * return the number of nodes destroyed
  */
-void destroy(rbtree *rbt, rbnode *n)
+size_t destroy(rbtree *rbt, rbnode *n)
 {
-	if (n != RB_NIL(rbt)) {
-		destroy(rbt, n->left);
-		destroy(rbt, n->right);
+	size_t count;
+
+	if (n == RB_NIL(rbt))
+		return 0;
+
+	count = destroy(rbt, n->left) + destroy(rbt, n->right) + 1;
+	if (rbt->destroy != NULL)
 		rbt->destroy(n->data);
-		free(n);
-	}
+	node_free(rbt, n);
+
+	return count;
 }
\ No newline at end of file
@@ -6,6 +6,13 @@
 #ifndef _RB_HEADER
 #define _RB_HEADER
 
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #define RB_DUP 1
 #define RB_MIN 1
 
@@ -21,45 +28,225 @@ enum rbtraversal {
 typedef struct rbnode {
 	struct rbnode *left;
 	struct rbnode *right;
+	#ifdef RB_COMPACT
+	uintptr_t parent_color; /* parent pointer, color in the low bit */
+	#else
 	struct rbnode *parent;
 	char color;
+	#endif
 	void *data;
+	#ifdef RB_RANK
+	size_t size; /* nodes in the subtree rooted here, 0 for nil */
+	#endif
 } rbnode;
 
+#ifdef RB_COMPACT
+#define RB_PARENT(n) ((rbnode *) ((n)->parent_color & ~(uintptr_t) 1))
+#define RB_COLOR(n) ((int) ((n)->parent_color & 1))
+#define RB_SET_PARENT(n, p) ((n)->parent_color = (uintptr_t) (p) | ((n)->parent_color & 1))
+#define RB_SET_COLOR(n, c) ((n)->parent_color = ((n)->parent_color & ~(uintptr_t) 1) | (uintptr_t) (c))
+#define RB_SET_PARENT_COLOR(n, p, c) ((n)->parent_color = (uintptr_t) (p) | (uintptr_t) (c))
+#else
+#define RB_PARENT(n) ((n)->parent)
+#define RB_COLOR(n) ((n)->color)
+#define RB_SET_PARENT(n, p) ((n)->parent = (p))
+#define RB_SET_COLOR(n, c) ((n)->color = (c))
+#define RB_SET_PARENT_COLOR(n, p, c) ((n)->parent = (p), (n)->color = (c))
+#endif
+
+#ifdef RB_STATS
+/*
+ * operation counters of a tree (RB_STATS)
+ * a search is a descent from the root by rb_find, rb_find_node, rb_find_rcu, an insert, a bound or rb_rank
+ */
+typedef struct {
+	unsigned long compares; /* comparator calls */
+	unsigned long rotations; /* rotate_left and rotate_right */
+	unsigned long insert_repairs; /* insert_repair loop iterations */
+	unsigned long delete_repairs; /* delete_repair loop iterations */
+	unsigned long allocs; /* nodes allocated, from malloc or the pool */
+	unsigned long searches;
+	unsigned long depth; /* nodes compared by all searches, depth / searches per operation */
+	unsigned long max_depth; /* of a single search */
+} rbstats;
+#endif
+
 typedef struct {
 	int (*compare)(const void *, const void *);
 	void (*print)(void *);
 	void (*destroy)(void *);
+	int (*augment)(rbnode *); /* recompute node's aggregate from its children, return non-zero if changed */
 
 	rbnode root;
-	rbnode nil;
 
 	#ifdef RB_MIN
 	rbnode *min;
 	#endif
+
+	#ifdef RB_MAX
+	rbnode *max;
+	#endif
+
+	struct rbpool *pool; /* NULL if nodes come from malloc */
+	int intrusive; /* nodes are embedded in the caller's records */
+
+	#ifdef RB_RCU
+	unsigned long seq; /* odd while the writer restructures the tree */
+	unsigned long epoch; /* reclamation epoch, never 0 */
+	struct rbreader *readers;
+	int readers_lock;
+	rbnode *retired[2]; /* nodes unlinked in the previous and the current epoch */
+	size_t retired_count; /* nodes retired in the current epoch */
+	#endif
+
+	#ifdef RB_STATS
+	rbstats stats;
+	#endif
 } rbtree;
 
+#ifdef RB_RCU
+/*
+ * reader of a tree shared with one writer thread, one per reader thread
+ * padded so that readers entering and leaving do not share a cache line
+ */
+typedef struct rbreader {
+	rbtree *rbt;
+	unsigned long epoch; /* epoch entered, 0 outside a read section */
+	struct rbreader *next;
+	char pad[64 - sizeof(void *) * 2 - sizeof(unsigned long)];
+} rbreader;
+#endif
+
+/* sentinel node nil, shared by all trees so that subtrees can move between them */
+extern rbnode rb_nil;
+
 #define RB_ROOT(rbt) (&(rbt)->root)
-#define RB_NIL(rbt) (&(rbt)->nil)
+#define RB_NIL(rbt) (&rb_nil)
 #define RB_FIRST(rbt) ((rbt)->root.left)
 #define RB_MINIMAL(rbt) ((rbt)->min)
+#define RB_MAXIMAL(rbt) ((rbt)->max)
+#ifdef RB_RANK
+#define RB_COUNT(rbt) ((rbt)->root.left->size)
+#endif
 
-#define RB_ISEMPTY(rbt) ((rbt)->root.left == &(rbt)->nil && (rbt)->root.right == &(rbt)->nil)
-#define RB_APPLY(rbt, f, c, o) rbapply_node((rbt), (rbt)->root.left, (f), (c), (o))
+#define RB_ISEMPTY(rbt) ((rbt)->root.left == &rb_nil && (rbt)->root.right == &rb_nil)
+/* record containing node, where node is the member field of type */
+#define RB_ENTRY(node, type, member) ((type *) ((char *) (node) - offsetof(type, member)))
+
+/* deep enough for any tree that fits in memory, the height is at most 2 * log2(n + 1) */
+#define RB_CURSOR_DEPTH (16 * sizeof(void *))
+
+/*
+ * in-order cursor, node is NULL once past either end
+ * the tree must not be modified while the cursor is in use
+ */
+typedef struct {
+	rbtree *rbt;
+	rbnode *node;
+	int depth;
+	rbnode *path[RB_CURSOR_DEPTH]; /* ancestors of node */
+	char right[RB_CURSOR_DEPTH]; /* non-zero if node is down the right of path[i] */
+} rbcursor;
+
+/* cursor over the nodes in [lo, hi) */
+typedef struct {
+	rbtree *rbt;
+	rbnode *node; /* next node, NULL at the end */
+	void *hi; /* NULL if unbounded */
+} rbrange;
+
+#define RB_APPLY(rbt, f, c, o) rb_apply_node((rbt), (rbt)->root.left, (f), (c), (o))
 
 rbtree *rb_create(int (*compare_func)(const void *, const void *), void (*destroy_func)(void *));
+rbtree *rb_create_pool(int (*compare_func)(const void *, const void *), void (*destroy_func)(void *), size_t chunk);
+rbtree *rb_create_intrusive(int (*compare_func)(const void *, const void *), void (*destroy_func)(void *));
+rbtree *rb_create_augment(int (*compare_func)(const void *, const void *), void (*destroy_func)(void *), int (*augment_func)(rbnode *));
 void rb_destroy(rbtree *rbt);
 
 rbnode *rb_find(rbtree *rbt, void *data);
 rbnode *rb_successor(rbtree *rbt, rbnode *node);
+rbnode *rb_predecessor(rbtree *rbt, rbnode *node);
+rbnode *rb_lower_bound(rbtree *rbt, void *data);
+rbnode *rb_upper_bound(rbtree *rbt, void *data);
+
+void rb_range_init(rbrange *range, rbtree *rbt, void *lo, void *hi);
+rbnode *rb_range_next(rbrange *range);
+
+rbnode *rb_cursor_begin(rbcursor *cursor, rbtree *rbt);
+rbnode *rb_cursor_end(rbcursor *cursor, rbtree *rbt);
+rbnode *rb_cursor_next(rbcursor *cursor);
+rbnode *rb_cursor_prev(rbcursor *cursor);
 
 int rb_apply_node(rbtree *rbt, rbnode *node, int (*func)(void *, void *), void *cookie, enum rbtraversal order);
 void rb_print(rbtree *rbt, void (*print_func)(void *));
 
+/*
+ * rb_insert places a key before the first node in O(1) amortized, a key past the last node only with RB_MAX
+ * without RB_MAX, increasing keys such as timestamps descend from the root unless rb_insert_hint is given the last node
+ */
 rbnode *rb_insert(rbtree *rbt, void *data);
+rbnode *rb_insert_hint(rbtree *rbt, rbnode *hint, void *data);
 void *rb_delete(rbtree *rbt, rbnode *node, int keep);
 
+void *rb_pop_min(rbtree *rbt);
+void *rb_pop_max(rbtree *rbt);
+size_t rb_pop_min_n(rbtree *rbt, void *data[], size_t k);
+
+int rb_build_sorted(rbtree *rbt, void *data[], size_t n);
+int rb_insert_batch(rbtree *rbt, void *data[], size_t n);
+
+#ifdef RB_PARALLEL
+/*
+ * rb_build_sorted, RB_APPLY and rb_destroy spread over threads, including the caller's
+ * func and the destroy function are called from several threads at once, in no particular order
+ */
+int rb_build_sorted_parallel(rbtree *rbt, void *data[], size_t n, int threads);
+int rb_apply_parallel(rbtree *rbt, int (*func)(void *, void *), void *cookie, int threads);
+void rb_destroy_parallel(rbtree *rbt, int threads);
+#endif
+
+int rb_join(rbtree *rbt, void *pivot, rbtree *other);
+int rb_concat(rbtree *rbt, rbtree *other);
+int rb_split(rbtree *rbt, void *data, rbtree **lo, rbtree **hi);
+size_t rb_delete_range(rbtree *rbt, void *lo, void *hi, void (*take)(void *, void *), void *cookie);
+
+rbnode *rb_find_node(rbtree *rbt, rbnode *key);
+rbnode *rb_insert_node(rbtree *rbt, rbnode *node);
+void rb_delete_node(rbtree *rbt, rbnode *node);
+
+#ifdef RB_RCU
+/*
+ * lock-free lookups beside one writer thread
+ * the writer may use rb_insert, rb_insert_hint, rb_delete and rb_pop_min/max, other updates need the readers stopped
+ * data kept by rb_delete may still be read until rb_rcu_synchronize returns
+ */
+void rb_rcu_register(rbtree *rbt, rbreader *reader);
+void rb_rcu_unregister(rbreader *reader);
+void rb_rcu_read_lock(rbreader *reader);
+void rb_rcu_read_unlock(rbreader *reader);
+rbnode *rb_find_rcu(rbtree *rbt, void *data);
+int rb_rcu_reclaim(rbtree *rbt);
+void rb_rcu_synchronize(rbtree *rbt);
+#endif
+
+#ifdef RB_RANK
+size_t rb_rank(rbtree *rbt, void *data);
+rbnode *rb_select(rbtree *rbt, size_t k);
+#endif
+
+#ifdef RB_STATS
+void rb_stats_get(rbtree *rbt, rbstats *stats);
+void rb_stats_reset(rbtree *rbt);
+#endif
+
 int rb_check_order(rbtree *rbt, void *min, void *max);
 int rb_check_black_height(rbtree *rbt);
+#ifdef RB_RANK
+int rb_check_size(rbtree *rbt);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif /* _RB_HEADER */
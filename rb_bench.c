@@ -0,0 +1,1330 @@
+/*
+ * Copyright (c) 2019 xieqing. https://github.com/xieqing
+ * May be freely redistributed, but copyright notice must be retained.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include "rb.h"
+#include "rb_data.h"
+#include "rb_interval.h"
+#include "rb_shard.h"
+#include "rb_persist.h"
+#include "rb_io.h"
+#include "rb_mmap.h"
+
+static double now();
+static void shuffle(int *a, int n);
+static rbtree *make_tree(int n);
+static void **make_batch(int n, int tree_size);
+static void bench_batch();
+static int count_interval(rbinterval *iv, void *cookie);
+static void bench_interval();
+static int sum_func(void *data, void *cookie);
+static void bench_scan();
+static int count_compare(const void *d1, const void *d2);
+static void bench_hint();
+static void *shard_update(void *arg);
+static void bench_shard();
+static void bench_persist();
+static void bench_io();
+static void bench_mapped();
+#ifdef RB_PARALLEL
+static int parallel_sum(void *data, void *cookie);
+static void bench_parallel();
+#endif
+#ifdef RB_RCU
+static void *rcu_lookup(void *arg);
+static void *rcu_update(void *arg);
+static void bench_rcu();
+#endif
+
+/*
+ * workload suite
+ * each operation is timed on each key distribution and tree size, and reported as text, CSV or JSON
+ */
+#define WORKLOAD_OPS 1000000 /* operations per measurement at least, small trees are rebuilt for more rounds */
+#define WORKLOAD_BLOCK 4096 /* keys generated between timings, so that generating them is not timed */
+#define ZIPF_THETA 0.99
+
+enum dist {
+	SEQUENTIAL, /* 0, 1, 2, ... */
+	RANDOM, /* a random permutation of the keys, or uniform draws */
+	ZIPFIAN, /* a few hot keys drawn most of the time, scattered over the key range */
+	ADVERSARIAL /* from both ends inward, every key at the opposite edge from the last */
+};
+
+static const char *dist_names[] = {"sequential", "random", "zipfian", "adversarial"};
+
+typedef struct {
+	int dist;
+	long n; /* keys are 0 .. n - 1 */
+	long i; /* keys generated */
+	uint64_t rng; /* xorshift state */
+	uint64_t lcg; /* random permutation, full period modulo mask + 1 */
+	uint64_t mask;
+	double zetan, alpha, eta;
+} keygen;
+
+typedef struct {
+	const char *name;
+	double (*run)(int dist, long n, long *ops);
+} workload;
+
+static void keygen_init(keygen *g, int dist, long n, uint64_t seed);
+static long keygen_next(keygen *g);
+static uint64_t xorshift(uint64_t *state);
+static double zeta(long n);
+static rbtree *workload_tree(long n, int dist);
+static double run_insert(int dist, long n, long *ops);
+static double run_find(int dist, long n, long *ops);
+static double run_delete(int dist, long n, long *ops);
+static double run_successor(int dist, long n, long *ops);
+static double run_mixed(int dist, long n, long *ops);
+static void bench_workloads(const char *format, long max);
+
+/*
+ * rb_bench [-f text|csv|json] [-n max] | rb_bench -h
+ *   no option runs every benchmark, a format runs the workload suite alone, -h the hint benchmark alone
+ *   max is the largest tree of the workload suite, 1000000 by default, 100000000 at most
+ */
+int main(int argc, char *argv[])
+{
+	const char *format;
+	long max;
+	int i;
+
+	format = NULL;
+	max = 1000000;
+	if (argc == 2 && strcmp(argv[1], "-h") == 0) {
+		srand(1);
+		bench_hint();
+		return 0;
+	}
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+			format = argv[++i];
+		else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+			max = atol(argv[++i]);
+		else
+			break;
+	}
+
+	if (i < argc || max < 1000 || (format != NULL && strcmp(format, "text") != 0 && strcmp(format, "csv") != 0 && strcmp(format, "json") != 0)) {
+		fprintf(stderr, "usage: %s [-f text|csv|json] [-n max] | -h\n", argv[0]);
+		return 1;
+	}
+
+	srand(1);
+
+	if (format != NULL) {
+		bench_workloads(format, max);
+		return 0;
+	}
+
+	bench_batch();
+	bench_interval();
+	bench_scan();
+	bench_hint();
+	bench_shard();
+	bench_persist();
+	bench_io();
+	bench_mapped();
+	#ifdef RB_PARALLEL
+	bench_parallel();
+	#endif
+	#ifdef RB_RCU
+	bench_rcu();
+	#endif
+	bench_workloads("text", max);
+
+	return 0;
+}
+
+double now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void shuffle(int *a, int n)
+{
+	int i, j, t;
+
+	for (i = n - 1; i > 0; i--) {
+		j = rand() % (i + 1);
+		t = a[i];
+		a[i] = a[j];
+		a[j] = t;
+	}
+}
+
+/*
+ * tree of n even keys inserted in random order
+ */
+rbtree *make_tree(int n)
+{
+	rbtree *rbt;
+	int *keys, i;
+
+	if ((rbt = rb_create(compare_func, destroy_func)) == NULL || (keys = (int *) malloc(n * sizeof(int))) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	for (i = 0; i < n; i++)
+		keys[i] = i * 2;
+	shuffle(keys, n);
+
+	for (i = 0; i < n; i++) {
+		if (rb_insert(rbt, makedata(keys[i])) == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+	}
+
+	free(keys);
+	return rbt;
+}
+
+/*
+ * n random odd keys, disjoint from make_tree's
+ */
+void **make_batch(int n, int tree_size)
+{
+	void **data;
+	int i;
+
+	if ((data = (void **) malloc(n * sizeof(void *))) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	for (i = 0; i < n; i++)
+		data[i] = makedata((rand() % (tree_size + 1)) * 2 + 1);
+
+	return data;
+}
+
+/*
+ * rb_insert_batch against a loop of rb_insert, batch size relative to tree size
+ */
+void bench_batch()
+{
+	int sizes[] = {1000, 100000, 1000000};
+	double ratios[] = {0.001, 0.01, 0.05, 0.1, 0.25, 0.5, 1, 4};
+	size_t i, j;
+	int k, n, b;
+	double t0, loop, batch;
+	rbtree *rbt;
+	void **data;
+
+	printf("# batch insert: ns per inserted key\n");
+	printf("%10s %10s %12s %12s\n", "tree", "batch", "rb_insert", "batch");
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		n = sizes[i];
+		for (j = 0; j < sizeof(ratios) / sizeof(ratios[0]); j++) {
+			if ((b = (int) (n * ratios[j])) == 0)
+				continue;
+
+			rbt = make_tree(n);
+			data = make_batch(b, n);
+			t0 = now();
+			for (k = 0; k < b; k++)
+				rb_insert(rbt, data[k]);
+			loop = (now() - t0) * 1e9 / b;
+			rb_destroy(rbt);
+			free(data);
+
+			rbt = make_tree(n);
+			data = make_batch(b, n);
+			t0 = now();
+			rb_insert_batch(rbt, data, b);
+			batch = (now() - t0) * 1e9 / b;
+			rb_destroy(rbt);
+			free(data);
+
+			printf("%10d %10d %12.1f %12.1f\n", n, b, loop, batch);
+		}
+	}
+}
+
+int count_interval(rbinterval *iv, void *cookie)
+{
+	(void) iv;
+	(*(long *) cookie)++;
+	return 0;
+}
+
+/*
+ * overlap queries on an interval tree against a linear scan of the same intervals
+ * intervals of length up to 1000 spread over 10 units per interval, queries 100 wide
+ */
+void bench_interval()
+{
+	int sizes[] = {1000, 100000, 1000000};
+	size_t i;
+	int j, k, n, queries;
+	long start, tree_found, scan_found;
+	double t0, tree, scan;
+	rbinterval *intervals;
+	rbtree *rbt;
+
+	printf("# interval overlap: ns per query\n");
+	printf("%10s %10s %12s %12s\n", "intervals", "matches", "tree", "scan");
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		n = sizes[i];
+		queries = n >= 100000 ? 100 : 1000;
+
+		if ((rbt = rb_interval_create(NULL)) == NULL || (intervals = (rbinterval *) malloc(n * sizeof(rbinterval))) == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+
+		for (j = 0; j < n; j++) {
+			intervals[j].start = rand() % (n * 10);
+			intervals[j].end = intervals[j].start + rand() % 1000;
+			rb_interval_insert(rbt, &intervals[j]);
+		}
+
+		srand(2);
+		tree_found = 0;
+		t0 = now();
+		for (k = 0; k < queries; k++) {
+			start = rand() % (n * 10);
+			rb_interval_overlap(rbt, start, start + 100, count_interval, &tree_found);
+		}
+		tree = (now() - t0) * 1e9 / queries;
+
+		srand(2);
+		scan_found = 0;
+		t0 = now();
+		for (k = 0; k < queries; k++) {
+			start = rand() % (n * 10);
+			for (j = 0; j < n; j++) {
+				if (intervals[j].start <= start + 100 && intervals[j].end >= start)
+					scan_found++;
+			}
+		}
+		scan = (now() - t0) * 1e9 / queries;
+
+		if (tree_found != scan_found) {
+			fprintf(stderr, "interval overlap: %ld found, %ld expected\n", tree_found, scan_found);
+			exit(1);
+		}
+
+		printf("%10d %10.1f %12.1f %12.1f\n", n, (double) tree_found / queries, tree, scan);
+
+		rb_destroy(rbt);
+		free(intervals);
+	}
+}
+
+int sum_func(void *data, void *cookie)
+{
+	*(long *) cookie += ((mydata *) data)->key;
+	return 0;
+}
+
+/*
+ * full in-order scan, recursive RB_APPLY against the cursor
+ */
+void bench_scan()
+{
+	int sizes[] = {1000, 100000, 1000000};
+	size_t i;
+	int k, n, rounds;
+	long apply_sum, cursor_sum;
+	double t0, apply, cursor;
+	rbcursor c;
+	rbnode *node;
+	rbtree *rbt;
+
+	printf("# in-order scan: ns per node\n");
+	printf("%10s %12s %12s\n", "tree", "RB_APPLY", "cursor");
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		n = sizes[i];
+		rounds = 10000000 / n;
+		rbt = make_tree(n);
+
+		apply_sum = 0;
+		t0 = now();
+		for (k = 0; k < rounds; k++)
+			RB_APPLY(rbt, sum_func, &apply_sum, INORDER);
+		apply = (now() - t0) * 1e9 / rounds / n;
+
+		cursor_sum = 0;
+		t0 = now();
+		for (k = 0; k < rounds; k++) {
+			for (node = rb_cursor_begin(&c, rbt); node != NULL; node = rb_cursor_next(&c))
+				cursor_sum += ((mydata *) node->data)->key;
+		}
+		cursor = (now() - t0) * 1e9 / rounds / n;
+
+		if (apply_sum != cursor_sum) {
+			fprintf(stderr, "scan: sums differ\n");
+			exit(1);
+		}
+
+		printf("%10d %12.1f %12.1f\n", n, apply, cursor);
+
+		rb_destroy(rbt);
+	}
+}
+
+static long compares;
+
+int count_compare(const void *d1, const void *d2)
+{
+	compares++;
+	return compare_func(d1, d2);
+}
+
+/*
+ * rb_insert against rb_insert_hint with the previous node as hint
+ * sequential keys, nearly sorted keys (each up to 64 places early or late) and random keys
+ */
+void bench_hint()
+{
+	char *streams[] = {"sequential", "nearly", "random"};
+	int n = 1000000;
+	size_t i;
+	int j, k;
+	int *keys;
+	double t0, plain, hinted;
+	long plain_cmp, hinted_cmp;
+	rbnode *hint;
+	rbtree *rbt;
+
+	#ifdef RB_MAX
+	printf("# insert key streams of %d with RB_MAX: ns and comparisons per key\n", n);
+	#else
+	printf("# insert key streams of %d without RB_MAX: ns and comparisons per key\n", n);
+	#endif
+	printf("%10s %12s %12s %12s %12s\n", "stream", "rb_insert", "compares", "hint", "compares");
+
+	if ((keys = (int *) malloc(n * sizeof(int))) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	for (i = 0; i < sizeof(streams) / sizeof(streams[0]); i++) {
+		for (j = 0; j < n; j++)
+			keys[j] = j;
+		if (i == 1) {
+			for (j = 0; j < n; j++) {
+				k = j + rand() % 64;
+				if (k < n) {
+					keys[j] = keys[k];
+					keys[k] = j;
+				}
+			}
+		} else if (i == 2) {
+			shuffle(keys, n);
+		}
+
+		if ((rbt = rb_create(count_compare, destroy_func)) == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+		compares = 0;
+		t0 = now();
+		for (j = 0; j < n; j++)
+			rb_insert(rbt, makedata(keys[j]));
+		plain = (now() - t0) * 1e9 / n;
+		plain_cmp = compares;
+		rb_destroy(rbt);
+
+		if ((rbt = rb_create(count_compare, destroy_func)) == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+		compares = 0;
+		t0 = now();
+		for (j = 0, hint = NULL; j < n; j++)
+			hint = rb_insert_hint(rbt, hint, makedata(keys[j]));
+		hinted = (now() - t0) * 1e9 / n;
+		hinted_cmp = compares;
+		rb_destroy(rbt);
+
+		printf("%10s %12.1f %12.1f %12.1f %12.1f\n", streams[i], plain, (double) plain_cmp / n, hinted, (double) hinted_cmp / n);
+	}
+
+	free(keys);
+}
+
+struct shard_bench {
+	rbsharded *s;
+	int keys;
+	int done;
+	long ops;
+};
+
+/*
+ * delete a random key if it is there, insert it otherwise, until done
+ */
+void *shard_update(void *arg)
+{
+	struct shard_bench *b = (struct shard_bench *) arg;
+	unsigned int seed = (unsigned int) (uintptr_t) arg ^ (unsigned int) (uintptr_t) &seed;
+	mydata query, *data;
+	long ops;
+
+	for (ops = 0; !__atomic_load_n(&b->done, __ATOMIC_RELAXED); ops++) {
+		query.key = rand_r(&seed) % b->keys;
+		if ((data = rb_shard_delete(b->s, &query)) != NULL)
+			free(data);
+		else
+			rb_shard_insert(b->s, makedata(query.key));
+	}
+
+	__atomic_fetch_add(&b->ops, ops, __ATOMIC_RELAXED);
+	return NULL;
+}
+
+/*
+ * inserts and deletes per second by writer threads, one tree under one lock against 16 shards
+ */
+void bench_shard()
+{
+	int threads[] = {1, 2, 4, 8};
+	size_t shards[] = {1, 16};
+	mydata bounds[15], *b[15];
+	struct shard_bench sb;
+	pthread_t tid[8];
+	double t0, rate[2];
+	size_t i;
+	int j, k;
+
+	printf("# updates of a 500000 tree by writer threads: million per second, all writers\n");
+	printf("%10s %12s %12s\n", "writers", "1 shard", "16 shards");
+
+	sb.keys = 1000000;
+	for (k = 0; k < 15; k++) {
+		bounds[k].key = (int) ((long) sb.keys * (k + 1) / 16);
+		b[k] = &bounds[k];
+	}
+
+	for (i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+		for (k = 0; k < 2; k++) {
+			if ((sb.s = rb_shard_create(compare_func, destroy_func, copy_func, (void **) b, shards[k])) == NULL) {
+				fprintf(stderr, "out of memory\n");
+				exit(1);
+			}
+			for (j = 0; j < sb.keys; j += 2)
+				rb_shard_insert(sb.s, makedata(j));
+			sb.done = 0;
+			sb.ops = 0;
+
+			t0 = now();
+			for (j = 0; j < threads[i]; j++)
+				pthread_create(&tid[j], NULL, shard_update, &sb);
+			while (now() - t0 < 0.5)
+				sched_yield();
+			__atomic_store_n(&sb.done, 1, __ATOMIC_RELAXED);
+			for (j = 0; j < threads[i]; j++)
+				pthread_join(tid[j], NULL);
+			rate[k] = sb.ops / (now() - t0) / 1e6;
+
+			rb_shard_destroy(sb.s);
+		}
+
+		printf("%10d %12.2f %12.2f\n", threads[i], rate[0], rate[1]);
+	}
+}
+
+/*
+ * updates of a persistent tree, alone and with a snapshot kept of every version,
+ * against copying a plain tree for each snapshot
+ */
+void bench_persist()
+{
+	int sizes[] = {1000, 100000, 1000000};
+	size_t i;
+	int j, k, n, rounds;
+	double t0, alone, shared, copy;
+	rbptree *t, *snap;
+	rbtree *rbt, *clone;
+	mydata *keys;
+	void **all;
+	rbcursor c;
+	rbnode *node;
+
+	printf("# updates with snapshots: ns per update, ns per whole copy of a plain tree\n");
+	printf("%10s %12s %12s %12s\n", "tree", "no snapshot", "snapshot", "tree copy");
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		n = sizes[i];
+		rounds = 200000;
+		if ((keys = (mydata *) malloc(n * 2 * sizeof(mydata))) == NULL || (all = (void **) malloc(n * sizeof(void *))) == NULL || (t = rbp_create(compare_func, NULL)) == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+		for (j = 0; j < n * 2; j++)
+			keys[j].key = j;
+		for (j = 0; j < n; j++)
+			rbp_insert(t, &keys[j * 2]);
+
+		/* insert an odd key, then delete it */
+		t0 = now();
+		for (k = 0; k < rounds; k++) {
+			j = (rand() % n) * 2 + 1;
+			rbp_insert(t, &keys[j]);
+			rbp_delete(t, &keys[j]);
+		}
+		alone = (now() - t0) * 1e9 / rounds / 2;
+
+		/* each update copies its path from the version kept before it */
+		t0 = now();
+		for (k = 0; k < rounds; k++) {
+			j = (rand() % n) * 2 + 1;
+			snap = rbp_snapshot(t);
+			rbp_insert(t, &keys[j]);
+			rbp_release(snap);
+			snap = rbp_snapshot(t);
+			rbp_delete(t, &keys[j]);
+			rbp_release(snap);
+		}
+		shared = (now() - t0) * 1e9 / rounds / 2;
+
+		/* a plain tree has to be copied whole for a consistent view */
+		rbt = make_tree(n);
+		t0 = now();
+		for (k = 0; k < rounds / n + 1; k++) {
+			for (j = 0, node = rb_cursor_begin(&c, rbt); node != NULL; node = rb_cursor_next(&c))
+				all[j++] = node->data;
+			if ((clone = rb_create(compare_func, NULL)) == NULL || rb_build_sorted(clone, all, j) != 0) {
+				fprintf(stderr, "out of memory\n");
+				exit(1);
+			}
+			rb_destroy(clone);
+		}
+		copy = (now() - t0) * 1e9 / (rounds / n + 1);
+
+		printf("%10d %12.1f %12.1f %12.1f\n", n, alone, shared, copy);
+
+		rb_destroy(rbt);
+		rbp_release(t);
+		free(all);
+		free(keys);
+	}
+}
+
+/*
+ * save and load through a file, against inserting the same keys one by one in order and shuffled
+ */
+void bench_io()
+{
+	int sizes[] = {1000, 100000, 1000000};
+	size_t i;
+	int j, k, n, *keys;
+	double t0, save, load, insert[2];
+	rbtree *rbt;
+	FILE *fp;
+
+	printf("# save and reload: ns per node\n");
+	printf("%10s %12s %12s %12s %12s\n", "tree", "rb_save", "rb_load", "in order", "shuffled");
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		n = sizes[i];
+		rbt = make_tree(n);
+		if ((fp = tmpfile()) == NULL || (keys = (int *) malloc(n * sizeof(int))) == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+
+		t0 = now();
+		if (rb_save(rbt, fp, encode_func, NULL) != 0) {
+			fprintf(stderr, "save failed\n");
+			exit(1);
+		}
+		save = (now() - t0) * 1e9 / n;
+		rb_destroy(rbt);
+
+		rewind(fp);
+		if ((rbt = rb_create(compare_func, destroy_func)) == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+		t0 = now();
+		if (rb_load(rbt, fp, decode_func, NULL) != 0) {
+			fprintf(stderr, "load failed\n");
+			exit(1);
+		}
+		load = (now() - t0) * 1e9 / n;
+		rb_destroy(rbt);
+
+		for (k = 0; k < 2; k++) {
+			for (j = 0; j < n; j++)
+				keys[j] = j * 2;
+			if (k == 1)
+				shuffle(keys, n);
+			if ((rbt = rb_create(compare_func, destroy_func)) == NULL) {
+				fprintf(stderr, "out of memory\n");
+				exit(1);
+			}
+			t0 = now();
+			for (j = 0; j < n; j++)
+				rb_insert(rbt, makedata(keys[j]));
+			insert[k] = (now() - t0) * 1e9 / n;
+			rb_destroy(rbt);
+		}
+
+		printf("%10d %12.1f %12.1f %12.1f %12.1f\n", n, save, load, insert[0], insert[1]);
+
+		free(keys);
+		fclose(fp);
+	}
+}
+
+/*
+ * open a mapped file against rb_load, then look up in place against an in-memory tree
+ */
+void bench_mapped()
+{
+	int sizes[] = {1000, 100000, 1000000};
+	char path[] = "/tmp/rb_benchXXXXXX";
+	size_t i;
+	int j, n, fd, rounds;
+	double t0, opening, load, find, mapped;
+	rbtree *rbt;
+	rbmtree *t;
+	mydata query;
+	long found;
+	FILE *fp;
+
+	printf("# mapped tree: us to open, ns per lookup\n");
+	printf("%10s %12s %12s %12s %12s\n", "tree", "open", "rb_load", "rb_find", "mapped");
+
+	if ((fd = mkstemp(path)) < 0) {
+		fprintf(stderr, "mkstemp failed\n");
+		exit(1);
+	}
+	close(fd);
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		n = sizes[i];
+		rounds = 1000000;
+		rbt = make_tree(n);
+		if (rb_save_mapped(rbt, path, encode_func, NULL) != 0 || (fp = tmpfile()) == NULL || rb_save(rbt, fp, encode_func, NULL) != 0) {
+			fprintf(stderr, "save failed\n");
+			exit(1);
+		}
+
+		t0 = now();
+		if ((t = rb_open_mapped(path, compare_payload_func)) == NULL) {
+			fprintf(stderr, "open failed\n");
+			exit(1);
+		}
+		opening = (now() - t0) * 1e6;
+
+		found = 0;
+		t0 = now();
+		for (j = 0; j < rounds; j++) {
+			query.key = rand() % (n * 2);
+			found += rb_find(rbt, &query) != NULL;
+		}
+		find = (now() - t0) * 1e9 / rounds;
+
+		t0 = now();
+		for (j = 0; j < rounds; j++) {
+			query.key = rand() % (n * 2);
+			found -= rb_find_mapped(t, &query, NULL) != NULL;
+		}
+		mapped = (now() - t0) * 1e9 / rounds;
+		rb_destroy(rbt);
+
+		rewind(fp);
+		if ((rbt = rb_create(compare_func, destroy_func)) == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+		t0 = now();
+		if (rb_load(rbt, fp, decode_func, NULL) != 0) {
+			fprintf(stderr, "load failed\n");
+			exit(1);
+		}
+		load = (now() - t0) * 1e6;
+
+		if (found > rounds / 100 || found < -rounds / 100) {
+			fprintf(stderr, "mapped: lookups differ\n");
+			exit(1);
+		}
+
+		printf("%10d %12.1f %12.1f %12.1f %12.1f\n", n, opening, load, find, mapped);
+
+		rb_destroy(rbt);
+		rb_close_mapped(t);
+		fclose(fp);
+	}
+
+	unlink(path);
+}
+
+#ifdef RB_PARALLEL
+int parallel_sum(void *data, void *cookie)
+{
+	__atomic_add_fetch((long *) cookie, ((mydata *) data)->key, __ATOMIC_RELAXED);
+	return 0;
+}
+
+/*
+ * sorted build, apply and destroy of a large tree by thread count, 1 is the serial code
+ */
+void bench_parallel()
+{
+	int threads[] = {1, 2, 4, 8};
+	size_t i;
+	int j, n;
+	double t0, build, apply, destroy;
+	rbtree *rbt;
+	void **data;
+	long sum;
+
+	n = 2000000;
+	printf("# parallel build, apply and destroy of a %d tree: ms\n", n);
+	printf("%10s %12s %12s %12s\n", "threads", "build", "apply", "destroy");
+
+	if ((data = (void **) malloc(n * sizeof(void *))) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	for (i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+		for (j = 0; j < n; j++)
+			data[j] = makedata(j);
+		if ((rbt = rb_create(compare_func, destroy_func)) == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+
+		t0 = now();
+		if (threads[i] == 1 ? rb_build_sorted(rbt, data, n) : rb_build_sorted_parallel(rbt, data, n, threads[i])) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+		build = (now() - t0) * 1e3;
+
+		sum = 0;
+		t0 = now();
+		if (threads[i] == 1)
+			RB_APPLY(rbt, parallel_sum, &sum, INORDER);
+		else
+			rb_apply_parallel(rbt, parallel_sum, &sum, threads[i]);
+		apply = (now() - t0) * 1e3;
+
+		t0 = now();
+		if (threads[i] == 1)
+			rb_destroy(rbt);
+		else
+			rb_destroy_parallel(rbt, threads[i]);
+		destroy = (now() - t0) * 1e3;
+
+		if (sum != (long) n * (n - 1) / 2) {
+			fprintf(stderr, "parallel: wrong sum\n");
+			exit(1);
+		}
+
+		printf("%10d %12.1f %12.1f %12.1f\n", threads[i], build, apply, destroy);
+	}
+
+	free(data);
+}
+#endif
+
+#ifdef RB_RCU
+struct rcu_bench {
+	rbtree *rbt;
+	pthread_mutex_t *lock; /* NULL for lock-free lookups */
+	int n;
+	int done;
+	long ops;
+};
+
+/*
+ * look up random keys of the tree until done
+ */
+void *rcu_lookup(void *arg)
+{
+	struct rcu_bench *b = (struct rcu_bench *) arg;
+	unsigned int seed = (unsigned int) (uintptr_t) arg;
+	rbreader reader;
+	mydata query;
+	long ops;
+
+	rb_rcu_register(b->rbt, &reader);
+	for (ops = 0; !__atomic_load_n(&b->done, __ATOMIC_RELAXED); ops++) {
+		query.key = (rand_r(&seed) % b->n) * 2;
+		if (b->lock == NULL) {
+			rb_rcu_read_lock(&reader);
+			rb_find_rcu(b->rbt, &query);
+			rb_rcu_read_unlock(&reader);
+		} else {
+			pthread_mutex_lock(b->lock);
+			rb_find(b->rbt, &query);
+			pthread_mutex_unlock(b->lock);
+		}
+	}
+	rb_rcu_unregister(&reader);
+
+	__atomic_fetch_add(&b->ops, ops, __ATOMIC_RELAXED);
+	return NULL;
+}
+
+/*
+ * insert and delete random odd keys until done
+ */
+void *rcu_update(void *arg)
+{
+	struct rcu_bench *b = (struct rcu_bench *) arg;
+	unsigned int seed = 7;
+	mydata query;
+	rbnode *node;
+
+	while (!__atomic_load_n(&b->done, __ATOMIC_RELAXED)) {
+		query.key = (rand_r(&seed) % b->n) * 2 + 1;
+		if (b->lock != NULL)
+			pthread_mutex_lock(b->lock);
+		if ((node = rb_find(b->rbt, &query)) != NULL)
+			rb_delete(b->rbt, node, 0);
+		else
+			rb_insert(b->rbt, makedata(query.key));
+		if (b->lock != NULL)
+			pthread_mutex_unlock(b->lock);
+	}
+
+	return NULL;
+}
+
+/*
+ * lookups per second by reader threads while one writer updates, rb_find_rcu against rb_find under a mutex
+ */
+void bench_rcu()
+{
+	int threads[] = {1, 2, 4, 8};
+	pthread_t tid[9];
+	pthread_mutex_t lock;
+	struct rcu_bench b;
+	double t0, rate[2]; /* mutex, rcu */
+	size_t i;
+	int j, k;
+	rbtree *rbt;
+
+	printf("# lookups of a 1000000 tree with one writer: million per second, all readers\n");
+	printf("%10s %12s %12s\n", "readers", "mutex", "rcu");
+
+	pthread_mutex_init(&lock, NULL);
+	rbt = make_tree(1000000);
+
+	for (i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+		for (k = 0; k < 2; k++) {
+			b.rbt = rbt;
+			b.lock = k == 0 ? &lock : NULL;
+			b.n = 1000000;
+			b.done = 0;
+			b.ops = 0;
+
+			t0 = now();
+			pthread_create(&tid[0], NULL, rcu_update, &b);
+			for (j = 1; j <= threads[i]; j++)
+				pthread_create(&tid[j], NULL, rcu_lookup, &b);
+			while (now() - t0 < 0.5)
+				sched_yield();
+			__atomic_store_n(&b.done, 1, __ATOMIC_RELAXED);
+			for (j = 0; j <= threads[i]; j++)
+				pthread_join(tid[j], NULL);
+
+			rate[k] = b.ops / (now() - t0) / 1e6;
+		}
+
+		printf("%10d %12.2f %12.2f\n", threads[i], rate[0], rate[1]);
+	}
+
+	rb_rcu_synchronize(rbt);
+	rb_destroy(rbt);
+	pthread_mutex_destroy(&lock);
+}
+#endif
+
+
+void keygen_init(keygen *g, int dist, long n, uint64_t seed)
+{
+	double zeta2;
+
+	g->dist = dist;
+	g->n = n;
+	g->i = 0;
+	g->rng = seed * 0x9e3779b97f4a7c15ull + 1;
+
+	for (g->mask = 1; g->mask < (uint64_t) n; g->mask = g->mask << 1 | 1) ;
+	g->lcg = xorshift(&g->rng) & g->mask;
+
+	/* Gray et al., quickly generating billion-record synthetic databases */
+	if (dist == ZIPFIAN) {
+		g->zetan = zeta(n);
+		zeta2 = 1 + pow(0.5, ZIPF_THETA);
+		g->alpha = 1 / (1 - ZIPF_THETA);
+		g->eta = (1 - pow(2.0 / n, 1 - ZIPF_THETA)) / (1 - zeta2 / g->zetan);
+	}
+}
+
+long keygen_next(keygen *g)
+{
+	double u, uz;
+	long i, rank;
+
+	i = g->i++ % g->n;
+
+	switch (g->dist) {
+	case SEQUENTIAL:
+		return i;
+	case RANDOM:
+		/* a full-period LCG modulo a power of two, skipping the values past n */
+		do {
+			g->lcg = (g->lcg * 6364136223846793005ull + 1442695040888963407ull) & g->mask;
+		} while (g->lcg >= (uint64_t) g->n);
+		return (long) g->lcg;
+	case ZIPFIAN:
+		u = (xorshift(&g->rng) >> 11) * (1.0 / 9007199254740992.0);
+		uz = u * g->zetan;
+		if (uz < 1)
+			rank = 0;
+		else if (uz < 1 + pow(0.5, ZIPF_THETA))
+			rank = 1;
+		else
+			rank = (long) (g->n * pow(g->eta * u - g->eta + 1, g->alpha));
+		if (rank >= g->n)
+			rank = g->n - 1;
+		/* hot keys scattered over the range rather than all at the low end */
+		return (long) (((uint64_t) rank * 0x9e3779b97f4a7c15ull) % (uint64_t) g->n);
+	default:
+		return i % 2 == 0 ? i / 2 : g->n - 1 - i / 2;
+	}
+}
+
+uint64_t xorshift(uint64_t *state)
+{
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 2685821657736338717ull;
+}
+
+/*
+ * sum of 1 / i^theta for i in 1 .. n, the last one is kept as it is slow for large n
+ */
+double zeta(long n)
+{
+	static long last_n;
+	static double last;
+	long i;
+
+	if (n != last_n) {
+		for (last = 0, i = 1; i <= n; i++)
+			last += 1 / pow(i, ZIPF_THETA);
+		last_n = n;
+	}
+
+	return last;
+}
+
+/*
+ * tree of keys 0 .. n - 1 inserted in dist order, or built sorted if dist is negative
+ */
+rbtree *workload_tree(long n, int dist)
+{
+	keygen g;
+	rbtree *rbt;
+	void **data;
+	long i;
+
+	if ((rbt = rb_create(compare_func, destroy_func)) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+
+	if (dist >= 0) {
+		/* a zipfian order would repeat keys, so it is a random one here */
+		keygen_init(&g, dist == ZIPFIAN ? RANDOM : dist, n, 1);
+		for (i = 0; i < n; i++) {
+			if (rb_insert(rbt, makedata((int) keygen_next(&g))) == NULL) {
+				fprintf(stderr, "out of memory\n");
+				exit(1);
+			}
+		}
+		return rbt;
+	}
+
+	if ((data = (void **) malloc(n * sizeof(void *))) == NULL) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	for (i = 0; i < n; i++) {
+		if ((data[i] = makedata((int) i)) == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+	}
+	if (rb_build_sorted(rbt, data, n) != 0) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	free(data);
+
+	return rbt;
+}
+
+/*
+ * n inserts into an empty tree, zipfian keys repeat
+ */
+double run_insert(int dist, long n, long *ops)
+{
+	void *data[WORKLOAD_BLOCK];
+	keygen g;
+	rbtree *rbt;
+	double t;
+	long i, j, k, round, rounds;
+
+	rounds = n < WORKLOAD_OPS ? WORKLOAD_OPS / n : 1;
+	for (t = 0, round = 0; round < rounds; round++) {
+		if ((rbt = rb_create(compare_func, destroy_func)) == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+
+		keygen_init(&g, dist, n, round + 1);
+		for (i = 0; i < n; i += k) {
+			k = n - i < WORKLOAD_BLOCK ? n - i : WORKLOAD_BLOCK;
+			for (j = 0; j < k; j++)
+				data[j] = makedata((int) keygen_next(&g));
+
+			t -= now();
+			for (j = 0; j < k; j++)
+				rb_insert(rbt, data[j]);
+			t += now();
+		}
+
+		rb_destroy(rbt);
+	}
+
+	*ops = rounds * n;
+	return t * 1e9 / *ops;
+}
+
+/*
+ * lookups in a tree of n keys, all hits
+ */
+double run_find(int dist, long n, long *ops)
+{
+	int keys[WORKLOAD_BLOCK];
+	mydata query;
+	keygen g;
+	rbtree *rbt;
+	double t;
+	long i, j, found;
+
+	rbt = workload_tree(n, -1);
+
+	keygen_init(&g, dist, n, 1);
+	for (t = 0, found = 0, i = 0; i < WORKLOAD_OPS; i += WORKLOAD_BLOCK) {
+		for (j = 0; j < WORKLOAD_BLOCK; j++)
+			keys[j] = (int) keygen_next(&g);
+
+		t -= now();
+		for (j = 0; j < WORKLOAD_BLOCK; j++) {
+			query.key = keys[j];
+			found += rb_find(rbt, &query) != NULL;
+		}
+		t += now();
+	}
+
+	if (found != i) {
+		fprintf(stderr, "find: %ld of %ld found\n", found, i);
+		exit(1);
+	}
+
+	rb_destroy(rbt);
+
+	*ops = i;
+	return t * 1e9 / *ops;
+}
+
+/*
+ * n lookups then deletes in a tree of n keys, zipfian keys miss once deleted
+ */
+double run_delete(int dist, long n, long *ops)
+{
+	int keys[WORKLOAD_BLOCK];
+	mydata query;
+	keygen g;
+	rbtree *rbt;
+	rbnode *node;
+	double t;
+	long i, j, k, round, rounds;
+
+	rounds = n < WORKLOAD_OPS ? WORKLOAD_OPS / n : 1;
+	for (t = 0, round = 0; round < rounds; round++) {
+		rbt = workload_tree(n, -1);
+
+		keygen_init(&g, dist, n, round + 1);
+		for (i = 0; i < n; i += k) {
+			k = n - i < WORKLOAD_BLOCK ? n - i : WORKLOAD_BLOCK;
+			for (j = 0; j < k; j++)
+				keys[j] = (int) keygen_next(&g);
+
+			t -= now();
+			for (j = 0; j < k; j++) {
+				query.key = keys[j];
+				if ((node = rb_find(rbt, &query)) != NULL)
+					rb_delete(rbt, node, 0);
+			}
+			t += now();
+		}
+
+		rb_destroy(rbt);
+	}
+
+	*ops = rounds * n;
+	return t * 1e9 / *ops;
+}
+
+/*
+ * in-order walk by rb_successor of a tree inserted in dist order, the order decides where the nodes are in memory
+ */
+double run_successor(int dist, long n, long *ops)
+{
+	rbtree *rbt;
+	rbnode *node;
+	double t;
+	long i, round, rounds;
+
+	rbt = workload_tree(n, dist);
+
+	rounds = n < WORKLOAD_OPS ? WORKLOAD_OPS / n : 1;
+	t = now();
+	for (i = 0, round = 0; round < rounds; round++) {
+		for (node = RB_MINIMAL(rbt); node != NULL; node = rb_successor(rbt, node))
+			i++;
+	}
+	t = now() - t;
+
+	if (i != rounds * n) {
+		fprintf(stderr, "successor: %ld nodes of %ld\n", i, rounds * n);
+		exit(1);
+	}
+
+	rb_destroy(rbt);
+
+	*ops = i;
+	return t * 1e9 / *ops;
+}
+
+/*
+ * 80% lookups, 10% inserts and 10% lookups then deletes in a tree of n keys
+ */
+double run_mixed(int dist, long n, long *ops)
+{
+	int keys[WORKLOAD_BLOCK], kind[WORKLOAD_BLOCK];
+	void *data[WORKLOAD_BLOCK];
+	mydata query;
+	keygen g;
+	rbtree *rbt;
+	rbnode *node;
+	double t;
+	long i, j;
+
+	rbt = workload_tree(n, -1);
+
+	keygen_init(&g, dist, n, 1);
+	for (t = 0, i = 0; i < WORKLOAD_OPS; i += WORKLOAD_BLOCK) {
+		for (j = 0; j < WORKLOAD_BLOCK; j++) {
+			keys[j] = (int) keygen_next(&g);
+			kind[j] = (int) (xorshift(&g.rng) % 10);
+			data[j] = kind[j] == 0 ? makedata(keys[j]) : NULL;
+		}
+
+		t -= now();
+		for (j = 0; j < WORKLOAD_BLOCK; j++) {
+			query.key = keys[j];
+			if (kind[j] == 0)
+				rb_insert(rbt, data[j]);
+			else if (kind[j] == 1 && (node = rb_find(rbt, &query)) != NULL)
+				rb_delete(rbt, node, 0);
+			else
+				rb_find(rbt, &query);
+		}
+		t += now();
+	}
+
+	rb_destroy(rbt);
+
+	*ops = i;
+	return t * 1e9 / *ops;
+}
+
+/*
+ * every workload on every distribution and tree size up to max
+ */
+void bench_workloads(const char *format, long max)
+{
+	workload workloads[] = {
+		{"insert", run_insert},
+		{"find", run_find},
+		{"delete", run_delete},
+		{"successor", run_successor},
+		{"mixed", run_mixed}
+	};
+	long n, ops;
+	double ns;
+	size_t w;
+	int d, first;
+
+	if (strcmp(format, "csv") == 0)
+		printf("op,dist,size,ops,ns_per_op,ops_per_sec\n");
+	else if (strcmp(format, "json") == 0)
+		printf("[\n");
+	else {
+		printf("# workloads: ns per operation, million operations per second\n");
+		printf("%10s %12s %10s %12s %12s\n", "op", "dist", "tree", "ns/op", "Mops/s");
+	}
+
+	first = 1;
+	for (n = 1000; n <= max && n <= 100000000; n *= 10) {
+		for (w = 0; w < sizeof(workloads) / sizeof(workloads[0]); w++) {
+			for (d = SEQUENTIAL; d <= ADVERSARIAL; d++) {
+				ns = workloads[w].run(d, n, &ops);
+
+				if (strcmp(format, "csv") == 0)
+					printf("%s,%s,%ld,%ld,%.2f,%.0f\n", workloads[w].name, dist_names[d], n, ops, ns, 1e9 / ns);
+				else if (strcmp(format, "json") == 0)
+					printf("%s  {\"op\": \"%s\", \"dist\": \"%s\", \"size\": %ld, \"ops\": %ld, \"ns_per_op\": %.2f, \"ops_per_sec\": %.0f}", \
+						first ? "" : ",\n", workloads[w].name, dist_names[d], n, ops, ns, 1e9 / ns);
+				else
+					printf("%10s %12s %10ld %12.1f %12.2f\n", workloads[w].name, dist_names[d], n, ns, 1e3 / ns);
+				fflush(stdout);
+				first = 0;
+			}
+		}
+	}
+
+	if (strcmp(format, "json") == 0)
+		printf("\n]\n");
+}
+
+/*
+ * usage: gcc -O2 -DRB_MAX -DRB_RCU -DRB_PARALLEL -pthread rb.c rb_data.c rb_interval.c rb_shard.c rb_persist.c rb_io.c rb_mmap.c rb_bench.c -lm -o rb_bench && ./rb_bench [-f text|csv|json] [-n max]
+ *        gcc -O2 -pthread rb.c rb_data.c rb_interval.c rb_shard.c rb_persist.c rb_io.c rb_mmap.c rb_bench.c -lm -o rb_bench_default && ./rb_bench_default -h
+ */
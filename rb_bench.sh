@@ -0,0 +1,6 @@
+#!/bin/bash
+
+gcc -O2 -DRB_MAX -DRB_RCU -DRB_PARALLEL -pthread rb.c rb_data.c rb_interval.c rb_shard.c rb_persist.c rb_io.c rb_mmap.c rb_bench.c -lm -o rb_bench && ./rb_bench "$@" && \
+if [ $# -eq 0 ]; then
+	gcc -O2 -pthread rb.c rb_data.c rb_interval.c rb_shard.c rb_persist.c rb_io.c rb_mmap.c rb_bench.c -lm -o rb_bench_default && ./rb_bench_default -h
+fi
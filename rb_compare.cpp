@@ -0,0 +1,743 @@
+/*
+ * Copyright (c) 2019 xieqing. https://github.com/xieqing
+ * May be freely redistributed, but copyright notice must be retained.
+ */
+
+/*
+ * the same workloads on rb.c, std::multimap (std::map without RB_DUP), a B-tree and a sorted array
+ * all of them hold the same mydata pointers ordered by compare_func, so only the structure differs
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <map>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include "rb.h"
+#include "rb_data.h"
+
+#define POOL_CHUNK 4096 /* nodes per slab of the pooled tree */
+#define VECTOR_MAX 100000 /* sorted array inserts and deletes move O(n) a key, larger ones are skipped */
+#define LATENCY_SAMPLES 100000 /* operations timed one by one for the percentiles */
+#define BTREE_T 16 /* minimum degree, 15 to 31 keys a node */
+
+static size_t heap_bytes; /* requested by the structures and not given back, allocator overhead not counted */
+
+/*
+ * std::allocator that counts into heap_bytes, so that only the structure under test is measured
+ */
+template <class T> struct counting_allocator {
+	typedef T value_type;
+
+	counting_allocator() {}
+	template <class U> counting_allocator(const counting_allocator<U> &) {}
+	T *allocate(size_t n)
+	{
+		heap_bytes += n * sizeof(T);
+		return std::allocator<T>().allocate(n);
+	}
+	void deallocate(T *p, size_t n)
+	{
+		heap_bytes -= n * sizeof(T);
+		std::allocator<T>().deallocate(p, n);
+	}
+	template <class U> bool operator==(const counting_allocator<U> &) const { return true; }
+	template <class U> bool operator!=(const counting_allocator<U> &) const { return false; }
+};
+
+struct less_data {
+	bool operator()(const mydata *a, const mydata *b) const
+	{
+		return compare_func(a, b) < 0;
+	}
+};
+
+/*
+ * every structure answers insert, find, erase and scan the same way
+ * insert returns false if out of memory, scan returns the sum of the keys in order
+ * each counts what it allocates into heap_bytes
+ */
+class rb_set {
+public:
+	rb_set(int pooled) : pooled(pooled), live(0), slots(0)
+	{
+		rbt = pooled ? rb_create_pool(compare_func, NULL, POOL_CHUNK) : rb_create(compare_func, NULL);
+		if (rbt == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+	}
+	~rb_set()
+	{
+		heap_bytes -= (pooled ? slots : live) * sizeof(rbnode);
+		rb_destroy(rbt);
+	}
+	bool insert(const mydata *d)
+	{
+		if (rb_insert(rbt, (void *) d) == NULL)
+			return false;
+		count(1);
+		return true;
+	}
+	bool find(const mydata *d) { return rb_find(rbt, (void *) d) != NULL; }
+	bool erase(const mydata *d)
+	{
+		rbnode *node;
+
+		if ((node = rb_find(rbt, (void *) d)) == NULL)
+			return false;
+		rb_delete(rbt, node, 1);
+		count(-1);
+		return true;
+	}
+	long scan()
+	{
+		rbnode *node;
+		long sum;
+
+		for (sum = 0, node = RB_MINIMAL(rbt); node != NULL; node = rb_successor(rbt, node))
+			sum += ((mydata *) node->data)->key;
+		return sum;
+	}
+
+private:
+	rbtree *rbt;
+	int pooled;
+	size_t live, slots; /* nodes in the tree, and in the pool's slabs, which are kept until rb_destroy */
+
+	/*
+	 * rb.c mallocs one rbnode a key, or a slab of POOL_CHUNK of them when the pool runs out, slab headers aside
+	 * the keys are distinct, so every insert takes a node
+	 */
+	void count(int delta)
+	{
+		if (delta > 0) {
+			if (!pooled)
+				heap_bytes += sizeof(rbnode);
+			else if (live == slots)
+				heap_bytes += POOL_CHUNK * sizeof(rbnode), slots += POOL_CHUNK;
+			live++;
+		} else {
+			if (!pooled)
+				heap_bytes -= sizeof(rbnode);
+			live--;
+		}
+	}
+};
+
+class map_set {
+public:
+	bool insert(const mydata *d)
+	{
+		#ifdef RB_DUP
+		map.insert(std::make_pair(d, (void *) NULL));
+		#else
+		map[d] = NULL;
+		#endif
+		return true;
+	}
+	bool find(const mydata *d) { return map.find(d) != map.end(); }
+	bool erase(const mydata *d)
+	{
+		auto it = map.find(d);
+
+		if (it == map.end())
+			return false;
+		map.erase(it);
+		return true;
+	}
+	long scan()
+	{
+		long sum = 0;
+
+		for (auto &it : map)
+			sum += it.first->key;
+		return sum;
+	}
+
+private:
+	#ifdef RB_DUP
+	std::multimap<const mydata *, void *, less_data, counting_allocator<std::pair<const mydata * const, void *> > > map;
+	#else
+	std::map<const mydata *, void *, less_data, counting_allocator<std::pair<const mydata * const, void *> > > map;
+	#endif
+};
+
+class vector_set {
+public:
+	bool insert(const mydata *d)
+	{
+		#ifndef RB_DUP
+		auto it = std::lower_bound(keys.begin(), keys.end(), d, less_data());
+		if (it != keys.end() && compare_func(*it, d) == 0) {
+			*it = d;
+			return true;
+		}
+		#endif
+		keys.insert(std::upper_bound(keys.begin(), keys.end(), d, less_data()), d);
+		return true;
+	}
+	bool find(const mydata *d)
+	{
+		auto it = std::lower_bound(keys.begin(), keys.end(), d, less_data());
+
+		return it != keys.end() && compare_func(*it, d) == 0;
+	}
+	bool erase(const mydata *d)
+	{
+		auto it = std::lower_bound(keys.begin(), keys.end(), d, less_data());
+
+		if (it == keys.end() || compare_func(*it, d) != 0)
+			return false;
+		keys.erase(it);
+		return true;
+	}
+	long scan()
+	{
+		long sum = 0;
+
+		for (auto d : keys)
+			sum += d->key;
+		return sum;
+	}
+
+private:
+	std::vector<const mydata *, counting_allocator<const mydata *> > keys;
+};
+
+/*
+ * B-tree of minimum degree BTREE_T, keys in every node, as in CLRS
+ * a node is filled to at least BTREE_T - 1 keys before the descent reaches it, so that insert and erase go down once
+ * leaves leave out the child array, the larger part of an internal node
+ */
+class btree_set {
+public:
+	btree_set() { root = alloc(true); }
+	~btree_set() { destroy(root); }
+	bool insert(const mydata *d)
+	{
+		bnode *x, *s;
+		int i;
+
+		if (root->n == MAXK) {
+			s = alloc(false);
+			child(s)[0] = root;
+			root = s;
+			split(s, 0);
+		}
+
+		for (x = root; ; x = child(x)[i]) {
+			i = upper(x, d);
+			if (x->leaf) {
+				memmove(&x->keys[i + 1], &x->keys[i], (x->n - i) * sizeof(x->keys[0]));
+				x->keys[i] = d;
+				x->n++;
+				return true;
+			}
+			if (child(x)[i]->n == MAXK) {
+				split(x, i);
+				if (compare_func(d, x->keys[i]) >= 0)
+					i++;
+			}
+		}
+	}
+	bool find(const mydata *d)
+	{
+		bnode *x;
+		int i;
+
+		for (x = root; ; x = child(x)[i]) {
+			i = lower(x, d);
+			if (i < x->n && compare_func(x->keys[i], d) == 0)
+				return true;
+			if (x->leaf)
+				return false;
+		}
+	}
+	bool erase(const mydata *d)
+	{
+		bool found;
+		bnode *old;
+
+		found = erase(root, d);
+		if (root->n == 0 && !root->leaf) {
+			old = root;
+			root = child(root)[0];
+			release(old);
+		}
+		return found;
+	}
+	long scan() { return scan(root); }
+
+private:
+	enum { MAXK = 2 * BTREE_T - 1 };
+
+	struct bnode {
+		int n;
+		bool leaf;
+		const mydata *keys[MAXK];
+	};
+
+	struct binner {
+		bnode node;
+		bnode *child[MAXK + 1];
+	};
+
+	bnode *root;
+
+	static bnode **child(bnode *x) { return ((binner *) x)->child; }
+
+	static bnode *alloc(bool leaf)
+	{
+		bnode *x;
+
+		if ((x = (bnode *) malloc(leaf ? sizeof(bnode) : sizeof(binner))) == NULL) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+		heap_bytes += leaf ? sizeof(bnode) : sizeof(binner);
+		x->n = 0;
+		x->leaf = leaf;
+		return x;
+	}
+
+	static void release(bnode *x)
+	{
+		heap_bytes -= x->leaf ? sizeof(bnode) : sizeof(binner);
+		free(x);
+	}
+
+	static void destroy(bnode *x)
+	{
+		int i;
+
+		if (!x->leaf) {
+			for (i = 0; i <= x->n; i++)
+				destroy(child(x)[i]);
+		}
+		release(x);
+	}
+
+	/* first key not less than d */
+	static int lower(bnode *x, const mydata *d)
+	{
+		int lo, hi, mid;
+
+		for (lo = 0, hi = x->n; lo < hi; ) {
+			mid = (lo + hi) / 2;
+			if (compare_func(x->keys[mid], d) < 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		return lo;
+	}
+
+	/* first key greater than d */
+	static int upper(bnode *x, const mydata *d)
+	{
+		int lo, hi, mid;
+
+		for (lo = 0, hi = x->n; lo < hi; ) {
+			mid = (lo + hi) / 2;
+			if (compare_func(x->keys[mid], d) <= 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+		return lo;
+	}
+
+	/* split the full i-th child of x around its middle key, which moves up into x */
+	static void split(bnode *x, int i)
+	{
+		bnode *y, *z;
+
+		y = child(x)[i];
+		z = alloc(y->leaf);
+		z->n = BTREE_T - 1;
+		memcpy(z->keys, &y->keys[BTREE_T], (BTREE_T - 1) * sizeof(y->keys[0]));
+		if (!y->leaf)
+			memcpy(child(z), &child(y)[BTREE_T], BTREE_T * sizeof(bnode *));
+		y->n = BTREE_T - 1;
+
+		memmove(&child(x)[i + 2], &child(x)[i + 1], (x->n - i) * sizeof(bnode *));
+		memmove(&x->keys[i + 1], &x->keys[i], (x->n - i) * sizeof(x->keys[0]));
+		child(x)[i + 1] = z;
+		x->keys[i] = y->keys[BTREE_T - 1];
+		x->n++;
+	}
+
+	/* join the i-th and i + 1-th children of x, both of BTREE_T - 1 keys, around the key between them */
+	static void merge(bnode *x, int i)
+	{
+		bnode *y, *z;
+
+		y = child(x)[i];
+		z = child(x)[i + 1];
+		y->keys[BTREE_T - 1] = x->keys[i];
+		memcpy(&y->keys[BTREE_T], z->keys, z->n * sizeof(z->keys[0]));
+		if (!y->leaf)
+			memcpy(&child(y)[BTREE_T], child(z), (z->n + 1) * sizeof(bnode *));
+		y->n = 2 * BTREE_T - 1;
+		release(z);
+
+		memmove(&x->keys[i], &x->keys[i + 1], (x->n - i - 1) * sizeof(x->keys[0]));
+		memmove(&child(x)[i + 1], &child(x)[i + 2], (x->n - i - 1) * sizeof(bnode *));
+		x->n--;
+	}
+
+	/* give the i-th child of x, of BTREE_T - 1 keys, one more from a sibling or by a merge */
+	static int fill(bnode *x, int i)
+	{
+		bnode *c, *s;
+
+		c = child(x)[i];
+		if (i > 0 && (s = child(x)[i - 1])->n >= BTREE_T) {
+			/* through x from the left sibling */
+			memmove(&c->keys[1], c->keys, c->n * sizeof(c->keys[0]));
+			c->keys[0] = x->keys[i - 1];
+			if (!c->leaf) {
+				memmove(&child(c)[1], child(c), (c->n + 1) * sizeof(bnode *));
+				child(c)[0] = child(s)[s->n];
+			}
+			x->keys[i - 1] = s->keys[s->n - 1];
+			s->n--;
+			c->n++;
+		} else if (i < x->n && (s = child(x)[i + 1])->n >= BTREE_T) {
+			/* through x from the right sibling */
+			c->keys[c->n] = x->keys[i];
+			if (!c->leaf)
+				child(c)[c->n + 1] = child(s)[0];
+			x->keys[i] = s->keys[0];
+			memmove(s->keys, &s->keys[1], (s->n - 1) * sizeof(s->keys[0]));
+			if (!s->leaf)
+				memmove(child(s), &child(s)[1], s->n * sizeof(bnode *));
+			s->n--;
+			c->n++;
+		} else if (i < x->n) {
+			merge(x, i);
+		} else {
+			merge(x, --i);
+		}
+		return i;
+	}
+
+	/* x has BTREE_T keys at least, or is the root */
+	static bool erase(bnode *x, const mydata *d)
+	{
+		bnode *y;
+		int i;
+
+		for (;;) {
+			i = lower(x, d);
+			if (i < x->n && compare_func(x->keys[i], d) == 0) {
+				if (x->leaf) {
+					memmove(&x->keys[i], &x->keys[i + 1], (x->n - i - 1) * sizeof(x->keys[0]));
+					x->n--;
+					return true;
+				}
+				if (child(x)[i]->n >= BTREE_T) {
+					/* the predecessor takes its place */
+					for (y = child(x)[i]; !y->leaf; y = child(y)[y->n]) ;
+					x->keys[i] = y->keys[y->n - 1];
+					return erase(child(x)[i], x->keys[i]);
+				}
+				if (child(x)[i + 1]->n >= BTREE_T) {
+					/* the successor takes its place */
+					for (y = child(x)[i + 1]; !y->leaf; y = child(y)[0]) ;
+					x->keys[i] = y->keys[0];
+					return erase(child(x)[i + 1], x->keys[i]);
+				}
+				merge(x, i);
+				x = child(x)[i];
+				continue;
+			}
+			if (x->leaf)
+				return false;
+			if (child(x)[i]->n < BTREE_T)
+				i = fill(x, i);
+			x = child(x)[i];
+		}
+	}
+
+	static long scan(bnode *x)
+	{
+		long sum;
+		int i;
+
+		for (sum = 0, i = 0; i < x->n; i++) {
+			if (!x->leaf)
+				sum += scan(child(x)[i]);
+			sum += x->keys[i]->key;
+		}
+		if (!x->leaf)
+			sum += scan(child(x)[x->n]);
+		return sum;
+	}
+};
+
+struct result {
+	const char *name;
+	long size;
+	double insert, find, scan, erase; /* ns per operation, negative if skipped */
+	double bytes; /* heap bytes requested per element, the mydata itself not counted */
+	double p50, p99, p999; /* ns per find */
+};
+
+static double now();
+static double timer_cost();
+static size_t heap_used();
+static void percentiles(std::vector<double> &t, result *r);
+template <class S> static void run(S *s, long n, std::vector<const mydata *> &order, std::vector<const mydata *> &queries, bool updates, result *r);
+static const char *field(char *buf, size_t size, double v, const char *none);
+static void print(const char *format, result *r, int first);
+
+static double overhead; /* of a now() pair, taken off each sample */
+
+/*
+ * rb_compare [-f text|csv|json] [-n max]
+ *   max is the largest structure, 1000000 by default, sizes go up by 10 from 1000
+ */
+int main(int argc, char *argv[])
+{
+	std::vector<const mydata *> order, queries;
+	const char *format;
+	long max, n, i;
+	int first;
+
+	format = "text";
+	max = 1000000;
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+			format = argv[++i];
+		else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+			max = atol(argv[++i]);
+		else
+			break;
+	}
+
+	if (i < argc || max < 1000 || max > INT32_MAX || (strcmp(format, "text") != 0 && strcmp(format, "csv") != 0 && strcmp(format, "json") != 0)) {
+		fprintf(stderr, "usage: %s [-f text|csv|json] [-n max]\n", argv[0]);
+		return 1;
+	}
+
+	srand(1);
+	overhead = timer_cost();
+
+	if (strcmp(format, "csv") == 0) {
+		printf("structure,size,insert_ns,find_ns,scan_ns,delete_ns,bytes_per_element,find_p50_ns,find_p99_ns,find_p999_ns\n");
+	} else if (strcmp(format, "json") == 0) {
+		printf("[\n");
+	} else {
+		printf("# ns per operation, heap bytes requested per element, find latency percentiles in ns (%.0f ns timer cost taken off)\n", overhead);
+		printf("%-14s %10s %10s %10s %10s %10s %10s %10s %10s %10s\n", "structure", "size", "insert", "find", "scan", "delete", "bytes", "p50", "p99", "p99.9");
+	}
+
+	first = 1;
+	for (n = 1000; n <= max; n *= 10) {
+		/* keys 0 .. n - 1 inserted and deleted in one random order, looked up in another */
+		order.resize(n);
+		for (i = 0; i < n; i++) {
+			if ((order[i] = makedata((int) i)) == NULL) {
+				fprintf(stderr, "out of memory\n");
+				return 1;
+			}
+		}
+		queries = order;
+		for (i = n - 1; i > 0; i--) {
+			std::swap(order[i], order[((long) rand() * RAND_MAX + rand()) % (i + 1)]);
+			std::swap(queries[i], queries[((long) rand() * RAND_MAX + rand()) % (i + 1)]);
+		}
+
+		result r[5] = {};
+		r[0].name = "rb.c";
+		r[1].name = "rb.c pool";
+		#ifdef RB_DUP
+		r[2].name = "std::multimap";
+		#else
+		r[2].name = "std::map";
+		#endif
+		r[3].name = "btree";
+		r[4].name = "sorted array";
+		{ rb_set s(0); run(&s, n, order, queries, true, &r[0]); }
+		{ rb_set s(1); run(&s, n, order, queries, true, &r[1]); }
+		{ map_set s; run(&s, n, order, queries, true, &r[2]); }
+		{ btree_set s; run(&s, n, order, queries, true, &r[3]); }
+		{ vector_set s; run(&s, n, order, queries, n <= VECTOR_MAX, &r[4]); }
+
+		for (i = 0; i < 5; i++, first = 0)
+			print(format, &r[i], first);
+		fflush(stdout);
+
+		for (i = 0; i < n; i++)
+			destroy_func((void *) order[i]);
+	}
+
+	if (strcmp(format, "json") == 0)
+		printf("\n]\n");
+
+	return 0;
+}
+
+double now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * least ns between two now() calls
+ */
+double timer_cost()
+{
+	double t, min;
+	int i;
+
+	for (min = 1, i = 0; i < 10000; i++) {
+		t = now();
+		t = now() - t;
+		if (t < min)
+			min = t;
+	}
+	return min * 1e9;
+}
+
+/*
+ * bytes the structures hold, counted as they allocate rather than asked of malloc, which is not portable
+ * and would count the harness's own allocations too
+ */
+size_t heap_used()
+{
+	return heap_bytes;
+}
+
+void percentiles(std::vector<double> &t, result *r)
+{
+	std::sort(t.begin(), t.end());
+	r->p50 = t[t.size() / 2];
+	r->p99 = t[t.size() * 99 / 100];
+	r->p999 = t[t.size() * 999 / 1000];
+}
+
+/*
+ * insert order, look up queries, scan, then delete order
+ * without updates, the structure is filled by sorted inserts, which are cheap for all of them, and not timed
+ */
+template <class S> void run(S *s, long n, std::vector<const mydata *> &order, std::vector<const mydata *> &queries, bool updates, result *r)
+{
+	std::vector<const mydata *> sorted;
+	std::vector<double> samples;
+	size_t heap;
+	double t;
+	long i, found, sum, rounds, samples_n;
+
+	r->size = n;
+	r->insert = r->erase = -1;
+
+	heap = heap_used();
+	if (updates) {
+		t = now();
+		for (i = 0; i < n; i++) {
+			if (!s->insert(order[i])) {
+				fprintf(stderr, "out of memory\n");
+				exit(1);
+			}
+		}
+		r->insert = (now() - t) * 1e9 / n;
+	} else {
+		sorted = order;
+		std::sort(sorted.begin(), sorted.end(), less_data());
+		for (i = 0; i < n; i++)
+			s->insert(sorted[i]);
+		sorted.clear();
+		sorted.shrink_to_fit();
+	}
+	r->bytes = (double) (heap_used() - heap) / n;
+
+	t = now();
+	for (found = 0, i = 0; i < n; i++)
+		found += s->find(queries[i]);
+	r->find = (now() - t) * 1e9 / n;
+
+	samples_n = n < LATENCY_SAMPLES ? n : LATENCY_SAMPLES;
+	samples.resize(samples_n);
+	for (i = 0; i < samples_n; i++) {
+		t = now();
+		found += s->find(queries[i]);
+		t = (now() - t) * 1e9 - overhead;
+		samples[i] = t > 0 ? t : 0;
+	}
+	percentiles(samples, r);
+
+	if (found != n + samples_n) {
+		fprintf(stderr, "%s: %ld of %ld found\n", r->name, found, n + samples_n);
+		exit(1);
+	}
+
+	rounds = n < 1000000 ? 1000000 / n : 1;
+	t = now();
+	for (sum = 0, i = 0; i < rounds; i++)
+		sum += s->scan();
+	r->scan = (now() - t) * 1e9 / (rounds * n);
+
+	if (sum != rounds * (n * (n - 1) / 2)) {
+		fprintf(stderr, "%s: scan sum %ld\n", r->name, sum);
+		exit(1);
+	}
+
+	if (updates) {
+		t = now();
+		for (found = 0, i = 0; i < n; i++)
+			found += s->erase(order[i]);
+		r->erase = (now() - t) * 1e9 / n;
+
+		if (found != n || s->find(order[0])) {
+			fprintf(stderr, "%s: %ld of %ld deleted\n", r->name, found, n);
+			exit(1);
+		}
+	}
+}
+
+/*
+ * v with one decimal, none if negative
+ */
+const char *field(char *buf, size_t size, double v, const char *none)
+{
+	if (v < 0)
+		snprintf(buf, size, "%s", none);
+	else
+		snprintf(buf, size, "%.1f", v);
+	return buf;
+}
+
+void print(const char *format, result *r, int first)
+{
+	char insert[32], erase[32];
+
+	if (strcmp(format, "csv") == 0) {
+		field(insert, sizeof(insert), r->insert, "");
+		field(erase, sizeof(erase), r->erase, "");
+		printf("%s,%ld,%s,%.1f,%.2f,%s,%.1f,%.0f,%.0f,%.0f\n", r->name, r->size, insert, r->find, r->scan, erase, r->bytes, r->p50, r->p99, r->p999);
+	} else if (strcmp(format, "json") == 0) {
+		field(insert, sizeof(insert), r->insert, "null");
+		field(erase, sizeof(erase), r->erase, "null");
+		printf("%s  {\"structure\": \"%s\", \"size\": %ld, \"insert_ns\": %s, \"find_ns\": %.1f, \"scan_ns\": %.2f, \"delete_ns\": %s, " \
+			"\"bytes_per_element\": %.1f, \"find_p50_ns\": %.0f, \"find_p99_ns\": %.0f, \"find_p999_ns\": %.0f}", \
+			first ? "" : ",\n", r->name, r->size, insert, r->find, r->scan, erase, r->bytes, r->p50, r->p99, r->p999);
+	} else {
+		field(insert, sizeof(insert), r->insert, "-");
+		field(erase, sizeof(erase), r->erase, "-");
+		printf("%-14s %10ld %10s %10.1f %10.2f %10s %10.1f %10.0f %10.0f %10.0f\n", r->name, r->size, insert, r->find, r->scan, erase, r->bytes, r->p50, r->p99, r->p999);
+	}
+}
+
+/*
+ * usage: gcc -O2 -c rb.c rb_data.c && g++ -O2 rb_compare.cpp rb.o rb_data.o -o rb_compare && ./rb_compare [-f text|csv|json] [-n max]
+ */
@@ -0,0 +1,3 @@
+#!/bin/bash
+
+gcc -O2 -c rb.c rb_data.c && g++ -O2 rb_compare.cpp rb.o rb_data.o -o rb_compare && rm -f rb.o rb_data.o && ./rb_compare "$@"
@@ -46,6 +46,73 @@ void destroy_func(void *d)
 	free(p);
 }
 
+void *copy_func(const void *d)
+{
+	assert(d != NULL);
+
+	return makedata(((mydata *) d)->key);
+}
+
+/*
+ * key as 4 bytes, low byte first
+ */
+size_t encode_func(const void *d, void *buf, size_t size, void *cookie)
+{
+	unsigned char *b;
+	unsigned int key;
+	int i;
+
+	assert(d != NULL);
+	(void) cookie;
+
+	if (size >= 4) {
+		b = (unsigned char *) buf;
+		key = (unsigned int) ((mydata *) d)->key;
+		for (i = 0; i < 4; i++, key >>= 8)
+			b[i] = (unsigned char) key;
+	}
+
+	return 4;
+}
+
+void *decode_func(const void *buf, size_t size, void *cookie)
+{
+	const unsigned char *b;
+	unsigned int key;
+
+	assert(buf != NULL);
+	(void) cookie;
+
+	if (size != 4)
+		return NULL;
+
+	b = (const unsigned char *) buf;
+	key = b[0] | b[1] << 8 | b[2] << 16 | (unsigned int) b[3] << 24;
+
+	return makedata((int) key);
+}
+
+/*
+ * data against a key encoded by encode_func
+ */
+int compare_payload_func(const void *d, const void *payload, size_t size)
+{
+	const unsigned char *b;
+	int key;
+
+	assert(d != NULL);
+	assert(size == 4);
+
+	b = (const unsigned char *) payload;
+	key = (int) (b[0] | b[1] << 8 | b[2] << 16 | (unsigned int) b[3] << 24);
+	if (((mydata *) d)->key == key)
+		return 0;
+	else if (((mydata *) d)->key > key)
+		return 1;
+	else
+		return -1;
+}
+
 void print_func(void *d)
 {
 	mydata *p;
@@ -64,4 +131,52 @@ void print_char_func(void *d)
 	
 	p = (mydata *) d;
 	printf("%c", p->key & 127);
-}
\ No newline at end of file
+}
+
+int compare_record_func(const void *n1, const void *n2)
+{
+	myrecord *p1, *p2;
+
+	assert(n1 != NULL);
+	assert(n2 != NULL);
+
+	p1 = RB_ENTRY(n1, myrecord, node);
+	p2 = RB_ENTRY(n2, myrecord, node);
+	if (p1->key == p2->key)
+		return 0;
+	else if (p1->key > p2->key)
+		return 1;
+	else
+		return -1;
+}
+
+mysumdata *makesumdata(int key)
+{
+	mysumdata *p;
+
+	p = (mysumdata *) malloc(sizeof(mysumdata));
+	if (p != NULL)
+		p->key = p->sum = key;
+
+	return p;
+}
+
+int augment_sum_func(rbnode *node)
+{
+	mysumdata *p;
+	long sum;
+
+	assert(node != NULL);
+
+	p = (mysumdata *) node->data;
+	sum = p->key;
+	if (node->left != &rb_nil)
+		sum += ((mysumdata *) node->left->data)->sum;
+	if (node->right != &rb_nil)
+		sum += ((mysumdata *) node->right->data)->sum;
+
+	if (p->sum == sum)
+		return 0;
+	p->sum = sum;
+	return 1;
+}
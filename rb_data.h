@@ -6,15 +6,44 @@
 #ifndef _RB_DATA_HEADER
 #define _RB_DATA_HEADER
 
+#include "rb.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 typedef struct {
 	int key;
 } mydata;
 
+typedef struct {
+	int key;
+	rbnode node;
+} myrecord;
+
+typedef struct {
+	int key; /* first, as in mydata */
+	long sum; /* sum of the keys in the subtree */
+} mysumdata;
+
 mydata *makedata(int key);
 int compare_func(const void *d1, const void *d2);
 void destroy_func(void *d);
+void *copy_func(const void *d);
+size_t encode_func(const void *d, void *buf, size_t size, void *cookie);
+void *decode_func(const void *buf, size_t size, void *cookie);
+int compare_payload_func(const void *d, const void *payload, size_t size);
 void print_func(void *d);
 void print_char_func(void *d);
 
+int compare_record_func(const void *n1, const void *n2);
+
+mysumdata *makesumdata(int key);
+int augment_sum_func(rbnode *node);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* _RB_DATA_HEADER */
 
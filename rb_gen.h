@@ -0,0 +1,567 @@
+/*
+ * Copyright (c) 2019 xieqing. https://github.com/xieqing
+ * May be freely redistributed, but copyright notice must be retained.
+ */
+
+/*
+ * type-specialized red-black tree
+ *
+ * the algorithm of rb.c instantiated for a concrete key type, with the comparison
+ * expanded inline instead of called through a function pointer
+ *
+ * usage:
+ *   #define RB_GEN_NAME inttree               prefix of generated types and functions
+ *   #define RB_GEN_KEY int                    key type, stored by value in the node
+ *   #define RB_GEN_CMP(a, b) (((a) > (b)) - ((a) < (b)))   three-way comparison of two keys
+ *   #include "rb_gen.h"
+ *
+ * generates:
+ *   inttree_node, inttree
+ *   inttree_create, inttree_destroy, inttree_find, inttree_successor,
+ *   inttree_insert, inttree_delete, inttree_check_order, inttree_check_black_height
+ *
+ * the header may be included once per instantiation, the parameters are undefined afterwards
+ */
+
+#ifndef _RB_GEN_HEADER
+#define _RB_GEN_HEADER
+
+#include <stdlib.h>
+#include "rb.h"
+
+#define RB_GEN_CAT_(a, b) a##b
+#define RB_GEN_CAT(a, b) RB_GEN_CAT_(a, b)
+
+#endif /* _RB_GEN_HEADER */
+
+#if !defined(RB_GEN_NAME) || !defined(RB_GEN_KEY) || !defined(RB_GEN_CMP)
+#error "RB_GEN_NAME, RB_GEN_KEY and RB_GEN_CMP must be defined before including rb_gen.h"
+#endif
+
+#define RB_GEN_NODE RB_GEN_CAT(RB_GEN_NAME, _node)
+#define RB_GEN_TREE RB_GEN_NAME
+#define RB_GEN_FN(f) RB_GEN_CAT(RB_GEN_NAME, f)
+#define RB_GEN_NIL(rbt) (&(rbt)->nil)
+#define RB_GEN_ROOT(rbt) (&(rbt)->root)
+#define RB_GEN_FIRST(rbt) ((rbt)->root.left)
+
+typedef struct RB_GEN_NODE {
+	struct RB_GEN_NODE *left;
+	struct RB_GEN_NODE *right;
+	struct RB_GEN_NODE *parent;
+	char color;
+	RB_GEN_KEY key;
+	void *data;
+} RB_GEN_NODE;
+
+typedef struct {
+	void (*destroy)(void *);
+
+	RB_GEN_NODE root;
+	RB_GEN_NODE nil;
+
+	#ifdef RB_MIN
+	RB_GEN_NODE *min;
+	#endif
+} RB_GEN_TREE;
+
+/*
+ * construction
+ * return NULL if out of memory
+ */
+static inline RB_GEN_TREE *RB_GEN_FN(_create)(void (*destroy)(void *))
+{
+	RB_GEN_TREE *rbt;
+
+	rbt = (RB_GEN_TREE *) malloc(sizeof(RB_GEN_TREE));
+	if (rbt == NULL)
+		return NULL; /* out of memory */
+
+	rbt->destroy = destroy;
+
+	/* sentinel node nil */
+	rbt->nil.left = rbt->nil.right = rbt->nil.parent = RB_GEN_NIL(rbt);
+	rbt->nil.color = BLACK;
+	rbt->nil.data = NULL;
+
+	/* sentinel node root */
+	rbt->root.left = rbt->root.right = rbt->root.parent = RB_GEN_NIL(rbt);
+	rbt->root.color = BLACK;
+	rbt->root.data = NULL;
+
+	#ifdef RB_MIN
+	rbt->min = NULL;
+	#endif
+
+	return rbt;
+}
+
+/*
+ * destroy node recursively
+ */
+static inline void RB_GEN_FN(_destroy_node)(RB_GEN_TREE *rbt, RB_GEN_NODE *n)
+{
+	if (n != RB_GEN_NIL(rbt)) {
+		RB_GEN_FN(_destroy_node)(rbt, n->left);
+		RB_GEN_FN(_destroy_node)(rbt, n->right);
+		if (rbt->destroy != NULL)
+			rbt->destroy(n->data);
+		free(n);
+	}
+}
+
+/*
+ * destruction
+ */
+static inline void RB_GEN_FN(_destroy)(RB_GEN_TREE *rbt)
+{
+	RB_GEN_FN(_destroy_node)(rbt, RB_GEN_FIRST(rbt));
+	free(rbt);
+}
+
+/*
+ * look up
+ * return NULL if not found
+ */
+static inline RB_GEN_NODE *RB_GEN_FN(_find)(RB_GEN_TREE *rbt, RB_GEN_KEY key)
+{
+	RB_GEN_NODE *p;
+
+	p = RB_GEN_FIRST(rbt);
+
+	while (p != RB_GEN_NIL(rbt)) {
+		int cmp;
+		cmp = RB_GEN_CMP(key, p->key);
+		if (cmp == 0)
+			return p; /* found */
+		p = cmp < 0 ? p->left : p->right;
+	}
+
+	return NULL; /* not found */
+}
+
+/*
+ * next larger
+ * return NULL if not found
+ */
+static inline RB_GEN_NODE *RB_GEN_FN(_successor)(RB_GEN_TREE *rbt, RB_GEN_NODE *node)
+{
+	RB_GEN_NODE *p;
+
+	p = node->right;
+
+	if (p != RB_GEN_NIL(rbt)) {
+		/* move down until we find it */
+		for ( ; p->left != RB_GEN_NIL(rbt); p = p->left) ;
+	} else {
+		/* move up until we find it or hit the root */
+		for (p = node->parent; node == p->right; node = p, p = p->parent) ;
+
+		if (p == RB_GEN_ROOT(rbt))
+			p = NULL; /* not found */
+	}
+
+	return p;
+}
+
+/*
+ * rotate left about x
+ */
+static inline void RB_GEN_FN(_rotate_left)(RB_GEN_TREE *rbt, RB_GEN_NODE *x)
+{
+	RB_GEN_NODE *y;
+
+	y = x->right; /* child */
+
+	/* tree x */
+	x->right = y->left;
+	if (x->right != RB_GEN_NIL(rbt))
+		x->right->parent = x;
+
+	/* tree y */
+	y->parent = x->parent;
+	if (x == x->parent->left)
+		x->parent->left = y;
+	else
+		x->parent->right = y;
+
+	/* assemble tree x and tree y */
+	y->left = x;
+	x->parent = y;
+}
+
+/*
+ * rotate right about x
+ */
+static inline void RB_GEN_FN(_rotate_right)(RB_GEN_TREE *rbt, RB_GEN_NODE *x)
+{
+	RB_GEN_NODE *y;
+
+	y = x->left; /* child */
+
+	/* tree x */
+	x->left = y->right;
+	if (x->left != RB_GEN_NIL(rbt))
+		x->left->parent = x;
+
+	/* tree y */
+	y->parent = x->parent;
+	if (x == x->parent->left)
+		x->parent->left = y;
+	else
+		x->parent->right = y;
+
+	/* assemble tree x and tree y */
+	y->right = x;
+	x->parent = y;
+}
+
+/*
+ * rebalance after insertion
+ */
+static inline void RB_GEN_FN(_insert_repair)(RB_GEN_TREE *rbt, RB_GEN_NODE *current)
+{
+	RB_GEN_NODE *uncle;
+
+	do {
+		/* current node is RED and parent node is RED */
+
+		if (current->parent == current->parent->parent->left) {
+			uncle = current->parent->parent->right;
+			if (uncle->color == RED) {
+				/* split, and send grandparent node up the tree */
+				current->parent->color = BLACK;
+				uncle->color = BLACK;
+				current = current->parent->parent; /* goto loop or break */
+				current->color = RED;
+			} else {
+				/* equivalent BST */
+				if (current == current->parent->right) {
+					current = current->parent;
+					RB_GEN_FN(_rotate_left)(rbt, current);
+				}
+
+				/* 3-children cluster has two representations */
+				current->parent->color = BLACK; /* thus goto break */
+				current->parent->parent->color = RED;
+				RB_GEN_FN(_rotate_right)(rbt, current->parent->parent);
+			}
+		} else {
+			uncle = current->parent->parent->left;
+			if (uncle->color == RED) {
+				/* split, and send grandparent node up the tree */
+				current->parent->color = BLACK;
+				uncle->color = BLACK;
+				current = current->parent->parent; /* goto loop or break */
+				current->color = RED;
+			} else {
+				/* equivalent BST */
+				if (current == current->parent->left) {
+					current = current->parent;
+					RB_GEN_FN(_rotate_right)(rbt, current);
+				}
+
+				/* 3-children cluster has two representations */
+				current->parent->color = BLACK; /* thus goto break */
+				current->parent->parent->color = RED;
+				RB_GEN_FN(_rotate_left)(rbt, current->parent->parent);
+			}
+		}
+	} while (current->parent->color == RED);
+}
+
+/*
+ * insert (or update) key
+ * return NULL if out of memory
+ */
+static inline RB_GEN_NODE *RB_GEN_FN(_insert)(RB_GEN_TREE *rbt, RB_GEN_KEY key, void *data)
+{
+	RB_GEN_NODE *current, *parent;
+	int cmp;
+
+	/* do a binary search to find where it should be */
+
+	current = RB_GEN_FIRST(rbt);
+	parent = RB_GEN_ROOT(rbt);
+	cmp = -1;
+
+	while (current != RB_GEN_NIL(rbt)) {
+		cmp = RB_GEN_CMP(key, current->key);
+
+		#ifndef RB_DUP
+		if (cmp == 0) {
+			if (rbt->destroy != NULL)
+				rbt->destroy(current->data);
+			current->data = data;
+			return current; /* updated */
+		}
+		#endif
+
+		parent = current;
+		current = cmp < 0 ? current->left : current->right;
+	}
+
+	/* replace the termination NIL pointer with the new node pointer */
+
+	current = (RB_GEN_NODE *) malloc(sizeof(RB_GEN_NODE));
+	if (current == NULL)
+		return NULL; /* out of memory */
+
+	current->left = current->right = RB_GEN_NIL(rbt);
+	current->parent = parent;
+	current->color = RED;
+	current->key = key;
+	current->data = data;
+
+	if (cmp < 0)
+		parent->left = current;
+	else
+		parent->right = current;
+
+	#ifdef RB_MIN
+	if (rbt->min == NULL || RB_GEN_CMP(key, rbt->min->key) < 0)
+		rbt->min = current;
+	#endif
+
+	/* see rb_insert for the 2-3-4 tree cases */
+	if (current->parent->color == RED)
+		RB_GEN_FN(_insert_repair)(rbt, current);
+
+	/* the root is always BLACK */
+	RB_GEN_FIRST(rbt)->color = BLACK;
+
+	return current;
+}
+
+/*
+ * rebalance after deletion
+ */
+static inline void RB_GEN_FN(_delete_repair)(RB_GEN_TREE *rbt, RB_GEN_NODE *current)
+{
+	RB_GEN_NODE *sibling;
+
+	do {
+		if (current == current->parent->left) {
+			sibling = current->parent->right;
+
+			if (sibling->color == RED) {
+				/* perform an adjustment (3-children parent cluster has two representations) */
+				sibling->color = BLACK;
+				current->parent->color = RED;
+				RB_GEN_FN(_rotate_left)(rbt, current->parent);
+				sibling = current->parent->right;
+			}
+
+			/* sibling node must be BLACK now */
+
+			if (sibling->right->color == BLACK && sibling->left->color == BLACK) {
+				/* 2-children sibling cluster, fuse by recoloring */
+				sibling->color = RED;
+				if (current->parent->color == RED) { /* 3/4-children parent cluster */
+					current->parent->color = BLACK;
+					break; /* goto break */
+				} else { /* 2-children parent cluster */
+					current = current->parent; /* goto loop */
+				}
+			} else {
+				/* perform an adjustment (3-children sibling cluster has two representations) */
+				if (sibling->right->color == BLACK) {
+					sibling->left->color = BLACK;
+					sibling->color = RED;
+					RB_GEN_FN(_rotate_right)(rbt, sibling);
+					sibling = current->parent->right;
+				}
+
+				/* transfer by rotation and recoloring */
+				sibling->color = current->parent->color;
+				current->parent->color = BLACK;
+				sibling->right->color = BLACK;
+				RB_GEN_FN(_rotate_left)(rbt, current->parent);
+				break; /* goto break */
+			}
+		} else {
+			sibling = current->parent->left;
+
+			if (sibling->color == RED) {
+				/* perform an adjustment (3-children parent cluster has two representations) */
+				sibling->color = BLACK;
+				current->parent->color = RED;
+				RB_GEN_FN(_rotate_right)(rbt, current->parent);
+				sibling = current->parent->left;
+			}
+
+			/* sibling node must be BLACK now */
+
+			if (sibling->right->color == BLACK && sibling->left->color == BLACK) {
+				/* 2-children sibling cluster, fuse by recoloring */
+				sibling->color = RED;
+				if (current->parent->color == RED) { /* 3/4-children parent cluster */
+					current->parent->color = BLACK;
+					break; /* goto break */
+				} else { /* 2-children parent cluster */
+					current = current->parent; /* goto loop */
+				}
+			} else {
+				/* perform an adjustment (3-children sibling cluster has two representations) */
+				if (sibling->left->color == BLACK) {
+					sibling->right->color = BLACK;
+					sibling->color = RED;
+					RB_GEN_FN(_rotate_left)(rbt, sibling);
+					sibling = current->parent->left;
+				}
+
+				/* transfer by rotation and recoloring */
+				sibling->color = current->parent->color;
+				current->parent->color = BLACK;
+				sibling->left->color = BLACK;
+				RB_GEN_FN(_rotate_right)(rbt, current->parent);
+				break; /* goto break */
+			}
+		}
+	} while (current != RB_GEN_FIRST(rbt));
+}
+
+/*
+ * delete node
+ * return NULL if keep is zero (already freed)
+ */
+static inline void *RB_GEN_FN(_delete)(RB_GEN_TREE *rbt, RB_GEN_NODE *node, int keep)
+{
+	RB_GEN_NODE *target, *child;
+	void *data;
+
+	data = node->data;
+
+	/* choose node's in-order successor if it has two children */
+
+	if (node->left == RB_GEN_NIL(rbt) || node->right == RB_GEN_NIL(rbt)) {
+		target = node;
+
+		#ifdef RB_MIN
+		if (rbt->min == target)
+			rbt->min = RB_GEN_FN(_successor)(rbt, target); /* deleted, thus min = successor */
+		#endif
+	} else {
+		target = RB_GEN_FN(_successor)(rbt, node); /* node->right must not be RB_GEN_NIL, thus move down */
+	}
+
+	child = (target->left == RB_GEN_NIL(rbt)) ? target->right : target->left; /* child may be RB_GEN_NIL */
+
+	/* see rb_delete for the 2-3-4 tree cases */
+	if (target->color == BLACK) {
+		if (child->color == RED)
+			child->color = BLACK;
+		else if (target != RB_GEN_FIRST(rbt))
+			RB_GEN_FN(_delete_repair)(rbt, target);
+	}
+
+	if (child != RB_GEN_NIL(rbt))
+		child->parent = target->parent;
+
+	if (target == target->parent->left)
+		target->parent->left = child;
+	else
+		target->parent->right = child;
+
+	if (target != node) {
+		/* target takes node's place */
+		target->left = node->left;
+		target->right = node->right;
+		target->parent = node->parent;
+		target->color = node->color;
+
+		if (node == node->parent->left)
+			node->parent->left = target;
+		else
+			node->parent->right = target;
+
+		if (target->left != RB_GEN_NIL(rbt))
+			target->left->parent = target;
+		if (target->right != RB_GEN_NIL(rbt))
+			target->right->parent = target;
+	}
+
+	free(node);
+
+	/* keep or discard data */
+	if (keep == 0) {
+		if (rbt->destroy != NULL)
+			rbt->destroy(data);
+		data = NULL;
+	}
+
+	return data;
+}
+
+/*
+ * check order recursively
+ */
+static inline int RB_GEN_FN(_check_order_node)(RB_GEN_TREE *rbt, RB_GEN_NODE *n, RB_GEN_KEY min, RB_GEN_KEY max)
+{
+	if (n == RB_GEN_NIL(rbt))
+		return 1;
+
+	#ifdef RB_DUP
+	if (RB_GEN_CMP(n->key, min) < 0 || RB_GEN_CMP(n->key, max) > 0)
+	#else
+	if (RB_GEN_CMP(n->key, min) <= 0 || RB_GEN_CMP(n->key, max) >= 0)
+	#endif
+		return 0;
+
+	return RB_GEN_FN(_check_order_node)(rbt, n->left, min, n->key) && RB_GEN_FN(_check_order_node)(rbt, n->right, n->key, max);
+}
+
+/*
+ * check order of tree
+ */
+static inline int RB_GEN_FN(_check_order)(RB_GEN_TREE *rbt, RB_GEN_KEY min, RB_GEN_KEY max)
+{
+	return RB_GEN_FN(_check_order_node)(rbt, RB_GEN_FIRST(rbt), min, max);
+}
+
+/*
+ * check black height recursively
+ */
+static inline int RB_GEN_FN(_check_black_height_node)(RB_GEN_TREE *rbt, RB_GEN_NODE *n)
+{
+	int lbh, rbh;
+
+	if (n == RB_GEN_NIL(rbt))
+		return 1;
+
+	if (n->color == RED && (n->left->color == RED || n->right->color == RED || n->parent->color == RED))
+		return 0;
+
+	if ((lbh = RB_GEN_FN(_check_black_height_node)(rbt, n->left)) == 0)
+		return 0;
+
+	if ((rbh = RB_GEN_FN(_check_black_height_node)(rbt, n->right)) == 0)
+		return 0;
+
+	if (lbh != rbh)
+		return 0;
+
+	return lbh + (n->color == BLACK ? 1 : 0);
+}
+
+/*
+ * check black height of tree
+ */
+static inline int RB_GEN_FN(_check_black_height)(RB_GEN_TREE *rbt)
+{
+	if (rbt->root.color == RED || RB_GEN_FIRST(rbt)->color == RED || rbt->nil.color == RED)
+		return 0;
+
+	return RB_GEN_FN(_check_black_height_node)(rbt, RB_GEN_FIRST(rbt));
+}
+
+#undef RB_GEN_NODE
+#undef RB_GEN_TREE
+#undef RB_GEN_FN
+#undef RB_GEN_NIL
+#undef RB_GEN_ROOT
+#undef RB_GEN_FIRST
+
+#undef RB_GEN_NAME
+#undef RB_GEN_KEY
+#undef RB_GEN_CMP
@@ -0,0 +1,575 @@
+/*
+ * Copyright (c) 2019 xieqing. https://github.com/xieqing
+ * May be freely redistributed, but copyright notice must be retained.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "rb_index.h"
+
+#define FREE 2 /* color of a slot on the free list */
+
+#define N(i) (rbt->nodes[(i)])
+
+static rbindex node_alloc(rbitree *rbt, void *data);
+static void node_free(rbitree *rbt, rbindex node);
+static void insert_repair(rbitree *rbt, rbindex current);
+static void delete_repair(rbitree *rbt, rbindex current);
+static void replace_node(rbitree *rbt, rbindex old, rbindex node);
+static void rotate_left(rbitree *rbt, rbindex x);
+static void rotate_right(rbitree *rbt, rbindex x);
+static int check_order(rbitree *rbt, rbindex n, void *min, void *max);
+static int check_black_height(rbitree *rbt, rbindex n);
+
+/*
+ * construction
+ * return NULL if out of memory
+ */
+rbitree *rbi_create(int (*compare)(const void *, const void *), void (*destroy)(void *))
+{
+	rbitree *rbt;
+
+	rbt = (rbitree *) malloc(sizeof(rbitree));
+	if (rbt == NULL)
+		return NULL; /* out of memory */
+
+	rbt->capacity = 16;
+	rbt->nodes = (rbinode *) malloc(rbt->capacity * sizeof(rbinode));
+	if (rbt->nodes == NULL) {
+		free(rbt);
+		return NULL; /* out of memory */
+	}
+
+	rbt->compare = compare;
+	rbt->destroy = destroy;
+	rbt->size = 2;
+	rbt->free = RBI_NIL;
+
+	/* sentinel node nil */
+	N(RBI_NIL).left = N(RBI_NIL).right = N(RBI_NIL).parent = RBI_NIL;
+	N(RBI_NIL).color = BLACK;
+	N(RBI_NIL).data = NULL;
+
+	/* sentinel node root */
+	N(RBI_ROOT).left = N(RBI_ROOT).right = N(RBI_ROOT).parent = RBI_NIL;
+	N(RBI_ROOT).color = BLACK;
+	N(RBI_ROOT).data = NULL;
+
+	#ifdef RB_MIN
+	rbt->min = RBI_NIL;
+	#endif
+
+	return rbt;
+}
+
+/*
+ * destruction
+ * live slots are found by scanning the array, no tree walk
+ */
+void rbi_destroy(rbitree *rbt)
+{
+	rbindex i;
+
+	if (rbt->destroy != NULL) {
+		for (i = RBI_ROOT + 1; i < rbt->size; i++) {
+			if (N(i).color != FREE)
+				rbt->destroy(N(i).data);
+		}
+	}
+
+	free(rbt->nodes);
+	free(rbt);
+}
+
+/*
+ * take a slot from the free list or the end of the array, growing it if full
+ * return RBI_NIL if out of memory
+ */
+rbindex node_alloc(rbitree *rbt, void *data)
+{
+	rbinode *nodes;
+	rbindex node, capacity;
+
+	if (rbt->free != RBI_NIL) {
+		node = rbt->free;
+		rbt->free = N(node).left;
+	} else {
+		if (rbt->size == rbt->capacity) {
+			/* size would wrap around onto nil and root */
+			if (rbt->capacity == UINT32_MAX)
+				return RBI_NIL; /* out of indices */
+			capacity = rbt->capacity > UINT32_MAX / 2 ? UINT32_MAX : rbt->capacity * 2;
+			#if SIZE_MAX <= UINT32_MAX
+			if (capacity > SIZE_MAX / sizeof(rbinode))
+				return RBI_NIL; /* out of memory */
+			#endif
+			nodes = (rbinode *) realloc(rbt->nodes, capacity * sizeof(rbinode));
+			if (nodes == NULL)
+				return RBI_NIL; /* out of memory */
+			rbt->nodes = nodes;
+			rbt->capacity = capacity;
+		}
+		node = rbt->size++;
+	}
+
+	N(node).data = data;
+
+	return node;
+}
+
+/*
+ * put slot on the free list
+ */
+void node_free(rbitree *rbt, rbindex node)
+{
+	N(node).color = FREE;
+	N(node).left = rbt->free;
+	rbt->free = node;
+}
+
+/*
+ * look up
+ * return RBI_NIL if not found
+ */
+rbindex rbi_find(rbitree *rbt, void *data)
+{
+	rbindex p;
+
+	p = RBI_FIRST(rbt);
+
+	while (p != RBI_NIL) {
+		int cmp;
+		cmp = rbt->compare(data, N(p).data);
+		if (cmp == 0)
+			return p; /* found */
+		p = cmp < 0 ? N(p).left : N(p).right;
+	}
+
+	return RBI_NIL; /* not found */
+}
+
+/*
+ * next larger
+ * return RBI_NIL if not found
+ */
+rbindex rbi_successor(rbitree *rbt, rbindex node)
+{
+	rbindex p;
+
+	p = N(node).right;
+
+	if (p != RBI_NIL) {
+		/* move down until we find it */
+		for ( ; N(p).left != RBI_NIL; p = N(p).left) ;
+	} else {
+		/* move up until we find it or hit the root */
+		for (p = N(node).parent; node == N(p).right; node = p, p = N(p).parent) ;
+
+		if (p == RBI_ROOT)
+			p = RBI_NIL; /* not found */
+	}
+
+	return p;
+}
+
+/*
+ * rotate left about x
+ */
+void rotate_left(rbitree *rbt, rbindex x)
+{
+	rbindex y;
+
+	y = N(x).right; /* child */
+
+	/* tree x */
+	N(x).right = N(y).left;
+	if (N(x).right != RBI_NIL)
+		N(N(x).right).parent = x;
+
+	/* tree y */
+	N(y).parent = N(x).parent;
+	if (x == N(N(x).parent).left)
+		N(N(x).parent).left = y;
+	else
+		N(N(x).parent).right = y;
+
+	/* assemble tree x and tree y */
+	N(y).left = x;
+	N(x).parent = y;
+}
+
+/*
+ * rotate right about x
+ */
+void rotate_right(rbitree *rbt, rbindex x)
+{
+	rbindex y;
+
+	y = N(x).left; /* child */
+
+	/* tree x */
+	N(x).left = N(y).right;
+	if (N(x).left != RBI_NIL)
+		N(N(x).left).parent = x;
+
+	/* tree y */
+	N(y).parent = N(x).parent;
+	if (x == N(N(x).parent).left)
+		N(N(x).parent).left = y;
+	else
+		N(N(x).parent).right = y;
+
+	/* assemble tree x and tree y */
+	N(y).right = x;
+	N(x).parent = y;
+}
+
+/*
+ * insert (or update) data
+ * return RBI_NIL if out of memory
+ */
+rbindex rbi_insert(rbitree *rbt, void *data)
+{
+	rbindex current, parent;
+
+	/* do a binary search to find where it should be */
+
+	current = RBI_FIRST(rbt);
+	parent = RBI_ROOT;
+
+	while (current != RBI_NIL) {
+		int cmp;
+		cmp = rbt->compare(data, N(current).data);
+
+		#ifndef RB_DUP
+		if (cmp == 0) {
+			if (rbt->destroy != NULL)
+				rbt->destroy(N(current).data);
+			N(current).data = data;
+			return current; /* updated */
+		}
+		#endif
+
+		parent = current;
+		current = cmp < 0 ? N(current).left : N(current).right;
+	}
+
+	/* replace the termination NIL index with the new node index */
+
+	if ((current = node_alloc(rbt, data)) == RBI_NIL)
+		return RBI_NIL; /* out of memory */
+
+	N(current).left = N(current).right = RBI_NIL;
+	N(current).parent = parent;
+	N(current).color = RED;
+
+	if (parent == RBI_ROOT || rbt->compare(data, N(parent).data) < 0)
+		N(parent).left = current;
+	else
+		N(parent).right = current;
+
+	#ifdef RB_MIN
+	if (rbt->min == RBI_NIL || rbt->compare(data, N(rbt->min).data) < 0)
+		rbt->min = current;
+	#endif
+
+	/* see rb_insert for the 2-3-4 tree cases */
+	if (N(N(current).parent).color == RED)
+		insert_repair(rbt, current);
+
+	/* the root is always BLACK */
+	N(RBI_FIRST(rbt)).color = BLACK;
+
+	return current;
+}
+
+/*
+ * rebalance after insertion
+ */
+void insert_repair(rbitree *rbt, rbindex current)
+{
+	rbindex parent, grandparent, uncle;
+
+	do {
+		/* current node is RED and parent node is RED */
+
+		parent = N(current).parent;
+		grandparent = N(parent).parent;
+
+		if (parent == N(grandparent).left) {
+			uncle = N(grandparent).right;
+			if (N(uncle).color == RED) {
+				/* split */
+				N(parent).color = BLACK;
+				N(uncle).color = BLACK;
+
+				/* send grandparent node up the tree */
+				current = grandparent; /* goto loop or break */
+				N(current).color = RED;
+			} else {
+				/* equivalent BST */
+				if (current == N(parent).right) {
+					current = parent;
+					rotate_left(rbt, current);
+				}
+
+				/* 3-children cluster has two representations */
+				N(N(current).parent).color = BLACK; /* thus goto break */
+				N(N(N(current).parent).parent).color = RED;
+				rotate_right(rbt, N(N(current).parent).parent);
+			}
+		} else {
+			uncle = N(grandparent).left;
+			if (N(uncle).color == RED) {
+				/* split */
+				N(parent).color = BLACK;
+				N(uncle).color = BLACK;
+
+				/* send grandparent node up the tree */
+				current = grandparent; /* goto loop or break */
+				N(current).color = RED;
+			} else {
+				/* equivalent BST */
+				if (current == N(parent).left) {
+					current = parent;
+					rotate_right(rbt, current);
+				}
+
+				/* 3-children cluster has two representations */
+				N(N(current).parent).color = BLACK; /* thus goto break */
+				N(N(N(current).parent).parent).color = RED;
+				rotate_left(rbt, N(N(current).parent).parent);
+			}
+		}
+	} while (N(N(current).parent).color == RED);
+}
+
+/*
+ * delete node
+ * return NULL if keep is zero (already freed)
+ */
+void *rbi_delete(rbitree *rbt, rbindex node, int keep)
+{
+	rbindex target, child;
+	void *data;
+
+	data = N(node).data;
+
+	/* choose node's in-order successor if it has two children */
+
+	if (N(node).left == RBI_NIL || N(node).right == RBI_NIL) {
+		target = node;
+
+		#ifdef RB_MIN
+		if (rbt->min == target)
+			rbt->min = rbi_successor(rbt, target); /* deleted, thus min = successor */
+		#endif
+	} else {
+		target = rbi_successor(rbt, node); /* node->right must not be NIL, thus move down */
+	}
+
+	child = (N(target).left == RBI_NIL) ? N(target).right : N(target).left; /* child may be NIL */
+
+	/* see rb_delete for the 2-3-4 tree cases */
+	if (N(target).color == BLACK) {
+		if (N(child).color == RED)
+			N(child).color = BLACK;
+		else if (target != RBI_FIRST(rbt))
+			delete_repair(rbt, target);
+	}
+
+	if (child != RBI_NIL)
+		N(child).parent = N(target).parent;
+
+	if (target == N(N(target).parent).left)
+		N(N(target).parent).left = child;
+	else
+		N(N(target).parent).right = child;
+
+	if (target != node)
+		replace_node(rbt, node, target);
+
+	node_free(rbt, node);
+
+	/* keep or discard data */
+	if (keep == 0) {
+		if (rbt->destroy != NULL)
+			rbt->destroy(data);
+		data = NULL;
+	}
+
+	return data;
+}
+
+/*
+ * put node in old's place, taking over its links and color
+ */
+void replace_node(rbitree *rbt, rbindex old, rbindex node)
+{
+	N(node).left = N(old).left;
+	N(node).right = N(old).right;
+	N(node).parent = N(old).parent;
+	N(node).color = N(old).color;
+
+	if (old == N(N(old).parent).left)
+		N(N(old).parent).left = node;
+	else
+		N(N(old).parent).right = node;
+
+	if (N(node).left != RBI_NIL)
+		N(N(node).left).parent = node;
+	if (N(node).right != RBI_NIL)
+		N(N(node).right).parent = node;
+}
+
+/*
+ * rebalance after deletion
+ */
+void delete_repair(rbitree *rbt, rbindex current)
+{
+	rbindex parent, sibling;
+
+	do {
+		parent = N(current).parent;
+
+		if (current == N(parent).left) {
+			sibling = N(parent).right;
+
+			if (N(sibling).color == RED) {
+				/* perform an adjustment (3-children parent cluster has two representations) */
+				N(sibling).color = BLACK;
+				N(parent).color = RED;
+				rotate_left(rbt, parent);
+				sibling = N(parent).right;
+			}
+
+			/* sibling node must be BLACK now */
+
+			if (N(N(sibling).right).color == BLACK && N(N(sibling).left).color == BLACK) {
+				/* 2-children sibling cluster, fuse by recoloring */
+				N(sibling).color = RED;
+				if (N(parent).color == RED) { /* 3/4-children parent cluster */
+					N(parent).color = BLACK;
+					break; /* goto break */
+				} else { /* 2-children parent cluster */
+					current = parent; /* goto loop */
+				}
+			} else {
+				/* perform an adjustment (3-children sibling cluster has two representations) */
+				if (N(N(sibling).right).color == BLACK) {
+					N(N(sibling).left).color = BLACK;
+					N(sibling).color = RED;
+					rotate_right(rbt, sibling);
+					sibling = N(parent).right;
+				}
+
+				/* transfer by rotation and recoloring */
+				N(sibling).color = N(parent).color;
+				N(parent).color = BLACK;
+				N(N(sibling).right).color = BLACK;
+				rotate_left(rbt, parent);
+				break; /* goto break */
+			}
+		} else {
+			sibling = N(parent).left;
+
+			if (N(sibling).color == RED) {
+				/* perform an adjustment (3-children parent cluster has two representations) */
+				N(sibling).color = BLACK;
+				N(parent).color = RED;
+				rotate_right(rbt, parent);
+				sibling = N(parent).left;
+			}
+
+			/* sibling node must be BLACK now */
+
+			if (N(N(sibling).right).color == BLACK && N(N(sibling).left).color == BLACK) {
+				/* 2-children sibling cluster, fuse by recoloring */
+				N(sibling).color = RED;
+				if (N(parent).color == RED) { /* 3/4-children parent cluster */
+					N(parent).color = BLACK;
+					break; /* goto break */
+				} else { /* 2-children parent cluster */
+					current = parent; /* goto loop */
+				}
+			} else {
+				/* perform an adjustment (3-children sibling cluster has two representations) */
+				if (N(N(sibling).left).color == BLACK) {
+					N(N(sibling).right).color = BLACK;
+					N(sibling).color = RED;
+					rotate_left(rbt, sibling);
+					sibling = N(parent).left;
+				}
+
+				/* transfer by rotation and recoloring */
+				N(sibling).color = N(parent).color;
+				N(parent).color = BLACK;
+				N(N(sibling).left).color = BLACK;
+				rotate_right(rbt, parent);
+				break; /* goto break */
+			}
+		}
+	} while (current != RBI_FIRST(rbt));
+}
+
+/*
+ * check order of tree
+ */
+int rbi_check_order(rbitree *rbt, void *min, void *max)
+{
+	return check_order(rbt, RBI_FIRST(rbt), min, max);
+}
+
+/*
+ * check order recursively
+ */
+int check_order(rbitree *rbt, rbindex n, void *min, void *max)
+{
+	if (n == RBI_NIL)
+		return 1;
+
+	#ifdef RB_DUP
+	if (rbt->compare(N(n).data, min) < 0 || rbt->compare(N(n).data, max) > 0)
+	#else
+	if (rbt->compare(N(n).data, min) <= 0 || rbt->compare(N(n).data, max) >= 0)
+	#endif
+		return 0;
+
+	return check_order(rbt, N(n).left, min, N(n).data) && check_order(rbt, N(n).right, N(n).data, max);
+}
+
+/*
+ * check black height of tree
+ */
+int rbi_check_black_height(rbitree *rbt)
+{
+	if (N(RBI_ROOT).color == RED || N(RBI_FIRST(rbt)).color == RED || N(RBI_NIL).color == RED)
+		return 0;
+
+	return check_black_height(rbt, RBI_FIRST(rbt));
+}
+
+/*
+ * check black height recursively
+ */
+int check_black_height(rbitree *rbt, rbindex n)
+{
+	int lbh, rbh;
+
+	if (n == RBI_NIL)
+		return 1;
+
+	if (N(n).color == RED && (N(N(n).left).color == RED || N(N(n).right).color == RED || N(N(n).parent).color == RED))
+		return 0;
+
+	if ((lbh = check_black_height(rbt, N(n).left)) == 0)
+		return 0;
+
+	if ((rbh = check_black_height(rbt, N(n).right)) == 0)
+		return 0;
+
+	if (lbh != rbh)
+		return 0;
+
+	return lbh + (N(n).color == BLACK ? 1 : 0);
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2019 xieqing. https://github.com/xieqing
+ * May be freely redistributed, but copyright notice must be retained.
+ */
+
+#ifndef _RB_INDEX_HEADER
+#define _RB_INDEX_HEADER
+
+#include <stdint.h>
+#include "rb.h"
+
+/*
+ * red-black tree over a growable node array
+ * links are 32-bit indices, index 0 is the NIL sentinel and index 1 is the root sentinel
+ */
+
+typedef uint32_t rbindex;
+
+typedef struct {
+	rbindex left;
+	rbindex right;
+	rbindex parent;
+	char color;
+	void *data;
+} rbinode;
+
+typedef struct {
+	int (*compare)(const void *, const void *);
+	void (*destroy)(void *);
+
+	rbinode *nodes;
+	rbindex size; /* slots handed out, including sentinels */
+	rbindex capacity;
+	rbindex free; /* free slots linked through left */
+
+	#ifdef RB_MIN
+	rbindex min;
+	#endif
+} rbitree;
+
+#define RBI_NIL 0
+#define RBI_ROOT 1
+
+#define RBI_NODE(rbt, i) (&(rbt)->nodes[(i)])
+#define RBI_DATA(rbt, i) ((rbt)->nodes[(i)].data)
+#define RBI_FIRST(rbt) ((rbt)->nodes[RBI_ROOT].left)
+#define RBI_MINIMAL(rbt) ((rbt)->min)
+
+#define RBI_ISEMPTY(rbt) (RBI_FIRST(rbt) == RBI_NIL)
+
+rbitree *rbi_create(int (*compare_func)(const void *, const void *), void (*destroy_func)(void *));
+void rbi_destroy(rbitree *rbt);
+
+rbindex rbi_find(rbitree *rbt, void *data);
+rbindex rbi_successor(rbitree *rbt, rbindex node);
+
+rbindex rbi_insert(rbitree *rbt, void *data);
+void *rbi_delete(rbitree *rbt, rbindex node, int keep);
+
+int rbi_check_order(rbitree *rbt, void *min, void *max);
+int rbi_check_black_height(rbitree *rbt);
+
+#endif /* _RB_INDEX_HEADER */
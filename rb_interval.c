@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2019 xieqing. https://github.com/xieqing
+ * May be freely redistributed, but copyright notice must be retained.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "rb_interval.h"
+
+static int compare(const void *n1, const void *n2);
+static int augment(rbnode *node);
+static int overlap(rbtree *rbt, rbnode *n, long start, long end, int (*func)(rbinterval *, void *), void *cookie);
+static int check_max(rbtree *rbt, rbnode *n);
+
+/*
+ * construction
+ * destroy_func receives the rbnode member of each interval, as for any intrusive tree
+ * return NULL if out of memory
+ */
+rbtree *rb_interval_create(void (*destroy_func)(void *))
+{
+	rbtree *rbt;
+
+	if ((rbt = rb_create_intrusive(compare, destroy_func)) == NULL)
+		return NULL; /* out of memory */
+
+	rbt->augment = augment;
+
+	return rbt;
+}
+
+/*
+ * insert interval, start must not be greater than end
+ * return the interval in the tree
+ */
+rbinterval *rb_interval_insert(rbtree *rbt, rbinterval *iv)
+{
+	iv->max = iv->end;
+
+	return RB_INTERVAL(rb_insert_node(rbt, &iv->node));
+}
+
+/*
+ * delete interval, the caller keeps its record
+ */
+void rb_interval_delete(rbtree *rbt, rbinterval *iv)
+{
+	rb_delete_node(rbt, &iv->node);
+}
+
+/*
+ * apply func to every interval overlapping [start, end], in order
+ * return non-zero if func does, stopping there
+ */
+int rb_interval_overlap(rbtree *rbt, long start, long end, int (*func)(rbinterval *, void *), void *cookie)
+{
+	return overlap(rbt, RB_FIRST(rbt), start, end, func, cookie);
+}
+
+/*
+ * apply func to every interval containing point, in order
+ * return non-zero if func does, stopping there
+ */
+int rb_interval_stab(rbtree *rbt, long point, int (*func)(rbinterval *, void *), void *cookie)
+{
+	return overlap(rbt, RB_FIRST(rbt), point, point, func, cookie);
+}
+
+/*
+ * subtrees whose largest end is before start are skipped, and so is everything after a start beyond end
+ * each subtree entered holds a match unless it lies on the boundary paths
+ */
+int overlap(rbtree *rbt, rbnode *n, long start, long end, int (*func)(rbinterval *, void *), void *cookie)
+{
+	rbinterval *iv;
+	int err;
+
+	while (n != RB_NIL(rbt) && RB_INTERVAL(n)->max >= start) {
+		iv = RB_INTERVAL(n);
+
+		if ((err = overlap(rbt, n->left, start, end, func, cookie)) != 0)
+			return err;
+
+		if (iv->start > end)
+			break; /* so does everything to the right */
+
+		if (iv->end >= start && (err = func(iv, cookie)) != 0)
+			return err;
+
+		n = n->right;
+	}
+
+	return 0;
+}
+
+int compare(const void *n1, const void *n2)
+{
+	rbinterval *p1, *p2;
+
+	p1 = RB_INTERVAL(n1);
+	p2 = RB_INTERVAL(n2);
+
+	if (p1->start != p2->start)
+		return p1->start > p2->start ? 1 : -1;
+	if (p1->end != p2->end)
+		return p1->end > p2->end ? 1 : -1;
+	return 0;
+}
+
+/*
+ * max is the largest of the node's own end and its children's max
+ */
+int augment(rbnode *node)
+{
+	rbinterval *iv;
+	long max;
+
+	iv = RB_INTERVAL(node);
+	max = iv->end;
+	if (node->left != &rb_nil && RB_INTERVAL(node->left)->max > max)
+		max = RB_INTERVAL(node->left)->max;
+	if (node->right != &rb_nil && RB_INTERVAL(node->right)->max > max)
+		max = RB_INTERVAL(node->right)->max;
+
+	if (iv->max == max)
+		return 0;
+	iv->max = max;
+	return 1;
+}
+
+/*
+ * check max of tree
+ */
+int rb_interval_check_max(rbtree *rbt)
+{
+	return check_max(rbt, RB_FIRST(rbt));
+}
+
+/*
+ * check max recursively
+ */
+int check_max(rbtree *rbt, rbnode *n)
+{
+	rbinterval *iv;
+	long max;
+
+	if (n == RB_NIL(rbt))
+		return 1;
+
+	if (!check_max(rbt, n->left) || !check_max(rbt, n->right))
+		return 0;
+
+	iv = RB_INTERVAL(n);
+	max = iv->end;
+	if (n->left != RB_NIL(rbt) && RB_INTERVAL(n->left)->max > max)
+		max = RB_INTERVAL(n->left)->max;
+	if (n->right != RB_NIL(rbt) && RB_INTERVAL(n->right)->max > max)
+		max = RB_INTERVAL(n->right)->max;
+
+	return iv->max == max;
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2019 xieqing. https://github.com/xieqing
+ * May be freely redistributed, but copyright notice must be retained.
+ */
+
+#ifndef _RB_INTERVAL_HEADER
+#define _RB_INTERVAL_HEADER
+
+#include "rb.h"
+
+/*
+ * interval tree on an intrusive red-black tree
+ * ordered by start then end, each node keeps the largest end in its subtree
+ * intervals are closed, embed rbinterval in the caller's records and recover them with RB_ENTRY
+ */
+
+typedef struct {
+	long start;
+	long end;
+	long max; /* largest end in the subtree, maintained by the tree */
+	rbnode node;
+} rbinterval;
+
+#define RB_INTERVAL(n) RB_ENTRY((n), rbinterval, node)
+
+rbtree *rb_interval_create(void (*destroy_func)(void *));
+
+rbinterval *rb_interval_insert(rbtree *rbt, rbinterval *iv);
+void rb_interval_delete(rbtree *rbt, rbinterval *iv);
+
+int rb_interval_overlap(rbtree *rbt, long start, long end, int (*func)(rbinterval *, void *), void *cookie);
+int rb_interval_stab(rbtree *rbt, long point, int (*func)(rbinterval *, void *), void *cookie);
+
+int rb_interval_check_max(rbtree *rbt);
+
+#endif /* _RB_INTERVAL_HEADER */
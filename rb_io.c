@@ -0,0 +1,343 @@
+/*
+ * Copyright (c) 2019 xieqing. https://github.com/xieqing
+ * May be freely redistributed, but copyright notice must be retained.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "rb_io.h"
+
+#ifndef RB_IO_BUFFER
+#define RB_IO_BUFFER 65536 /* bytes buffered between the tree and the file */
+#endif
+
+#define MAGIC "RBT"
+#define FNV_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
+/*
+ * buffered stream over a FILE, with a running checksum of the bytes passed
+ */
+typedef struct {
+	FILE *fp;
+	size_t pos; /* next byte in buf */
+	size_t len; /* bytes in buf, reading only */
+	uint32_t sum;
+	unsigned char buf[RB_IO_BUFFER];
+} rbstream;
+
+static rbstream *stream_open(FILE *fp);
+static int put(rbstream *s, const void *p, size_t n);
+static int put_varint(rbstream *s, uint64_t v);
+static int put_int(rbstream *s, uint64_t v, int bytes);
+static int flush(rbstream *s);
+static int get(rbstream *s, void *p, size_t n);
+static int get_varint(rbstream *s, uint64_t *v);
+static int get_int(rbstream *s, uint64_t *v, int bytes);
+static int get_payload(rbstream *s, void **payload, size_t *size, size_t len);
+static void *grow(void *p, size_t *size, size_t need, size_t unit);
+
+/*
+ * write the data of the tree in order
+ * return non-zero if error (out of memory or write failure), fp is left where the failure was
+ */
+int rb_save(rbtree *rbt, FILE *fp, rbencode encode, void *cookie)
+{
+	rbstream *s;
+	rbcursor c;
+	rbnode *node;
+	void *payload, *p;
+	size_t size, len;
+	uint64_t count;
+	uint32_t sum;
+	int err;
+
+	size = 64;
+	if ((s = stream_open(fp)) == NULL || (payload = malloc(size)) == NULL) {
+		free(s);
+		return 1; /* out of memory */
+	}
+
+	err = put(s, MAGIC, 4) || put_int(s, RB_IO_VERSION, 4);
+
+	for (count = 0, node = rb_cursor_begin(&c, rbt); !err && node != NULL; count++, node = rb_cursor_next(&c)) {
+		while (!err && (len = encode(node->data, payload, size, cookie)) > size) {
+			if ((p = grow(payload, &size, len, 1)) == NULL)
+				err = 1; /* out of memory */
+			else
+				payload = p;
+		}
+		err = err || put_varint(s, (uint64_t) len + 1) || put(s, payload, len);
+	}
+
+	if (!err) {
+		err = put_varint(s, 0) || put_int(s, count, 8);
+		sum = s->sum;
+		err = err || put_int(s, sum, 4) || flush(s);
+	}
+
+	free(payload);
+	free(s);
+
+	return err;
+}
+
+/*
+ * read data saved by rb_save into an empty tree, building it in linear time
+ * each record is decoded as it is read, before the checksum in the trailer is verified
+ * data decoded before an error is destroyed with the tree's destroy function
+ * fp is left just past the trailer, unless it cannot seek back over what was read ahead, then the rest is consumed
+ * return non-zero if error (tree not empty, bad version, corrupt or truncated file, data out of order or out of memory)
+ */
+int rb_load(rbtree *rbt, FILE *fp, rbdecode decode, void *cookie)
+{
+	rbstream *s;
+	unsigned char magic[4];
+	void *payload, **data, *d, *p;
+	size_t size, n, max;
+	uint64_t version, len, count, stored;
+	uint32_t sum;
+	int err;
+
+	if (!RB_ISEMPTY(rbt))
+		return 1;
+
+	size = 64;
+	max = 1024;
+	n = 0;
+	s = stream_open(fp);
+	payload = malloc(size);
+	data = (void **) malloc(max * sizeof(void *));
+	err = s == NULL || payload == NULL || data == NULL; /* out of memory */
+
+	err = err || get(s, magic, 4) || memcmp(magic, MAGIC, 4) != 0 || get_int(s, &version, 4) || version != RB_IO_VERSION;
+
+	while (!err && !(err = get_varint(s, &len)) && len-- > 0) {
+		if (len > SIZE_MAX / 2) {
+			err = 1; /* corrupt length */
+			break;
+		}
+		if (n == max) {
+			if ((p = grow(data, &max, n + 1, sizeof(void *))) == NULL) {
+				err = 1; /* out of memory */
+				break;
+			}
+			data = (void **) p;
+		}
+		if (get_payload(s, &payload, &size, (size_t) len) != 0 || (d = decode(payload, (size_t) len, cookie)) == NULL) {
+			err = 1; /* truncated, invalid payload or out of memory */
+			break;
+		}
+		data[n++] = d;
+	}
+
+	/* the checksum covers the count, not itself */
+	if (!err)
+		err = get_int(s, &count, 8) || count != n;
+	if (!err) {
+		sum = s->sum;
+		err = get_int(s, &stored, 4) || stored != sum;
+	}
+
+	/* give back what was read ahead, for whatever follows in fp */
+	if (!err && s->pos < s->len)
+		fseek(fp, -(long) (s->len - s->pos), SEEK_CUR);
+
+	err = err || rb_build_sorted(rbt, data, n);
+
+	if (err && data != NULL && rbt->destroy != NULL) {
+		while (n > 0)
+			rbt->destroy(data[--n]);
+	}
+
+	free(data);
+	free(payload);
+	free(s);
+
+	return err;
+}
+
+/*
+ * return NULL if out of memory
+ */
+rbstream *stream_open(FILE *fp)
+{
+	rbstream *s;
+
+	if ((s = (rbstream *) malloc(sizeof(rbstream))) == NULL)
+		return NULL; /* out of memory */
+
+	s->fp = fp;
+	s->pos = 0;
+	s->len = 0;
+	s->sum = FNV_BASIS;
+
+	return s;
+}
+
+/*
+ * return non-zero if write failure
+ */
+int put(rbstream *s, const void *p, size_t n)
+{
+	const unsigned char *b = (const unsigned char *) p;
+	size_t i, k;
+
+	while (n > 0) {
+		if (s->pos == RB_IO_BUFFER && flush(s) != 0)
+			return 1;
+
+		k = n < RB_IO_BUFFER - s->pos ? n : RB_IO_BUFFER - s->pos;
+		for (i = 0; i < k; i++)
+			s->sum = (s->sum ^ b[i]) * FNV_PRIME;
+		memcpy(s->buf + s->pos, b, k);
+		s->pos += k;
+		b += k;
+		n -= k;
+	}
+
+	return 0;
+}
+
+/*
+ * 7 bits a byte, low bits first, the high bit set on all but the last byte
+ */
+int put_varint(rbstream *s, uint64_t v)
+{
+	unsigned char b[10];
+	int n;
+
+	for (n = 0; v >= 128; v >>= 7)
+		b[n++] = (unsigned char) (v | 128);
+	b[n++] = (unsigned char) v;
+
+	return put(s, b, n);
+}
+
+int put_int(rbstream *s, uint64_t v, int bytes)
+{
+	unsigned char b[8];
+	int i;
+
+	for (i = 0; i < bytes; i++, v >>= 8)
+		b[i] = (unsigned char) v;
+
+	return put(s, b, bytes);
+}
+
+/*
+ * return non-zero if write failure
+ */
+int flush(rbstream *s)
+{
+	if (s->pos > 0 && fwrite(s->buf, 1, s->pos, s->fp) != s->pos)
+		return 1;
+	s->pos = 0;
+
+	return fflush(s->fp) != 0;
+}
+
+/*
+ * return non-zero if the stream ends first or read failure
+ */
+int get(rbstream *s, void *p, size_t n)
+{
+	unsigned char *b = (unsigned char *) p;
+	size_t i, k;
+
+	while (n > 0) {
+		if (s->pos == s->len) {
+			if ((s->len = fread(s->buf, 1, RB_IO_BUFFER, s->fp)) == 0)
+				return 1; /* truncated */
+			s->pos = 0;
+		}
+
+		k = n < s->len - s->pos ? n : s->len - s->pos;
+		memcpy(b, s->buf + s->pos, k);
+		for (i = 0; i < k; i++)
+			s->sum = (s->sum ^ b[i]) * FNV_PRIME;
+		s->pos += k;
+		b += k;
+		n -= k;
+	}
+
+	return 0;
+}
+
+int get_varint(rbstream *s, uint64_t *v)
+{
+	unsigned char b;
+	int shift;
+
+	for (*v = 0, shift = 0; shift < 64; shift += 7) {
+		if (s->pos < s->len) {
+			/* most bytes are already buffered */
+			b = s->buf[s->pos++];
+			s->sum = (s->sum ^ b) * FNV_PRIME;
+		} else if (get(s, &b, 1) != 0) {
+			return 1;
+		}
+		*v |= (uint64_t) (b & 127) << shift;
+		if (b < 128)
+			return 0;
+	}
+
+	return 1; /* too long */
+}
+
+int get_int(rbstream *s, uint64_t *v, int bytes)
+{
+	unsigned char b[8];
+	int i;
+
+	if (get(s, b, bytes) != 0)
+		return 1;
+
+	for (*v = 0, i = bytes; i > 0; i--)
+		*v = *v << 8 | b[i - 1];
+
+	return 0;
+}
+
+/*
+ * read a payload of len bytes into *payload, grown as its bytes arrive
+ * so a corrupt length cannot allocate much more than what is left in the stream
+ * return non-zero if the stream ends first, read failure or out of memory
+ */
+int get_payload(rbstream *s, void **payload, size_t *size, size_t len)
+{
+	size_t got, k;
+	void *p;
+
+	for (got = 0; got < len; got += k) {
+		if (got == *size) {
+			if ((p = grow(*payload, size, got + 1, 1)) == NULL)
+				return 1; /* out of memory */
+			*payload = p;
+		}
+		k = len - got < *size - got ? len - got : *size - got;
+		if (get(s, (unsigned char *) *payload + got, k) != 0)
+			return 1; /* truncated */
+	}
+
+	return 0;
+}
+
+/*
+ * double an array of *size units until it holds need
+ * return the array moved, NULL if out of memory and p is left as it was
+ */
+void *grow(void *p, size_t *size, size_t need, size_t unit)
+{
+	size_t n;
+
+	for (n = *size; n < need; n *= 2) ;
+
+	if ((p = realloc(p, n * unit)) == NULL)
+		return NULL; /* out of memory */
+
+	*size = n;
+	return p;
+}
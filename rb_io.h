@@ -0,0 +1,36 @@
+/*
+ * Copyright (c) 2019 xieqing. https://github.com/xieqing
+ * May be freely redistributed, but copyright notice must be retained.
+ */
+
+#ifndef _RB_IO_HEADER
+#define _RB_IO_HEADER
+
+#include <stdio.h>
+#include "rb.h"
+
+/*
+ * binary save and load of a tree's data through caller-supplied payload codecs
+ * the file is the data in order, so loading builds the tree in linear time without a single comparison-driven insert
+ *
+ * format, integers little-endian:
+ *   header   "RBT" 0, version (4 bytes)
+ *   records  payload length + 1 (varint), payload, a 0 length ends them
+ *   trailer  record count (8 bytes), FNV-1a checksum of everything before it (4 bytes)
+ */
+
+#define RB_IO_VERSION 1
+
+/*
+ * encode data into buf of size bytes, return the payload length, which may be more than size to ask for a larger buf
+ * decode a payload of size bytes, return new data or NULL if it is invalid
+ * rb_load decodes each record before the file's checksum is verified, so a corrupt or truncated file
+ * reaches decode with arbitrary bytes, decode must check size and content and never trust the payload
+ */
+typedef size_t (*rbencode)(const void *data, void *buf, size_t size, void *cookie);
+typedef void *(*rbdecode)(const void *buf, size_t size, void *cookie);
+
+int rb_save(rbtree *rbt, FILE *fp, rbencode encode, void *cookie);
+int rb_load(rbtree *rbt, FILE *fp, rbdecode decode, void *cookie);
+
+#endif /* _RB_IO_HEADER */
@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) 2019 xieqing. https://github.com/xieqing
+ * May be freely redistributed, but copyright notice must be retained.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "rb_mmap.h"
+
+#define MAGIC "RBM"
+#define ORDER 0x01020304u /* reads back differently on a machine of the other byte order */
+
+typedef struct {
+	char magic[4];
+	uint32_t version;
+	uint32_t order;
+	uint32_t reserved;
+	uint64_t count;
+	uint64_t root;
+	uint64_t nodes;
+	uint64_t length; /* of the whole file */
+} rbmheader;
+
+/* where the payload of the i-th node in order went */
+struct span {
+	uint64_t offset;
+	uint32_t size;
+};
+
+/* nodes lo .. lo + n - 1 in order, a subtree waiting for its place in the file */
+struct range {
+	size_t lo;
+	size_t n;
+	int depth;
+};
+
+static const rbmnode *node_at(rbmtree *t, uint64_t off);
+static int check(rbmtree *t, uint64_t off, size_t depth, uint64_t *count);
+
+/*
+ * write the tree to a file for rb_open_mapped, in the shape rb_build_sorted gives
+ * the file is written beside path as path.tmp and renamed over it, so a mapping of the old file stays valid
+ * return non-zero if error (cannot write path, payload over 4 GB or out of memory), path is untouched then
+ */
+int rb_save_mapped(rbtree *rbt, const char *path, rbencode encode, void *cookie)
+{
+	static const char zeros[8];
+	struct span *spans;
+	struct range *queue, r;
+	rbmheader h;
+	rbmnode m;
+	rbcursor c;
+	rbnode *node;
+	FILE *fp;
+	char *tmp;
+	void *payload, *p;
+	size_t size, len, n, i, head, tail, left;
+	uint64_t off;
+	int red_depth, err;
+
+	for (n = 0, node = rb_cursor_begin(&c, rbt); node != NULL; node = rb_cursor_next(&c))
+		n++;
+
+	if ((tmp = (char *) malloc(strlen(path) + 5)) == NULL)
+		return 1; /* out of memory */
+	sprintf(tmp, "%s.tmp", path);
+
+	if ((fp = fopen(tmp, "wb")) == NULL) {
+		free(tmp);
+		return 1;
+	}
+
+	size = 64;
+	spans = (struct span *) malloc((n + 1) * sizeof(struct span));
+	queue = (struct range *) malloc((n + 1) * sizeof(struct range));
+	payload = malloc(size);
+	err = spans == NULL || queue == NULL || payload == NULL; /* out of memory */
+
+	/* the header goes last, once the offsets are known */
+	memset(&h, 0, sizeof(h));
+	err = err || fwrite(&h, sizeof(h), 1, fp) != 1;
+	off = sizeof(h);
+
+	for (i = 0, node = rb_cursor_begin(&c, rbt); !err && node != NULL; i++, node = rb_cursor_next(&c)) {
+		while (!err && (len = encode(node->data, payload, size, cookie)) > size) {
+			for (size *= 2; size < len; size *= 2) ;
+			if ((p = realloc(payload, size)) == NULL)
+				err = 1; /* out of memory */
+			else
+				payload = p;
+		}
+		if (err || len > UINT32_MAX || fwrite(payload, 1, len, fp) != len) {
+			err = 1;
+			break;
+		}
+
+		spans[i].offset = off;
+		spans[i].size = (uint32_t) len;
+		off += len;
+		if (off % 8 != 0) {
+			err = fwrite(zeros, 1, 8 - off % 8, fp) != 8 - off % 8;
+			off += 8 - off % 8;
+		}
+	}
+
+	/* a subtree's children are the next two ranges queued, so their offsets are known when it is written */
+	for (red_depth = 0; ((size_t) 2 << red_depth) <= n + 1; red_depth++) ;
+
+	h.nodes = off;
+	head = tail = 0;
+	if (n > 0) {
+		queue[tail].lo = 0;
+		queue[tail].n = n;
+		queue[tail++].depth = 0;
+	}
+
+	while (!err && head < tail) {
+		r = queue[head++];
+		left = (r.n - 1) / 2;
+
+		m.left = m.right = 0;
+		if (left > 0) {
+			m.left = h.nodes + tail * sizeof(rbmnode);
+			queue[tail].lo = r.lo;
+			queue[tail].n = left;
+			queue[tail++].depth = r.depth + 1;
+		}
+		if (r.n - 1 - left > 0) {
+			m.right = h.nodes + tail * sizeof(rbmnode);
+			queue[tail].lo = r.lo + left + 1;
+			queue[tail].n = r.n - 1 - left;
+			queue[tail++].depth = r.depth + 1;
+		}
+		m.payload = spans[r.lo + left].offset;
+		m.size = spans[r.lo + left].size;
+		m.color = r.depth == red_depth ? RED : BLACK;
+
+		err = fwrite(&m, sizeof(m), 1, fp) != 1;
+	}
+
+	memcpy(h.magic, MAGIC, 4);
+	h.version = RB_MMAP_VERSION;
+	h.order = ORDER;
+	h.count = n;
+	h.root = n > 0 ? h.nodes : 0;
+	h.length = h.nodes + n * sizeof(rbmnode);
+	err = err || fseek(fp, 0, SEEK_SET) != 0 || fwrite(&h, sizeof(h), 1, fp) != 1;
+	err = err || fflush(fp) != 0 || fsync(fileno(fp)) != 0;
+	err = fclose(fp) != 0 || err;
+	err = err || rename(tmp, path) != 0;
+
+	if (err)
+		remove(tmp);
+
+	free(tmp);
+	free(payload);
+	free(queue);
+	free(spans);
+
+	return err;
+}
+
+/*
+ * map a file written by rb_save_mapped, only the header is read
+ * return NULL if error (cannot map path, not such a file, another version or byte order, or out of memory)
+ */
+rbmtree *rb_open_mapped(const char *path, int (*compare)(const void *, const void *, size_t))
+{
+	rbmtree *t;
+	rbmheader h;
+	struct stat st;
+	void *base;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) < 0)
+		return NULL;
+
+	if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(h) || \
+		(base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		close(fd);
+		return NULL;
+	}
+	close(fd); /* the mapping stays */
+
+	memcpy(&h, base, sizeof(h));
+	if (memcmp(h.magic, MAGIC, 4) != 0 || h.version != RB_MMAP_VERSION || h.order != ORDER || \
+		h.length != (uint64_t) st.st_size || h.nodes < sizeof(h) || h.nodes % 8 != 0 || h.nodes > h.length || \
+		(h.length - h.nodes) % sizeof(rbmnode) != 0 || (h.length - h.nodes) / sizeof(rbmnode) != h.count || \
+		h.root != (h.count > 0 ? h.nodes : 0) || (t = (rbmtree *) malloc(sizeof(rbmtree))) == NULL) {
+		munmap(base, st.st_size);
+		return NULL;
+	}
+
+	t->compare = compare;
+	t->base = (const unsigned char *) base;
+	t->length = st.st_size;
+	t->count = h.count;
+	t->root = h.root;
+	t->nodes = h.nodes;
+
+	return t;
+}
+
+void rb_close_mapped(rbmtree *t)
+{
+	munmap((void *) t->base, t->length);
+	free(t);
+}
+
+/*
+ * look up in place
+ * return the payload found and its size, NULL if not found or the file is corrupt
+ */
+const void *rb_find_mapped(rbmtree *t, const void *data, size_t *size)
+{
+	const rbmnode *n;
+	uint64_t off;
+	size_t depth;
+	int cmp;
+
+	for (off = t->root, depth = 0; off != 0 && depth < RB_CURSOR_DEPTH; depth++) {
+		if ((n = node_at(t, off)) == NULL)
+			return NULL; /* corrupt */
+
+		if ((cmp = t->compare(data, t->base + n->payload, n->size)) == 0) {
+			if (size != NULL)
+				*size = n->size;
+			return t->base + n->payload; /* found */
+		}
+
+		off = cmp < 0 ? n->left : n->right;
+	}
+
+	return NULL; /* not found */
+}
+
+/*
+ * apply func to all payloads in order
+ * a link back up the tree would revisit nodes without end, so more nodes than the count is corrupt too
+ * return non-zero if func does, stopping there, -1 if the file is corrupt
+ */
+int rb_apply_mapped(rbmtree *t, int (*func)(const void *, size_t, void *), void *cookie)
+{
+	const rbmnode *stack[RB_CURSOR_DEPTH], *n;
+	uint64_t off, count;
+	size_t depth;
+	int err;
+
+	for (off = t->root, depth = 0, count = 0; ; off = n->right) {
+		/* down the left, stacking the nodes passed */
+		for (; off != 0; off = n->left) {
+			if (depth == RB_CURSOR_DEPTH || ++count > t->count || (n = node_at(t, off)) == NULL)
+				return -1; /* corrupt */
+			stack[depth++] = n;
+		}
+
+		if (depth == 0)
+			return 0;
+
+		n = stack[--depth];
+		if ((err = func(t->base + n->payload, n->size, cookie)) != 0)
+			return err;
+	}
+}
+
+/*
+ * node at off with its payload within the file
+ * return NULL if not
+ */
+const rbmnode *node_at(rbmtree *t, uint64_t off)
+{
+	const rbmnode *n;
+
+	if (off < t->nodes || off >= t->length || (off - t->nodes) % sizeof(rbmnode) != 0)
+		return NULL;
+
+	n = (const rbmnode *) (t->base + off);
+	if (n->payload < sizeof(rbmheader) || n->payload > t->nodes || n->size > t->nodes - n->payload)
+		return NULL;
+
+	return n;
+}
+
+/*
+ * check links, colors, black heights and count, the order is the writer's
+ * return 1 if valid
+ */
+int rb_check_mapped(rbmtree *t)
+{
+	const rbmnode *root;
+	uint64_t count;
+
+	if (t->root != 0 && ((root = node_at(t, t->root)) == NULL || root->color != BLACK))
+		return 0;
+
+	count = 0;
+	return check(t, t->root, 0, &count) > 0 && count == t->count;
+}
+
+/*
+ * check recursively
+ * return the black height of the subtree at off, 0 if invalid
+ */
+int check(rbmtree *t, uint64_t off, size_t depth, uint64_t *count)
+{
+	const rbmnode *n, *l, *r;
+	int lh, rh;
+
+	if (off == 0)
+		return 1;
+
+	if (depth == RB_CURSOR_DEPTH || (n = node_at(t, off)) == NULL || ++*count > t->count)
+		return 0;
+
+	l = n->left != 0 ? node_at(t, n->left) : NULL;
+	r = n->right != 0 ? node_at(t, n->right) : NULL;
+	if ((n->color != RED && n->color != BLACK) || (n->color == RED && ((l != NULL && l->color == RED) || (r != NULL && r->color == RED))))
+		return 0;
+
+	if ((lh = check(t, n->left, depth + 1, count)) == 0 || (rh = check(t, n->right, depth + 1, count)) == 0 || lh != rh)
+		return 0;
+
+	return lh + (n->color == BLACK);
+}
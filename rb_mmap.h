@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2019 xieqing. https://github.com/xieqing
+ * May be freely redistributed, but copyright notice must be retained.
+ */
+
+#ifndef _RB_MMAP_HEADER
+#define _RB_MMAP_HEADER
+
+#include <stdint.h>
+#include "rb.h"
+#include "rb_io.h"
+
+/*
+ * read-only tree in a memory-mapped file
+ * links are byte offsets from the start of the file, so the file maps anywhere and is searched in place
+ * opening reads only the header, pages come in from the page cache on demand and are shared between processes
+ *
+ * layout, in the byte order of the machine that wrote it:
+ *   header    magic, version, byte order mark, node count, root, node region and file length
+ *   payloads  encoded data in order, each 8-byte aligned so that it may be used in place
+ *   nodes     rbmnode in breadth-first order, so that the top levels share the first pages
+ */
+
+#define RB_MMAP_VERSION 1
+
+typedef struct {
+	uint64_t left; /* offset of the node, 0 if none */
+	uint64_t right;
+	uint64_t payload; /* offset of the payload */
+	uint32_t size; /* payload bytes */
+	uint32_t color;
+} rbmnode;
+
+typedef struct {
+	int (*compare)(const void *data, const void *payload, size_t size); /* data against a payload */
+	const unsigned char *base;
+	size_t length;
+	uint64_t count;
+	uint64_t root; /* offset of the root, 0 if empty */
+	uint64_t nodes; /* offset of the first node */
+} rbmtree;
+
+int rb_save_mapped(rbtree *rbt, const char *path, rbencode encode, void *cookie);
+
+rbmtree *rb_open_mapped(const char *path, int (*compare_func)(const void *, const void *, size_t));
+void rb_close_mapped(rbmtree *t);
+
+const void *rb_find_mapped(rbmtree *t, const void *data, size_t *size);
+int rb_apply_mapped(rbmtree *t, int (*func)(const void *, size_t, void *), void *cookie);
+
+int rb_check_mapped(rbmtree *t);
+
+#endif /* _RB_MMAP_HEADER */
@@ -0,0 +1,576 @@
+/*
+ * Copyright (c) 2019 xieqing. https://github.com/xieqing
+ * May be freely redistributed, but copyright notice must be retained.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "rb_persist.h"
+
+/* versions in other threads may share the node, so references are counted atomically */
+#define REF(n) ((n) != NULL ? (void) __atomic_add_fetch(&(n)->refs, 1, __ATOMIC_RELAXED) : (void) 0)
+
+static int reserve(rbptree *t, size_t n);
+static rbpnode *alloc(rbptree *t);
+static rbpnode *own(rbptree *t, rbpnode **link);
+static rbpnode *replace(rbptree *t, rbpnode **link, void *data, rbpnode *owner);
+static void unref(rbptree *t, rbpnode *node);
+static void drop(rbptree *t, rbpnode *node);
+static rbpnode **link_of(rbptree *t, rbpnode **path, char *dirs, int i);
+static void rotate_left(rbpnode **link);
+static void rotate_right(rbpnode **link);
+static void insert_repair(rbptree *t, rbpnode **path, char *dirs, int i);
+static void delete_repair(rbptree *t, rbpnode **path, char *dirs, int i);
+static int apply(rbpnode *node, int (*func)(void *, void *), void *cookie);
+static int check(rbptree *t, rbpnode *node, void **prev, size_t *count);
+
+/*
+ * construction
+ * return NULL if out of memory
+ */
+rbptree *rbp_create(int (*compare)(const void *, const void *), void (*destroy)(void *))
+{
+	rbptree *t;
+
+	if ((t = (rbptree *) malloc(sizeof(rbptree))) == NULL)
+		return NULL; /* out of memory */
+
+	t->compare = compare;
+	t->destroy = destroy;
+	t->root = NULL;
+	t->count = 0;
+	t->spare = NULL;
+	t->spares = 0;
+
+	return t;
+}
+
+/*
+ * new version sharing every node with t, O(1)
+ * either may change afterwards without the other seeing it
+ * return NULL if out of memory
+ */
+rbptree *rbp_snapshot(rbptree *t)
+{
+	rbptree *snap;
+
+	if ((snap = rbp_create(t->compare, t->destroy)) == NULL)
+		return NULL; /* out of memory */
+
+	snap->root = t->root;
+	REF(snap->root);
+	snap->count = t->count;
+
+	return snap;
+}
+
+/*
+ * release version t, freeing the nodes and data no other version has
+ */
+void rbp_release(rbptree *t)
+{
+	rbpnode *node;
+
+	unref(t, t->root);
+
+	while ((node = t->spare) != NULL) {
+		t->spare = node->left;
+		free(node);
+	}
+
+	free(t);
+}
+
+/*
+ * look up
+ * return the data found, NULL if not found
+ */
+void *rbp_find(rbptree *t, void *data)
+{
+	rbpnode *p;
+	int cmp;
+
+	for (p = t->root; p != NULL; p = cmp < 0 ? p->left : p->right) {
+		if ((cmp = t->compare(data, p->data)) == 0)
+			return p->data; /* found */
+	}
+
+	return NULL; /* not found */
+}
+
+/*
+ * insert (or update) data
+ * the path to its place is copied where shared, other versions are untouched
+ * return non-zero if out of memory, t is unchanged then
+ */
+int rbp_insert(rbptree *t, void *data)
+{
+	rbpnode *path[RB_CURSOR_DEPTH], **link, *node;
+	char dirs[RB_CURSOR_DEPTH];
+	int i, d, cmp;
+
+	/* find the place first, the path is copied on the way back down */
+	for (d = 0, node = t->root; node != NULL; d++) {
+		cmp = t->compare(data, node->data);
+		#ifndef RB_DUP
+		if (cmp == 0)
+			break; /* update */
+		#endif
+		dirs[d] = cmp >= 0; /* an equal key goes right */
+		node = dirs[d] ? node->right : node->left;
+	}
+
+	/* the path, the new node and one uncle for every two levels of repair */
+	if (reserve(t, d + d / 2 + 3) != 0)
+		return 1; /* out of memory */
+
+	for (i = 0, link = &t->root; i < d; i++) {
+		path[i] = own(t, link);
+		link = dirs[i] ? &path[i]->right : &path[i]->left;
+	}
+
+	#ifndef RB_DUP
+	if (node != NULL) {
+		/* versions sharing the old node keep its data */
+		replace(t, link, data, NULL);
+		return 0;
+	}
+	#endif
+
+	node = alloc(t);
+	node->left = node->right = NULL;
+	node->data = data;
+	node->owner = node;
+	node->refs = 1;
+	node->copies = 1;
+	node->color = RED;
+
+	*link = path[d] = node;
+	t->count++;
+
+	insert_repair(t, path, dirs, d);
+	t->root->color = BLACK; /* the root is on the path, thus private */
+
+	return 0;
+}
+
+/*
+ * delete a node with the key of data
+ * its data is destroyed once no version has it
+ * return non-zero if not found or out of memory, t is unchanged then
+ */
+int rbp_delete(rbptree *t, void *data)
+{
+	rbpnode *path[RB_CURSOR_DEPTH], **link, *node, *child;
+	char dirs[RB_CURSOR_DEPTH];
+	int i, d, z, cmp;
+
+	for (d = 0, node = t->root; node != NULL && (cmp = t->compare(data, node->data)) != 0; d++) {
+		dirs[d] = cmp > 0;
+		node = dirs[d] ? node->right : node->left;
+	}
+
+	if (node == NULL)
+		return 1; /* not found */
+
+	/* with two children, the successor's data takes node's place and the successor goes instead */
+	z = d;
+	if (node->left != NULL && node->right != NULL) {
+		dirs[d++] = 1;
+		for (node = node->right; node->left != NULL; node = node->left)
+			dirs[d++] = 0;
+	}
+
+	/* the path, the replacement and at most four nodes for every level of repair */
+	if (reserve(t, 5 * d + 8) != 0)
+		return 1; /* out of memory */
+
+	for (i = 0, link = &t->root; ; i++) {
+		path[i] = own(t, link);
+		if (i == d)
+			break;
+		link = dirs[i] ? &path[i]->right : &path[i]->left;
+	}
+
+	if (z < d)
+		path[z] = replace(t, link_of(t, path, dirs, z), path[d]->data, path[d]->owner);
+
+	node = path[d];
+	link = link_of(t, path, dirs, d);
+	child = node->left != NULL ? node->left : node->right;
+
+	/* child moves up, node goes */
+	*link = child;
+	node->left = node->right = NULL;
+	t->count--;
+
+	if (node->color == BLACK) {
+		if (child != NULL && child->color == RED)
+			own(t, link)->color = BLACK;
+		else if (d > 0)
+			delete_repair(t, path, dirs, d - 1);
+	}
+
+	unref(t, node);
+
+	if (t->root != NULL && t->root->color == RED)
+		own(t, &t->root)->color = BLACK;
+
+	return 0;
+}
+
+/*
+ * apply func to all data in order
+ * return non-zero if func does, stopping there
+ */
+int rbp_apply(rbptree *t, int (*func)(void *, void *), void *cookie)
+{
+	return apply(t->root, func, cookie);
+}
+
+int apply(rbpnode *node, int (*func)(void *, void *), void *cookie)
+{
+	int err;
+
+	if (node == NULL)
+		return 0;
+
+	if ((err = apply(node->left, func, cookie)) != 0 || (err = func(node->data, cookie)) != 0)
+		return err;
+
+	return apply(node->right, func, cookie);
+}
+
+/*
+ * set aside n nodes for the update to come
+ * return non-zero if out of memory
+ */
+int reserve(rbptree *t, size_t n)
+{
+	rbpnode *node;
+
+	while (t->spares < n) {
+		if ((node = (rbpnode *) malloc(sizeof(rbpnode))) == NULL)
+			return 1; /* out of memory */
+		node->left = t->spare;
+		t->spare = node;
+		t->spares++;
+	}
+
+	return 0;
+}
+
+/*
+ * take a node set aside by reserve
+ */
+rbpnode *alloc(rbptree *t)
+{
+	rbpnode *node;
+
+	node = t->spare;
+	t->spare = node->left;
+	t->spares--;
+
+	return node;
+}
+
+/*
+ * make the node at link private to t, copying it if another parent or version shares it
+ * the node holding link must be private already
+ */
+rbpnode *own(rbptree *t, rbpnode **link)
+{
+	rbpnode *node, *copy;
+
+	node = *link;
+	if (__atomic_load_n(&node->refs, __ATOMIC_ACQUIRE) == 1)
+		return node; /* only this version's parent points here */
+
+	copy = alloc(t);
+	copy->left = node->left;
+	copy->right = node->right;
+	copy->data = node->data;
+	copy->owner = node->owner;
+	copy->refs = 1;
+	copy->copies = 0;
+	copy->color = node->color;
+
+	REF(copy->left);
+	REF(copy->right);
+	__atomic_add_fetch(&copy->owner->copies, 1, __ATOMIC_RELAXED);
+
+	*link = copy;
+	unref(t, node);
+
+	return copy;
+}
+
+/*
+ * put a new node with data in place of the node at link, which is released
+ * owner counts the copies of data, NULL for new data
+ */
+rbpnode *replace(rbptree *t, rbpnode **link, void *data, rbpnode *owner)
+{
+	rbpnode *old, *node;
+
+	old = *link;
+	node = alloc(t);
+
+	/* the children are shared with old, other versions may still have it */
+	node->left = old->left;
+	node->right = old->right;
+	node->color = old->color;
+	REF(node->left);
+	REF(node->right);
+
+	node->data = data;
+	node->refs = 1;
+	if (owner == NULL) {
+		node->owner = node;
+		node->copies = 1;
+	} else {
+		node->owner = owner;
+		node->copies = 0;
+		__atomic_add_fetch(&owner->copies, 1, __ATOMIC_RELAXED);
+	}
+
+	*link = node;
+	unref(t, old);
+
+	return node;
+}
+
+/*
+ * drop a reference to node, freeing it and what only it refers to once none is left
+ */
+void unref(rbptree *t, rbpnode *node)
+{
+	if (node == NULL || __atomic_sub_fetch(&node->refs, 1, __ATOMIC_ACQ_REL) != 0)
+		return;
+
+	unref(t, node->left);
+	unref(t, node->right);
+	drop(t, node);
+}
+
+/*
+ * free a node in no version, and its data once it is the last copy
+ * the owner counts itself, so it is gone too once the count is zero
+ */
+void drop(rbptree *t, rbpnode *node)
+{
+	rbpnode *owner;
+
+	owner = node->owner;
+	if (node != owner)
+		free(node);
+
+	if (__atomic_sub_fetch(&owner->copies, 1, __ATOMIC_ACQ_REL) == 0) {
+		if (t->destroy != NULL)
+			t->destroy(owner->data);
+		free(owner);
+	}
+}
+
+/*
+ * link to path[i] in its parent
+ */
+rbpnode **link_of(rbptree *t, rbpnode **path, char *dirs, int i)
+{
+	if (i == 0)
+		return &t->root;
+
+	return dirs[i - 1] ? &path[i - 1]->right : &path[i - 1]->left;
+}
+
+/*
+ * rotate left about the node at link, it and its right child must be private
+ */
+void rotate_left(rbpnode **link)
+{
+	rbpnode *x, *y;
+
+	x = *link;
+	y = x->right;
+	x->right = y->left;
+	y->left = x;
+	*link = y;
+}
+
+/*
+ * rotate right about the node at link, it and its left child must be private
+ */
+void rotate_right(rbpnode **link)
+{
+	rbpnode *x, *y;
+
+	x = *link;
+	y = x->left;
+	x->left = y->right;
+	y->right = x;
+	*link = y;
+}
+
+/*
+ * rebalance after insertion of the RED node path[i]
+ * the path is private, an uncle is copied before it is recolored
+ */
+void insert_repair(rbptree *t, rbpnode **path, char *dirs, int i)
+{
+	rbpnode *parent, *grandparent, *uncle, **link;
+
+	while (i >= 2 && (parent = path[i - 1])->color == RED) {
+		grandparent = path[i - 2];
+		link = dirs[i - 2] ? &grandparent->left : &grandparent->right;
+
+		if ((uncle = *link) != NULL && uncle->color == RED) {
+			/* insertion into 4-children cluster, split */
+			uncle = own(t, link);
+			parent->color = BLACK;
+			uncle->color = BLACK;
+			grandparent->color = RED;
+			i -= 2; /* send grandparent node up the tree */
+		} else {
+			/* insertion into 3-children cluster, equivalent BST first */
+			if (dirs[i - 1] != dirs[i - 2]) {
+				if (dirs[i - 1])
+					rotate_left(&grandparent->left);
+				else
+					rotate_right(&grandparent->right);
+				parent = path[i];
+			}
+
+			parent->color = BLACK;
+			grandparent->color = RED;
+			if (dirs[i - 2])
+				rotate_left(link_of(t, path, dirs, i - 2));
+			else
+				rotate_right(link_of(t, path, dirs, i - 2));
+			break;
+		}
+	}
+}
+
+/*
+ * rebalance after deletion, the subtree on side dirs[i] of path[i] is one BLACK node short
+ * the path is private, siblings and nephews are copied before they change
+ */
+void delete_repair(rbptree *t, rbpnode **path, char *dirs, int i)
+{
+	rbpnode *parent, *sibling, *near, *far;
+	int dir;
+
+	for (;;) {
+		parent = path[i];
+		dir = dirs[i];
+		sibling = own(t, dir ? &parent->left : &parent->right); /* never NULL, it has a BLACK node more */
+
+		if (sibling->color == RED) {
+			/* 3-children parent cluster, turn it so that the sibling is BLACK */
+			sibling->color = BLACK;
+			parent->color = RED;
+			if (dir)
+				rotate_right(link_of(t, path, dirs, i));
+			else
+				rotate_left(link_of(t, path, dirs, i));
+
+			/* parent moves down below the old sibling */
+			path[i] = sibling;
+			dirs[i] = dir;
+			path[i + 1] = parent;
+			dirs[i + 1] = dir;
+			i++;
+			sibling = own(t, dir ? &parent->left : &parent->right);
+		}
+
+		near = dir ? sibling->right : sibling->left;
+		far = dir ? sibling->left : sibling->right;
+
+		if ((near == NULL || near->color == BLACK) && (far == NULL || far->color == BLACK)) {
+			/* 2-children sibling cluster, fuse by recoloring */
+			sibling->color = RED;
+			if (parent->color == RED) {
+				parent->color = BLACK;
+				return;
+			}
+			if (i == 0)
+				return; /* the whole tree is one BLACK node shorter */
+			i--;
+			continue;
+		}
+
+		/* 3/4-children sibling cluster */
+		if (far == NULL || far->color == BLACK) {
+			/* bring the RED near nephew above the sibling */
+			near = own(t, dir ? &sibling->right : &sibling->left);
+			near->color = BLACK;
+			sibling->color = RED;
+			if (dir)
+				rotate_left(&parent->left);
+			else
+				rotate_right(&parent->right);
+			sibling = near;
+		}
+
+		/* transfer by rotation and recoloring */
+		far = own(t, dir ? &sibling->left : &sibling->right);
+		sibling->color = parent->color;
+		parent->color = BLACK;
+		far->color = BLACK;
+		if (dir)
+			rotate_right(link_of(t, path, dirs, i));
+		else
+			rotate_left(link_of(t, path, dirs, i));
+		return;
+	}
+}
+
+/*
+ * check order, colors, black heights and count
+ * return 1 if valid
+ */
+int rbp_check(rbptree *t)
+{
+	size_t count;
+	void *prev;
+
+	if (t->root != NULL && t->root->color != BLACK)
+		return 0;
+
+	count = 0;
+	prev = NULL;
+
+	return check(t, t->root, &prev, &count) > 0 && count == t->count;
+}
+
+/*
+ * check recursively, prev is the data before node in order
+ * return the black height of node, 0 if invalid
+ */
+int check(rbptree *t, rbpnode *n, void **prev, size_t *count)
+{
+	int lh, rh;
+
+	if (n == NULL)
+		return 1;
+
+	if (n->refs == 0 || (n->color == RED && ((n->left != NULL && n->left->color == RED) || (n->right != NULL && n->right->color == RED))))
+		return 0;
+
+	if ((lh = check(t, n->left, prev, count)) == 0)
+		return 0;
+
+	#ifdef RB_DUP
+	if (*prev != NULL && t->compare(*prev, n->data) > 0)
+	#else
+	if (*prev != NULL && t->compare(*prev, n->data) >= 0)
+	#endif
+		return 0;
+	*prev = n->data;
+	(*count)++;
+
+	if ((rh = check(t, n->right, prev, count)) == 0 || lh != rh)
+		return 0;
+
+	return lh + (n->color == BLACK);
+}
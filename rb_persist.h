@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2019 xieqing. https://github.com/xieqing
+ * May be freely redistributed, but copyright notice must be retained.
+ */
+
+#ifndef _RB_PERSIST_HEADER
+#define _RB_PERSIST_HEADER
+
+#include <stddef.h>
+#include "rb.h"
+
+/*
+ * persistent red-black tree with copy-on-write snapshots
+ * a node is shared by every version that reaches it and copied before a version changes it,
+ * so an update copies the O(log n) nodes on its path and leaves the other versions intact
+ * nodes have no parent pointer, a shared node has many parents
+ * each version is used by one thread at a time, versions sharing nodes may be in different threads
+ */
+
+typedef struct rbpnode {
+	struct rbpnode *left; /* NULL if none */
+	struct rbpnode *right;
+	void *data;
+	struct rbpnode *owner; /* node counting the copies of data, may be itself */
+	unsigned int refs; /* parents and versions pointing here */
+	unsigned int copies; /* in the owner, nodes with data that are alive */
+	char color;
+} rbpnode;
+
+typedef struct {
+	int (*compare)(const void *, const void *);
+	void (*destroy)(void *); /* called once data is in no version */
+	rbpnode *root; /* NULL if empty */
+	size_t count;
+	rbpnode *spare; /* nodes set aside so that an update cannot run out of memory halfway */
+	size_t spares;
+} rbptree;
+
+rbptree *rbp_create(int (*compare_func)(const void *, const void *), void (*destroy_func)(void *));
+rbptree *rbp_snapshot(rbptree *t);
+void rbp_release(rbptree *t);
+
+void *rbp_find(rbptree *t, void *data);
+int rbp_insert(rbptree *t, void *data);
+int rbp_delete(rbptree *t, void *data);
+
+int rbp_apply(rbptree *t, int (*func)(void *, void *), void *cookie);
+int rbp_check(rbptree *t);
+
+#endif /* _RB_PERSIST_HEADER */
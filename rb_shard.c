@@ -0,0 +1,435 @@
+/*
+ * Copyright (c) 2019 xieqing. https://github.com/xieqing
+ * May be freely redistributed, but copyright notice must be retained.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "rb_shard.h"
+
+static rbshard *route(rbsharded *s, void *data);
+static rbnode *nth(rbtree *rbt, size_t k, size_t count);
+static int move(rbsharded *s, size_t i, size_t m, int right);
+static int drain(rbsharded *s, size_t i);
+
+/*
+ * construction of n shards split at n - 1 ascending bounds
+ * bounds are duplicated with copy_func and released with destroy_func, or used as they are if copy_func is NULL
+ * return NULL if out of memory, or if copy_func is given without destroy_func to release the copies
+ */
+rbsharded *rb_shard_create(int (*compare)(const void *, const void *), void (*destroy)(void *), void *(*copy)(const void *), void *bounds[], size_t n)
+{
+	rbsharded *s;
+
+	if (n == 0 || (copy != NULL && destroy == NULL))
+		return NULL;
+
+	if ((s = (rbsharded *) malloc(sizeof(rbsharded))) == NULL)
+		return NULL; /* out of memory */
+
+	if ((s->shards = (rbshard *) malloc(n * sizeof(rbshard))) == NULL) {
+		free(s);
+		return NULL; /* out of memory */
+	}
+
+	if (pthread_rwlock_init(&s->lock, NULL) != 0) {
+		free(s->shards);
+		free(s);
+		return NULL;
+	}
+
+	s->n = 0;
+	s->compare = compare;
+	s->copy = copy;
+	s->destroy = destroy;
+
+	for (; s->n < n; s->n++) {
+		rbshard *shard = &s->shards[s->n];
+
+		shard->count = 0;
+		shard->lo = NULL;
+		if ((shard->rbt = rb_create(compare, destroy)) == NULL)
+			break; /* out of memory */
+		if (s->n > 0 && (shard->lo = copy != NULL ? copy(bounds[s->n - 1]) : bounds[s->n - 1]) == NULL) {
+			rb_destroy(shard->rbt);
+			break; /* out of memory */
+		}
+		pthread_mutex_init(&shard->lock, NULL);
+	}
+
+	if (s->n < n) {
+		rb_shard_destroy(s);
+		return NULL;
+	}
+
+	return s;
+}
+
+/*
+ * destruction, no other thread may be using s
+ */
+void rb_shard_destroy(rbsharded *s)
+{
+	size_t i;
+
+	for (i = 0; i < s->n; i++) {
+		rb_destroy(s->shards[i].rbt);
+		if (s->copy != NULL && s->shards[i].lo != NULL)
+			s->destroy(s->shards[i].lo);
+		pthread_mutex_destroy(&s->shards[i].lock);
+	}
+
+	pthread_rwlock_destroy(&s->lock);
+	free(s->shards);
+	free(s);
+}
+
+/*
+ * the last shard whose lower bound is not after data
+ */
+rbshard *route(rbsharded *s, void *data)
+{
+	size_t lo, hi, mid;
+
+	for (lo = 0, hi = s->n - 1; lo < hi; ) {
+		mid = (lo + hi + 1) / 2;
+		if (s->compare(data, s->shards[mid].lo) >= 0)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	return &s->shards[lo];
+}
+
+/*
+ * look up
+ * return the data found, NULL if not found
+ */
+void *rb_shard_find(rbsharded *s, void *data)
+{
+	rbshard *shard;
+	rbnode *node;
+	void *found;
+
+	pthread_rwlock_rdlock(&s->lock);
+	shard = route(s, data);
+	pthread_mutex_lock(&shard->lock);
+
+	found = (node = rb_find(shard->rbt, data)) != NULL ? node->data : NULL;
+
+	pthread_mutex_unlock(&shard->lock);
+	pthread_rwlock_unlock(&s->lock);
+
+	return found;
+}
+
+/*
+ * insert (or update) data
+ * return non-zero if out of memory
+ */
+int rb_shard_insert(rbsharded *s, void *data)
+{
+	rbshard *shard;
+	int err;
+	#ifndef RB_DUP
+	rbnode *node;
+	#endif
+
+	pthread_rwlock_rdlock(&s->lock);
+	shard = route(s, data);
+	pthread_mutex_lock(&shard->lock);
+
+	#ifdef RB_DUP
+	if ((err = rb_insert(shard->rbt, data) == NULL) == 0)
+		shard->count++;
+	#else
+	/* only a new key counts, an equal one is updated through the node found */
+	if ((node = rb_find(shard->rbt, data)) != NULL)
+		err = rb_insert_hint(shard->rbt, node, data) == NULL;
+	else if ((err = rb_insert(shard->rbt, data) == NULL) == 0)
+		shard->count++;
+	#endif
+
+	pthread_mutex_unlock(&shard->lock);
+	pthread_rwlock_unlock(&s->lock);
+
+	return err;
+}
+
+/*
+ * delete a node with the key of data
+ * return its data, now the caller's, NULL if not found
+ */
+void *rb_shard_delete(rbsharded *s, void *data)
+{
+	rbshard *shard;
+	rbnode *node;
+	void *found;
+
+	pthread_rwlock_rdlock(&s->lock);
+	shard = route(s, data);
+	pthread_mutex_lock(&shard->lock);
+
+	found = NULL;
+	if ((node = rb_find(shard->rbt, data)) != NULL) {
+		found = rb_delete(shard->rbt, node, 1);
+		shard->count--;
+	}
+
+	pthread_mutex_unlock(&shard->lock);
+	pthread_rwlock_unlock(&s->lock);
+
+	return found;
+}
+
+/*
+ * smallest data, from the first shard that is not empty
+ * return NULL if empty
+ */
+void *rb_shard_min(rbsharded *s)
+{
+	rbcursor cursor;
+	rbnode *node;
+	void *found;
+	size_t i;
+
+	pthread_rwlock_rdlock(&s->lock);
+
+	for (i = 0, found = NULL; i < s->n && found == NULL; i++) {
+		pthread_mutex_lock(&s->shards[i].lock);
+		node = rb_cursor_begin(&cursor, s->shards[i].rbt);
+		found = node != NULL ? node->data : NULL; /* the node may go once the shard is unlocked */
+		pthread_mutex_unlock(&s->shards[i].lock);
+	}
+
+	pthread_rwlock_unlock(&s->lock);
+
+	return found;
+}
+
+/*
+ * largest data, from the last shard that is not empty
+ * return NULL if empty
+ */
+void *rb_shard_max(rbsharded *s)
+{
+	rbcursor cursor;
+	rbnode *node;
+	void *found;
+	size_t i;
+
+	pthread_rwlock_rdlock(&s->lock);
+
+	for (i = s->n, found = NULL; i > 0 && found == NULL; i--) {
+		pthread_mutex_lock(&s->shards[i - 1].lock);
+		node = rb_cursor_end(&cursor, s->shards[i - 1].rbt);
+		found = node != NULL ? node->data : NULL;
+		pthread_mutex_unlock(&s->shards[i - 1].lock);
+	}
+
+	pthread_rwlock_unlock(&s->lock);
+
+	return found;
+}
+
+/*
+ * apply func to all data in order, one shard locked at a time
+ * func must not modify s
+ * return non-zero if func does, stopping there
+ */
+int rb_shard_apply(rbsharded *s, int (*func)(void *, void *), void *cookie)
+{
+	size_t i;
+	int err;
+
+	pthread_rwlock_rdlock(&s->lock);
+
+	for (i = 0, err = 0; i < s->n && err == 0; i++) {
+		pthread_mutex_lock(&s->shards[i].lock);
+		err = RB_APPLY(s->shards[i].rbt, func, cookie, INORDER);
+		pthread_mutex_unlock(&s->shards[i].lock);
+	}
+
+	pthread_rwlock_unlock(&s->lock);
+
+	return err;
+}
+
+/*
+ * number of nodes in all shards
+ */
+size_t rb_shard_count(rbsharded *s)
+{
+	size_t i, count;
+
+	pthread_rwlock_rdlock(&s->lock);
+
+	for (i = 0, count = 0; i < s->n; i++) {
+		pthread_mutex_lock(&s->shards[i].lock);
+		count += s->shards[i].count;
+		pthread_mutex_unlock(&s->shards[i].lock);
+	}
+
+	pthread_rwlock_unlock(&s->lock);
+
+	return count;
+}
+
+/*
+ * move the bounds so that every shard holds about count / n nodes, equal keys stay in one shard
+ * a pass to the right moves the excess of each prefix up, a pass to the left the excess of each suffix down
+ * each move is a split and a concat, O(log n) with RB_RANK, plus a walk to the new bound without
+ * bounds must be duplicated with copy_func
+ * return non-zero if error (out of memory, no copy_func)
+ */
+int rb_shard_rebalance(rbsharded *s)
+{
+	size_t i, total, prefix, suffix, target;
+	int err;
+
+	if (s->copy == NULL)
+		return 1; /* the bounds are the caller's */
+
+	pthread_rwlock_wrlock(&s->lock);
+
+	for (i = 0, total = 0; i < s->n; i++)
+		total += s->shards[i].count;
+
+	err = 0;
+	for (i = 0, prefix = 0; i + 1 < s->n && err == 0; i++) {
+		/* prefix counts the nodes before shard i, target those up to it */
+		target = total * (i + 1) / s->n;
+		if (prefix + s->shards[i].count > target)
+			err = move(s, i, prefix + s->shards[i].count - target, 1);
+		prefix += s->shards[i].count;
+	}
+
+	for (i = s->n - 1, suffix = 0; i > 0 && err == 0; i--) {
+		/* suffix counts the nodes after shard i, target those from it on */
+		target = total - total * i / s->n;
+		if (suffix + s->shards[i].count > target)
+			err = move(s, i - 1, suffix + s->shards[i].count - target, 0);
+		suffix += s->shards[i].count;
+	}
+
+	pthread_rwlock_unlock(&s->lock);
+
+	return err;
+}
+
+/*
+ * k-th smallest of count nodes, counting from 0
+ */
+rbnode *nth(rbtree *rbt, size_t k, size_t count)
+{
+	#ifdef RB_RANK
+	(void) count;
+	return rb_select(rbt, k);
+	#else
+	rbcursor cursor;
+	rbnode *node;
+	size_t i;
+
+	/* walk from the nearer end */
+	if (k < count / 2) {
+		for (node = rb_cursor_begin(&cursor, rbt), i = 0; i < k; i++)
+			node = rb_cursor_next(&cursor);
+	} else {
+		for (node = rb_cursor_end(&cursor, rbt), i = count - 1; i > k; i--)
+			node = rb_cursor_prev(&cursor);
+	}
+
+	return node;
+	#endif
+}
+
+/*
+ * move the last m nodes of shard i up to shard i + 1 if right, otherwise the first m of shard i + 1 down to shard i
+ * equal keys all stay above the new bound, so the number moved may differ from m
+ * return non-zero if out of memory
+ */
+int move(rbsharded *s, size_t i, size_t m, int right)
+{
+	rbshard *from, *to;
+	rbnode *node, *prev;
+	rbtree *lo, *hi;
+	size_t k;
+	void *bound;
+
+	from = &s->shards[right ? i : i + 1];
+	to = &s->shards[right ? i + 1 : i];
+
+	if (m > from->count)
+		m = from->count;
+	if (m == 0)
+		return 0;
+
+	if (!right && m == from->count) {
+		if (i + 2 == s->n)
+			m--; /* no bound above the last shard, it keeps its largest keys */
+		else
+			return drain(s, i);
+	}
+
+	/* the first node above the new bound, k nodes before it */
+	k = right ? from->count - m : m;
+	node = nth(from->rbt, k, from->count);
+	while ((prev = rb_predecessor(from->rbt, node)) != NULL && s->compare(prev->data, node->data) == 0) {
+		node = prev;
+		k--;
+	}
+	if ((m = right ? from->count - k : k) == 0)
+		return 0; /* all equal keys */
+
+	if ((bound = s->copy(node->data)) == NULL)
+		return 1; /* out of memory */
+
+	if (rb_split(from->rbt, node->data, &lo, &hi) != 0) {
+		s->destroy(bound);
+		return 1; /* out of memory */
+	}
+
+	/* the pieces share compare and allocation and are in order, so concat cannot fail */
+	rb_destroy(from->rbt);
+	if (right) {
+		rb_concat(hi, to->rbt);
+		rb_destroy(to->rbt);
+		from->rbt = lo;
+		to->rbt = hi;
+	} else {
+		rb_concat(to->rbt, lo);
+		rb_destroy(lo);
+		from->rbt = hi;
+	}
+
+	from->count -= m;
+	to->count += m;
+
+	s->destroy(s->shards[i + 1].lo);
+	s->shards[i + 1].lo = bound;
+
+	return 0;
+}
+
+/*
+ * move all of shard i + 1 down to shard i, shard i + 1 is left empty below the bound of shard i + 2
+ * return non-zero if out of memory
+ */
+int drain(rbsharded *s, size_t i)
+{
+	void *bound;
+
+	if ((bound = s->copy(s->shards[i + 2].lo)) == NULL)
+		return 1; /* out of memory */
+
+	/* same compare and allocation and in order, so concat cannot fail */
+	rb_concat(s->shards[i].rbt, s->shards[i + 1].rbt);
+	s->shards[i].count += s->shards[i + 1].count;
+	s->shards[i + 1].count = 0;
+
+	s->destroy(s->shards[i + 1].lo);
+	s->shards[i + 1].lo = bound;
+
+	return 0;
+}
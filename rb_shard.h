@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2019 xieqing. https://github.com/xieqing
+ * May be freely redistributed, but copyright notice must be retained.
+ */
+
+#ifndef _RB_SHARD_HEADER
+#define _RB_SHARD_HEADER
+
+#include <pthread.h>
+#include "rb.h"
+
+/*
+ * key-range sharded tree, n red-black trees each with its own lock
+ * shard i holds the keys from its lower bound up to the next shard's, writers to different shards run in parallel
+ * bounds only move in rb_shard_rebalance, which locks out every other operation
+ */
+
+typedef struct {
+	rbtree *rbt;
+	void *lo; /* least key routed here, NULL for the first shard */
+	size_t count; /* nodes in rbt */
+	pthread_mutex_t lock;
+} rbshard;
+
+typedef struct {
+	size_t n;
+	rbshard *shards;
+	int (*compare)(const void *, const void *);
+	void *(*copy)(const void *); /* duplicate a key for a bound, NULL if bounds are the caller's */
+	void (*destroy)(void *);
+	pthread_rwlock_t lock; /* read by every operation, written to move bounds */
+} rbsharded;
+
+rbsharded *rb_shard_create(int (*compare_func)(const void *, const void *), void (*destroy_func)(void *), void *(*copy_func)(const void *), void *bounds[], size_t n);
+void rb_shard_destroy(rbsharded *s);
+
+void *rb_shard_find(rbsharded *s, void *data);
+int rb_shard_insert(rbsharded *s, void *data);
+void *rb_shard_delete(rbsharded *s, void *data);
+
+void *rb_shard_min(rbsharded *s);
+void *rb_shard_max(rbsharded *s);
+int rb_shard_apply(rbsharded *s, int (*func)(void *, void *), void *cookie);
+size_t rb_shard_count(rbsharded *s);
+
+int rb_shard_rebalance(rbsharded *s);
+
+#endif /* _RB_SHARD_HEADER */
@@ -8,10 +8,23 @@
 #include <stdlib.h>
 #include <time.h>
 #include <limits.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "rb.h"
 #include "rb_data.h"
+#include "rb_index.h"
+#include "rb_interval.h"
+#include "rb_shard.h"
+#include "rb_persist.h"
+#include "rb_io.h"
+#include "rb_mmap.h"
 #include "minunit.h"
 
+#define RB_GEN_NAME inttree
+#define RB_GEN_KEY int
+#define RB_GEN_CMP(a, b) (((a) > (b)) - ((a) < (b)))
+#include "rb_gen.h"
+
 #define MIN INT_MIN
 #define MAX INT_MAX
 #define CHARS "ABCDEFGHIJ"
@@ -28,6 +41,30 @@ static rbnode *tree_insert(rbtree *rbt, int key);
 static int tree_delete(rbtree *rbt, int key);
 
 static rbtree *make_black_tree();
+static long check_sum(rbnode *node);
+static void range_take(void *data, void *cookie);
+static int count_interval(rbinterval *iv, void *cookie);
+static int sum_func(void *data, void *cookie);
+static void *shard_writer(void *arg);
+static int shard_collect(void *data, void *cookie);
+static int shard_check(rbsharded *s, int keys);
+static void persist_destroy(void *data);
+static int persist_sum(void *data, void *cookie);
+static void *persist_reader(void *arg);
+static int persist_insert(rbptree *t, int key);
+static size_t io_encode(const void *d, void *buf, size_t size, void *cookie);
+static void *io_decode(const void *buf, size_t size, void *cookie);
+static FILE *io_copy(FILE *fp, long bytes, long flip);
+static int mapped_collect(const void *payload, size_t size, void *cookie);
+static int mapped_count(const void *payload, size_t size, void *cookie);
+static int mapped_change(const char *path, long at, int byte);
+#ifdef RB_PARALLEL
+static int parallel_sum(void *data, void *cookie);
+static int parallel_stop(void *data, void *cookie);
+#endif
+#ifdef RB_RCU
+static void *rcu_reader(void *arg);
+#endif
 
 static void swap(char *x, char *y);
 static void permute(char *a, int start, int end, void func(char *));
@@ -37,6 +74,8 @@ static void permutation_delete(char *a);
 static int unit_test_create();
 static int unit_test_find();
 static int unit_test_successor();
+static int unit_test_bounds();
+static int unit_test_cursor();
 static int unit_test_atomic_insertion();
 static int unit_test_chain_insertion();
 static int unit_test_atomic_deletion();
@@ -46,9 +85,37 @@ static int unit_test_permutation_deletion();
 static int unit_test_random_insertion_deletion();
 
 static int unit_test_dup();
+static int unit_test_pool();
+static int unit_test_intrusive();
+static int unit_test_index();
+static int unit_test_gen();
+static int unit_test_build_sorted();
+static int unit_test_insert_batch();
+static int unit_test_insert_hint();
+static int unit_test_split_join();
+static int unit_test_delete_range();
+static int unit_test_pop();
+static int unit_test_augment();
+static int unit_test_interval();
+static int unit_test_shard();
+static int unit_test_persist();
+static int unit_test_io();
+static int unit_test_mapped();
+#ifdef RB_RANK
+static int unit_test_rank();
+#endif
 #ifdef RB_MIN
 static int unit_test_min();
 #endif
+#ifdef RB_PARALLEL
+static int unit_test_parallel();
+#endif
+#ifdef RB_RCU
+static int unit_test_rcu();
+#endif
+#ifdef RB_STATS
+static int unit_test_stats();
+#endif
 
 void all_tests()
 {
@@ -57,6 +124,8 @@ void all_tests()
 	mu_test("unit_test_find", unit_test_find());
 
 	mu_test("unit_test_successor", unit_test_successor());
+	mu_test("unit_test_bounds", unit_test_bounds());
+	mu_test("unit_test_cursor", unit_test_cursor());
 
 	mu_test("unit_test_atomic_insertion", unit_test_atomic_insertion());
 	mu_test("unit_test_chain_insertion", unit_test_chain_insertion());
@@ -71,9 +140,48 @@ void all_tests()
 
 	mu_test("unit_test_dup", unit_test_dup());
 
+	mu_test("unit_test_pool", unit_test_pool());
+
+	mu_test("unit_test_intrusive", unit_test_intrusive());
+
+	mu_test("unit_test_index", unit_test_index());
+
+	mu_test("unit_test_gen", unit_test_gen());
+
+	mu_test("unit_test_build_sorted", unit_test_build_sorted());
+	mu_test("unit_test_insert_batch", unit_test_insert_batch());
+	mu_test("unit_test_insert_hint", unit_test_insert_hint());
+
+	mu_test("unit_test_split_join", unit_test_split_join());
+	mu_test("unit_test_delete_range", unit_test_delete_range());
+	mu_test("unit_test_pop", unit_test_pop());
+
+	mu_test("unit_test_augment", unit_test_augment());
+	mu_test("unit_test_interval", unit_test_interval());
+	mu_test("unit_test_shard", unit_test_shard());
+	mu_test("unit_test_persist", unit_test_persist());
+	mu_test("unit_test_io", unit_test_io());
+	mu_test("unit_test_mapped", unit_test_mapped());
+
+	#ifdef RB_RANK
+	mu_test("unit_test_rank", unit_test_rank());
+	#endif
+
 	#ifdef RB_MIN
 	mu_test("unit_test_min", unit_test_min());
 	#endif
+
+	#ifdef RB_PARALLEL
+	mu_test("unit_test_parallel", unit_test_parallel());
+	#endif
+
+	#ifdef RB_RCU
+	mu_test("unit_test_rcu", unit_test_rcu());
+	#endif
+
+	#ifdef RB_STATS
+	mu_test("unit_test_stats", unit_test_stats());
+	#endif
 }
 
 int main(int argc, char **argv)
@@ -109,6 +217,9 @@ void tree_print(rbtree *rbt)
 int tree_check(rbtree *rbt)
 {
 	mydata min, max;
+	#ifdef RB_MAX
+	rbnode *node;
+	#endif
 	int rc;
 
 	min.key = MIN;
@@ -125,6 +236,21 @@ int tree_check(rbtree *rbt)
 		rc = 0;
 	}
 
+	#ifdef RB_MAX
+	for (node = RB_FIRST(rbt); node != RB_NIL(rbt) && node->right != RB_NIL(rbt); node = node->right) ;
+	if (RB_MAXIMAL(rbt) != (node != RB_NIL(rbt) ? node : NULL)) {
+		fprintf(stdout, "tree_check: invalid max\n");
+		rc = 0;
+	}
+	#endif
+
+	#ifdef RB_RANK
+	if (rb_check_size(rbt) == 0) {
+		fprintf(stdout, "tree_check: invalid size\n");
+		rc = 0;
+	}
+	#endif
+
 	return rc;
 }
 
@@ -272,7 +398,7 @@ rbtree *make_black_tree()
 
 	n = strlen(c);
 	for (i = 0; i < n; i++) {
-		if ((node = tree_find(rbt, c[i])) == NULL || node->color != BLACK)
+		if ((node = tree_find(rbt, c[i])) == NULL || RB_COLOR(node) != BLACK)
 			goto err;
 	}
 
@@ -309,21 +435,33 @@ int unit_test_create()
 
 	if (rbt->compare != compare_func || \
 		rbt->destroy != destroy_func || \
-		rbt->nil.left != RB_NIL(rbt) || \
-		rbt->nil.right != RB_NIL(rbt) || \
-		rbt->nil.parent != RB_NIL(rbt) || \
-		rbt->nil.color != BLACK || \
-		rbt->nil.data != NULL || \
+		RB_NIL(rbt)->left != RB_NIL(rbt) || \
+		RB_NIL(rbt)->right != RB_NIL(rbt) || \
+		RB_PARENT(RB_NIL(rbt)) != RB_NIL(rbt) || \
+		RB_COLOR(RB_NIL(rbt)) != BLACK || \
+		RB_NIL(rbt)->data != NULL || \
 		rbt->root.left != RB_NIL(rbt) || \
 		rbt->root.right != RB_NIL(rbt) || \
-		rbt->root.parent != RB_NIL(rbt) || \
-		rbt->root.color != BLACK || \
+		RB_PARENT(&rbt->root) != RB_NIL(rbt) || \
+		RB_COLOR(&rbt->root) != BLACK || \
 		rbt->root.data != NULL) {
 		fprintf(stdout, "init failed\n");
 		rb_destroy(rbt);
 		return 0;
 	}
 
+	#ifdef RB_COMPACT
+	#ifdef RB_RANK
+	if (sizeof(rbnode) != 4 * sizeof(void *) + sizeof(size_t)) {
+	#else
+	if (sizeof(rbnode) != 4 * sizeof(void *)) {
+	#endif
+		fprintf(stdout, "node not compact\n");
+		rb_destroy(rbt);
+		return 0;
+	}
+	#endif
+
 	rb_destroy(rbt);
 	return 1;
 }
@@ -776,4 +914,2573 @@ err:
 	rb_destroy(rbt);
 err0:
 	return 0;
-}
\ No newline at end of file
+}
+
+int unit_test_pool()
+{
+	rbtree *rbt;
+	rbnode *node, *reused;
+	int i;
+
+	/* a slab of SIZE_MAX nodes would wrap its size */
+	if (rb_create_pool(compare_func, destroy_func, 0) != NULL || rb_create_pool(compare_func, destroy_func, SIZE_MAX) != NULL) {
+		fprintf(stdout, "bad chunk accepted\n");
+		goto err0;
+	}
+
+	if ((rbt = rb_create_pool(compare_func, destroy_func, 8)) == NULL) {
+		fprintf(stdout, "create red-black tree failed\n");
+		goto err0;
+	}
+
+	for (i = 0; i < 100; i++) {
+		if (tree_insert(rbt, (i * 37) % 101) == NULL || tree_check(rbt) != 1) {
+			fprintf(stdout, "insert %d failed\n", (i * 37) % 101);
+			goto err;
+		}
+	}
+
+	for (i = 0; i < 100; i += 2) {
+		if (tree_delete(rbt, (i * 37) % 101) != 1 || tree_check(rbt) != 1) {
+			fprintf(stdout, "delete %d failed\n", (i * 37) % 101);
+			goto err;
+		}
+	}
+
+	/* a freed node is handed out again by the next insertion */
+	#ifdef RB_RCU
+	rb_rcu_synchronize(rbt); /* so that only the next deleted node is retired */
+	#endif
+	for (node = RB_FIRST(rbt); node->left != RB_NIL(rbt); node = node->left) ;
+	if (tree_delete(rbt, ((mydata *) node->data)->key) != 1) {
+		fprintf(stdout, "delete failed\n");
+		goto err;
+	}
+	#ifdef RB_RCU
+	rb_rcu_synchronize(rbt); /* deleted nodes are retired until readers have left */
+	#endif
+	if ((reused = tree_insert(rbt, 1000)) == NULL || tree_check(rbt) != 1) {
+		fprintf(stdout, "reinsert failed\n");
+		goto err;
+	}
+
+	if (reused != node) {
+		fprintf(stdout, "node not reused\n");
+		goto err;
+	}
+
+	rb_destroy(rbt);
+	return 1;
+
+err:
+	rb_destroy(rbt);
+err0:
+	return 0;
+}
+
+int unit_test_intrusive()
+{
+	rbtree *rbt;
+	rbnode *node;
+	myrecord records[64], query, min, max;
+	int i, n;
+
+	if ((rbt = rb_create_intrusive(compare_record_func, NULL)) == NULL) {
+		fprintf(stdout, "create red-black tree failed\n");
+		goto err0;
+	}
+
+	n = sizeof(records) / sizeof(records[0]);
+	min.key = MIN;
+	max.key = MAX;
+
+	for (i = 0; i < n; i++) {
+		records[i].key = (i * 37) % n;
+		query.key = records[i].key;
+		if (rb_insert_node(rbt, &records[i].node) != &records[i].node || \
+			rb_find_node(rbt, &query.node) != &records[i].node || \
+			rb_check_order(rbt, &min.node, &max.node) != 1 || \
+			rb_check_black_height(rbt) == 0) {
+			fprintf(stdout, "insert %d failed\n", records[i].key);
+			goto err;
+		}
+	}
+
+	/* nodes with two children are unlinked without moving any other record */
+	for (i = 0; i < n; i += 2) {
+		rb_delete_node(rbt, &records[i].node);
+		query.key = records[i].key;
+		if (rb_find_node(rbt, &query.node) != NULL || \
+			rb_check_order(rbt, &min.node, &max.node) != 1 || \
+			rb_check_black_height(rbt) == 0) {
+			fprintf(stdout, "delete %d failed\n", records[i].key);
+			goto err;
+		}
+	}
+
+	for (i = 1; i < n; i += 2) {
+		query.key = records[i].key;
+		if ((node = rb_find_node(rbt, &query.node)) != &records[i].node || \
+			RB_ENTRY(node, myrecord, node)->key != records[i].key) {
+			fprintf(stdout, "find %d failed\n", records[i].key);
+			goto err;
+		}
+	}
+
+	rb_destroy(rbt);
+	return 1;
+
+err:
+	rb_destroy(rbt);
+err0:
+	return 0;
+}
+
+int unit_test_index()
+{
+	rbitree *rbt;
+	rbindex node, nodes[500];
+	mydata *data, query, min, max;
+	int i;
+
+	if ((rbt = rbi_create(compare_func, destroy_func)) == NULL) {
+		fprintf(stdout, "create red-black tree failed\n");
+		goto err0;
+	}
+
+	min.key = MIN;
+	max.key = MAX;
+
+	/* indices stay valid while the node array grows and moves */
+	for (i = 0; i < 500; i++) {
+		if ((data = makedata((i * 37) % 500)) == NULL || (nodes[i] = rbi_insert(rbt, data)) == RBI_NIL) {
+			fprintf(stdout, "insert %d failed\n", (i * 37) % 500);
+			free(data);
+			goto err;
+		}
+		if (rbi_check_order(rbt, &min, &max) != 1 || rbi_check_black_height(rbt) == 0) {
+			fprintf(stdout, "insert %d failed\n", (i * 37) % 500);
+			goto err;
+		}
+	}
+
+	for (i = 0; i < 500; i++) {
+		query.key = (i * 37) % 500;
+		if (rbi_find(rbt, &query) != nodes[i]) {
+			fprintf(stdout, "find %d failed\n", query.key);
+			goto err;
+		}
+	}
+
+	for (i = 0; i < 500; i += 2) {
+		rbi_delete(rbt, nodes[i], 0);
+		query.key = (i * 37) % 500;
+		if (rbi_find(rbt, &query) != RBI_NIL || \
+			rbi_check_order(rbt, &min, &max) != 1 || \
+			rbi_check_black_height(rbt) == 0) {
+			fprintf(stdout, "delete %d failed\n", query.key);
+			goto err;
+		}
+	}
+
+	#ifdef RB_MIN
+	if (((mydata *) RBI_DATA(rbt, RBI_MINIMAL(rbt)))->key != 1) {
+		fprintf(stdout, "invalid min\n");
+		goto err;
+	}
+	#endif
+
+	/* freed slots are reused before the array grows */
+	if ((data = makedata(1000)) == NULL || (node = rbi_insert(rbt, data)) == RBI_NIL) {
+		fprintf(stdout, "insert 1000 failed\n");
+		free(data);
+		goto err;
+	}
+	if (node != nodes[498]) {
+		fprintf(stdout, "slot not reused\n");
+		goto err;
+	}
+
+	for (node = RBI_FIRST(rbt); RBI_NODE(rbt, node)->left != RBI_NIL; node = RBI_NODE(rbt, node)->left) ;
+	for (i = 0; node != RBI_NIL; node = rbi_successor(rbt, node))
+		i++;
+	if (i != 251) {
+		fprintf(stdout, "successor failed\n");
+		goto err;
+	}
+
+	rbi_destroy(rbt);
+	return 1;
+
+err:
+	rbi_destroy(rbt);
+err0:
+	return 0;
+}
+
+int unit_test_gen()
+{
+	inttree *rbt;
+	inttree_node *node;
+	int i, key, n;
+
+	if ((rbt = inttree_create(NULL)) == NULL) {
+		fprintf(stdout, "create red-black tree failed\n");
+		goto err0;
+	}
+
+	n = 0;
+	for (i = 0; i < 1000; i++) {
+		key = (i * 37) % 1000;
+		if (inttree_insert(rbt, key, NULL) == NULL || \
+			inttree_check_order(rbt, MIN, MAX) != 1 || \
+			inttree_check_black_height(rbt) == 0) {
+			fprintf(stdout, "insert %d failed\n", key);
+			goto err;
+		}
+	}
+
+	for (i = 0; i < 1000; i += 3) {
+		if ((node = inttree_find(rbt, i)) == NULL || node->key != i) {
+			fprintf(stdout, "find %d failed\n", i);
+			goto err;
+		}
+		inttree_delete(rbt, node, 0);
+		if (inttree_find(rbt, i) != NULL || \
+			inttree_check_order(rbt, MIN, MAX) != 1 || \
+			inttree_check_black_height(rbt) == 0) {
+			fprintf(stdout, "delete %d failed\n", i);
+			goto err;
+		}
+	}
+
+	#ifdef RB_MIN
+	if (rbt->min == NULL || rbt->min->key != 1) {
+		fprintf(stdout, "invalid min\n");
+		goto err;
+	}
+	#endif
+
+	for (node = rbt->root.left; node->left != &rbt->nil; node = node->left) ;
+	for (key = -1; node != NULL; node = inttree_successor(rbt, node)) {
+		if (node->key <= key || node->key % 3 == 0) {
+			fprintf(stdout, "successor failed\n");
+			goto err;
+		}
+		key = node->key;
+		n++;
+	}
+
+	if (n != 666) {
+		fprintf(stdout, "invalid count %d\n", n);
+		goto err;
+	}
+
+	inttree_destroy(rbt);
+	return 1;
+
+err:
+	inttree_destroy(rbt);
+err0:
+	return 0;
+}
+
+int unit_test_build_sorted()
+{
+	rbtree *rbt;
+	rbnode *node;
+	void *data[300];
+	int i, n;
+
+	for (n = 0; n <= 300; n += (n < 70 ? 1 : 23)) {
+		if ((rbt = tree_create()) == NULL) {
+			fprintf(stdout, "create red-black tree failed\n");
+			goto err0;
+		}
+
+		for (i = 0; i < n; i++) {
+			if ((data[i] = makedata(i * 2)) == NULL) {
+				fprintf(stdout, "out of memory\n");
+				while (i-- > 0)
+					free(data[i]);
+				goto err;
+			}
+		}
+
+		if (rb_build_sorted(rbt, data, n) != 0 || tree_check(rbt) != 1) {
+			fprintf(stdout, "build %d failed\n", n);
+			for (i = 0; i < n; i++)
+				free(data[i]);
+			goto err;
+		}
+
+		#ifdef RB_MIN
+		if (RB_MINIMAL(rbt) != (n == 0 ? NULL : tree_find(rbt, 0))) {
+			fprintf(stdout, "build %d: invalid min\n", n);
+			goto err;
+		}
+		#endif
+
+		for (i = 0; i < n; i++) {
+			if ((node = tree_find(rbt, i * 2)) == NULL || node->data != data[i]) {
+				fprintf(stdout, "build %d: find %d failed\n", n, i * 2);
+				goto err;
+			}
+		}
+
+		/* the built tree is an ordinary tree */
+		if (tree_insert(rbt, n * 2 + 1) == NULL || tree_check(rbt) != 1 || \
+			tree_delete(rbt, n * 2 + 1) != 1 || tree_check(rbt) != 1 || \
+			(n > 0 && (tree_delete(rbt, n / 2 * 2) != 1 || tree_check(rbt) != 1))) {
+			fprintf(stdout, "build %d: update failed\n", n);
+			goto err;
+		}
+
+		/* a non-empty tree is refused */
+		if (n > 1 && rb_build_sorted(rbt, data, 1) == 0) {
+			fprintf(stdout, "build %d: non-empty tree accepted\n", n);
+			goto err;
+		}
+
+		rb_destroy(rbt);
+	}
+
+	/* unsorted data is refused */
+	if ((rbt = tree_create()) == NULL) {
+		fprintf(stdout, "create red-black tree failed\n");
+		goto err0;
+	}
+
+	mydata d1, d2;
+	d1.key = 2;
+	d2.key = 1;
+	data[0] = &d1;
+	data[1] = &d2;
+	if (rb_build_sorted(rbt, data, 2) == 0 || !RB_ISEMPTY(rbt)) {
+		fprintf(stdout, "unsorted data accepted\n");
+		rb_destroy(rbt);
+		goto err0;
+	}
+
+	rb_destroy(rbt);
+	return 1;
+
+err:
+	rb_destroy(rbt);
+err0:
+	return 0;
+}
+
+int unit_test_insert_batch()
+{
+	rbtree *rbt;
+	rbnode *node;
+	void *data[600];
+	int keys[600];
+	char seen[1200];
+	int sizes[][2] = {
+		{0, 300}, /* empty tree, built from the batch */
+		{500, 10}, /* small batch, inserted key by key */
+		{500, 100}, /* sorted, each key searched from the previous one */
+		{300, 600}, /* large batch, merged and rebuilt */
+		{60, 600}
+	};
+	size_t i;
+	int j, n, b, count;
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		n = sizes[i][0];
+		b = sizes[i][1];
+		memset(seen, 0, sizeof(seen));
+
+		if ((rbt = tree_create()) == NULL) {
+			fprintf(stdout, "create red-black tree failed\n");
+			goto err0;
+		}
+
+		for (j = 0; j < n; j++) {
+			if (tree_insert(rbt, j * 2) == NULL) {
+				fprintf(stdout, "insert %d failed\n", j * 2);
+				goto err;
+			}
+			seen[j * 2] = 1;
+		}
+
+		/* unsorted batch, some keys already in the tree, some repeated */
+		for (j = 0; j < b; j++) {
+			keys[j] = (j * 37) % (b / 2 + 1);
+			if ((data[j] = makedata(keys[j])) == NULL) {
+				fprintf(stdout, "out of memory\n");
+				while (j-- > 0)
+					free(data[j]);
+				goto err;
+			}
+		}
+
+		if (rb_insert_batch(rbt, data, b) != 0 || tree_check(rbt) != 1) {
+			fprintf(stdout, "batch %d into %d failed\n", b, n);
+			goto err;
+		}
+
+		count = n;
+		for (j = 0; j < b; j++) {
+			if (tree_find(rbt, keys[j]) == NULL) {
+				fprintf(stdout, "batch %d into %d: find %d failed\n", b, n, keys[j]);
+				goto err;
+			}
+			#ifdef RB_DUP
+			count++;
+			#else
+			count += !seen[keys[j]];
+			#endif
+			seen[keys[j]] = 1;
+		}
+
+		#ifdef RB_MIN
+		if (RB_MINIMAL(rbt) == NULL || ((mydata *) RB_MINIMAL(rbt)->data)->key != 0) {
+			fprintf(stdout, "batch %d into %d: invalid min\n", b, n);
+			goto err;
+		}
+		for (j = 0, node = RB_MINIMAL(rbt); node != NULL; node = rb_successor(rbt, node))
+			j++;
+		if (j != count) {
+			fprintf(stdout, "batch %d into %d: %d nodes, %d expected\n", b, n, j, count);
+			goto err;
+		}
+		#endif
+
+		rb_destroy(rbt);
+	}
+
+	return 1;
+
+err:
+	rb_destroy(rbt);
+err0:
+	return 0;
+}
+
+/*
+ * split a pooled tree of even keys at every odd key, then join it back around that key
+ */
+int unit_test_split_join()
+{
+	rbtree *rbt, *lo, *hi, *left, *right;
+	rbnode *node;
+	mydata query, *pivot;
+	int sizes[] = {0, 1, 2, 3, 10, 100};
+	size_t i;
+	int j, k, n, count;
+
+	lo = hi = left = right = NULL;
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		n = sizes[i];
+		for (k = -1; k <= 2 * n + 1; k += 2) {
+			if ((rbt = rb_create_pool(compare_func, destroy_func, 16)) == NULL) {
+				fprintf(stdout, "create red-black tree failed\n");
+				goto err0;
+			}
+
+			for (j = 0; j < n; j++) {
+				if (tree_insert(rbt, (j * 37) % n * 2) == NULL) {
+					fprintf(stdout, "insert %d failed\n", (j * 37) % n * 2);
+					goto err;
+				}
+			}
+
+			query.key = k;
+			if (rb_split(rbt, &query, &lo, &hi) != 0 || !RB_ISEMPTY(rbt) || tree_check(lo) != 1 || tree_check(hi) != 1) {
+				fprintf(stdout, "split %d of %d failed\n", k, n);
+				goto err;
+			}
+
+			for (node = RB_FIRST(lo); node != RB_NIL(lo); node = node->right) {
+				if (((mydata *) node->data)->key > k) {
+					fprintf(stdout, "split %d of %d: %d in lo\n", k, n, ((mydata *) node->data)->key);
+					goto err;
+				}
+			}
+			for (node = RB_FIRST(hi); node != RB_NIL(hi); node = node->left) {
+				if (((mydata *) node->data)->key < k) {
+					fprintf(stdout, "split %d of %d: %d in hi\n", k, n, ((mydata *) node->data)->key);
+					goto err;
+				}
+			}
+
+			#ifdef RB_MIN
+			if ((n == 0 || k < 0) != (RB_MINIMAL(lo) == NULL) || (k > 2 * n - 2) != (RB_MINIMAL(hi) == NULL) || \
+				(RB_MINIMAL(lo) != NULL && ((mydata *) RB_MINIMAL(lo)->data)->key != 0) || \
+				(RB_MINIMAL(hi) != NULL && ((mydata *) RB_MINIMAL(hi)->data)->key != k + 1)) {
+				fprintf(stdout, "split %d of %d: invalid min\n", k, n);
+				goto err;
+			}
+			#endif
+
+			/* the pivot must fall between the two trees */
+			query.key = k + 2;
+			if (k + 1 < 2 * n && rb_join(lo, &query, hi) == 0) {
+				fprintf(stdout, "join %d of %d: out of order pivot accepted\n", k, n);
+				goto err;
+			}
+
+			/* other's data would be freed by lo's destroy */
+			hi->destroy = NULL;
+			if (rb_join(lo, &query, hi) == 0 || rb_concat(lo, hi) == 0) {
+				fprintf(stdout, "join %d of %d: incompatible trees accepted\n", k, n);
+				goto err;
+			}
+			hi->destroy = lo->destroy;
+
+			if ((pivot = makedata(k)) == NULL || rb_join(lo, pivot, hi) != 0 || !RB_ISEMPTY(hi) || tree_check(lo) != 1) {
+				fprintf(stdout, "join %d of %d failed\n", k, n);
+				free(pivot);
+				goto err;
+			}
+
+			for (count = 0, j = -2, node = RB_FIRST(lo); node->left != RB_NIL(lo); node = node->left) ;
+			for (; node != NULL; node = rb_successor(lo, node), count++) {
+				if (((mydata *) node->data)->key <= j) {
+					fprintf(stdout, "join %d of %d: out of order\n", k, n);
+					goto err;
+				}
+				j = ((mydata *) node->data)->key;
+			}
+			if (count != n + 1) {
+				fprintf(stdout, "join %d of %d: %d nodes\n", k, n, count);
+				goto err;
+			}
+
+			#ifdef RB_MIN
+			if (RB_MINIMAL(lo) == NULL || ((mydata *) RB_MINIMAL(lo)->data)->key != (n == 0 || k < 0 ? k : 0)) {
+				fprintf(stdout, "join %d of %d: invalid min\n", k, n);
+				goto err;
+			}
+			#endif
+
+			/* split after the pivot again, concat takes its pivot from the second tree */
+			query.key = k + 1;
+			if (rb_split(lo, &query, &left, &right) != 0 || \
+				(!RB_ISEMPTY(left) && !RB_ISEMPTY(right) && rb_concat(right, left) == 0) || \
+				rb_concat(left, right) != 0 || !RB_ISEMPTY(right) || tree_check(left) != 1) {
+				fprintf(stdout, "concat %d of %d failed\n", k, n);
+				goto err;
+			}
+			for (count = 0, node = RB_FIRST(left); node->left != RB_NIL(left); node = node->left) ;
+			for (; node != NULL; node = rb_successor(left, node))
+				count++;
+			if (count != n + 1) {
+				fprintf(stdout, "concat %d of %d: %d nodes\n", k, n, count);
+				goto err;
+			}
+
+			/* the trees share the pool, which outlives all but the last */
+			rb_destroy(rbt);
+			rb_destroy(hi);
+			rb_destroy(lo);
+			rb_destroy(left);
+			rb_destroy(right);
+			lo = hi = left = right = NULL;
+		}
+	}
+
+	return 1;
+
+err:
+	rb_destroy(rbt);
+	if (lo != NULL)
+		rb_destroy(lo);
+	if (hi != NULL)
+		rb_destroy(hi);
+	if (left != NULL)
+		rb_destroy(left);
+	if (right != NULL)
+		rb_destroy(right);
+err0:
+	return 0;
+}
+
+/*
+ * cookie is {count, keys...}
+ */
+void range_take(void *data, void *cookie)
+{
+	int *keys = (int *) cookie;
+
+	keys[++keys[0]] = ((mydata *) data)->key;
+}
+
+int unit_test_delete_range()
+{
+	rbtree *rbt;
+	rbnode *node;
+	mydata lo, hi, records[50];
+	int ranges[][2] = {
+		{-10, -1}, /* before all keys */
+		{200, 300}, /* after all keys */
+		{50, 49}, /* empty range */
+		{0, 0}, /* the minimum */
+		{10, 19},
+		{31, 32}, /* between keys */
+		{150, 1000}, /* the tail */
+		{-5, 5}, /* the head */
+		{-1000, 1000} /* everything */
+	};
+	size_t r, expected;
+	int i, key, count, taken[51];
+	char alive[200];
+
+	if ((rbt = tree_create()) == NULL) {
+		fprintf(stdout, "create red-black tree failed\n");
+		goto err0;
+	}
+
+	for (i = 0; i < 200; i++) {
+		if (tree_insert(rbt, (i * 37) % 200) == NULL) {
+			fprintf(stdout, "insert %d failed\n", (i * 37) % 200);
+			goto err;
+		}
+		alive[i] = 1;
+	}
+
+	for (r = 0; r < sizeof(ranges) / sizeof(ranges[0]); r++) {
+		lo.key = ranges[r][0];
+		hi.key = ranges[r][1];
+
+		for (expected = 0, key = 0; key < 200; key++) {
+			if (alive[key] && key >= lo.key && key <= hi.key) {
+				alive[key] = 0;
+				expected++;
+			}
+		}
+
+		if (rb_delete_range(rbt, &lo, &hi, NULL, NULL) != expected || tree_check(rbt) != 1) {
+			fprintf(stdout, "delete range [%d, %d] failed\n", lo.key, hi.key);
+			goto err;
+		}
+
+		for (count = 0, key = 0; key < 200; key++) {
+			if ((tree_find(rbt, key) != NULL) != alive[key]) {
+				fprintf(stdout, "delete range [%d, %d]: key %d\n", lo.key, hi.key, key);
+				goto err;
+			}
+			count += alive[key];
+		}
+
+		#ifdef RB_MIN
+		for (key = 0; key < 200 && !alive[key]; key++) ;
+		if ((key == 200) != (RB_MINIMAL(rbt) == NULL) || (key < 200 && ((mydata *) RB_MINIMAL(rbt)->data)->key != key)) {
+			fprintf(stdout, "delete range [%d, %d]: invalid min\n", lo.key, hi.key);
+			goto err;
+		}
+		#endif
+	}
+
+	if (!RB_ISEMPTY(rbt)) {
+		fprintf(stdout, "tree not empty\n");
+		goto err;
+	}
+
+	/* taken data is handed over in order */
+	for (i = 0; i < 50; i++) {
+		records[i].key = i;
+		if (rb_insert(rbt, &records[i]) == NULL) {
+			fprintf(stdout, "insert %d failed\n", i);
+			goto err;
+		}
+	}
+
+	lo.key = 10;
+	hi.key = 100;
+	taken[0] = 0;
+	if (rb_delete_range(rbt, &lo, &hi, range_take, taken) != 40 || taken[0] != 40 || tree_check(rbt) != 1) {
+		fprintf(stdout, "delete range take failed\n");
+		goto err;
+	}
+	for (i = 0; i < 40 && taken[i + 1] == i + 10; i++) ;
+	if (i < 40) {
+		fprintf(stdout, "delete range take out of order\n");
+		goto err;
+	}
+
+	for (count = 0, node = RB_FIRST(rbt); node != RB_NIL(rbt); node = node->right)
+		count = ((mydata *) node->data)->key;
+	lo.key = 0;
+	hi.key = 9;
+	taken[0] = 0;
+	if (count != 9 || rb_delete_range(rbt, &lo, &hi, range_take, taken) != 10 || taken[0] != 10 || !RB_ISEMPTY(rbt)) {
+		fprintf(stdout, "delete range take failed\n");
+		goto err;
+	}
+	for (i = 0; i < 10 && taken[i + 1] == i; i++) ;
+	if (i < 10) {
+		fprintf(stdout, "delete range take out of order\n");
+		goto err;
+	}
+
+	rb_destroy(rbt);
+	return 1;
+
+err:
+	rb_destroy(rbt);
+err0:
+	return 0;
+}
+
+#ifdef RB_RANK
+int unit_test_rank()
+{
+	rbtree *rbt;
+	rbnode *node;
+	mydata query;
+	int count[100]; /* occurrences of each key */
+	int i, key, below;
+	size_t k;
+
+	if ((rbt = tree_create()) == NULL) {
+		fprintf(stdout, "create red-black tree failed\n");
+		goto err0;
+	}
+
+	memset(count, 0, sizeof(count));
+	for (i = 0; i < 300; i++) {
+		key = (i * 37) % 100;
+		if (count[key] > 0 && i % 2 == 0) {
+			if (tree_delete(rbt, key) != 1) {
+				fprintf(stdout, "delete %d failed\n", key);
+				goto err;
+			}
+			count[key]--;
+		} else {
+			if (tree_insert(rbt, key) == NULL) {
+				fprintf(stdout, "insert %d failed\n", key);
+				goto err;
+			}
+			#ifdef RB_DUP
+			count[key]++;
+			#else
+			count[key] = 1; /* replaced */
+			#endif
+		}
+		if (tree_check(rbt) != 1) {
+			fprintf(stdout, "step %d failed\n", i);
+			goto err;
+		}
+	}
+
+	for (below = 0, key = 0; key <= 100; key++) {
+		query.key = key;
+		if (rb_rank(rbt, &query) != (size_t) below) {
+			fprintf(stdout, "rank %d failed\n", key);
+			goto err;
+		}
+		for (i = 0; key < 100 && i < count[key]; i++) {
+			if ((node = rb_select(rbt, below + i)) == NULL || ((mydata *) node->data)->key != key) {
+				fprintf(stdout, "select %d failed\n", below + i);
+				goto err;
+			}
+		}
+		if (key < 100)
+			below += count[key];
+	}
+
+	if (RB_COUNT(rbt) != (size_t) below || rb_select(rbt, below) != NULL) {
+		fprintf(stdout, "count failed\n");
+		goto err;
+	}
+
+	/* sizes survive bulk operations */
+	query.key = 50;
+	k = rb_rank(rbt, &query);
+	query.key = 49;
+	if (rb_delete_range(rbt, &query, &query, NULL, NULL) != (size_t) count[49] || tree_check(rbt) != 1 || RB_COUNT(rbt) != (size_t) (below - count[49])) {
+		fprintf(stdout, "delete range failed\n");
+		goto err;
+	}
+	query.key = 50;
+	if (rb_rank(rbt, &query) != k - count[49]) {
+		fprintf(stdout, "rank after delete range failed\n");
+		goto err;
+	}
+
+	rb_destroy(rbt);
+	return 1;
+
+err:
+	rb_destroy(rbt);
+err0:
+	return 0;
+}
+#endif
+
+/*
+ * return the sum of the keys in the subtree, -1 if an aggregate is stale
+ */
+long check_sum(rbnode *node)
+{
+	long l, r;
+
+	if (node == &rb_nil)
+		return 0;
+
+	if ((l = check_sum(node->left)) < 0 || (r = check_sum(node->right)) < 0)
+		return -1;
+
+	return ((mysumdata *) node->data)->sum == l + r + ((mysumdata *) node->data)->key ? l + r + ((mysumdata *) node->data)->key : -1;
+}
+
+int unit_test_augment()
+{
+	rbtree *rbt, *lo, *hi;
+	rbnode *node;
+	mysumdata query, limit, *pivot;
+	void *data[200];
+	int i, key;
+
+	lo = hi = NULL;
+	if ((rbt = rb_create_augment(compare_func, destroy_func, augment_sum_func)) == NULL) {
+		fprintf(stdout, "create red-black tree failed\n");
+		goto err0;
+	}
+
+	for (i = 0; i < 400; i++) {
+		key = (i * 37) % 150;
+		query.key = key;
+		if (i % 3 == 2 && (node = rb_find(rbt, &query)) != NULL) {
+			rb_delete(rbt, node, 0);
+		} else if ((data[0] = makesumdata(key)) == NULL || rb_insert(rbt, data[0]) == NULL) {
+			fprintf(stdout, "insert %d failed\n", key);
+			free(data[0]);
+			goto err;
+		}
+		if (tree_check(rbt) != 1 || check_sum(RB_FIRST(rbt)) < 0) {
+			fprintf(stdout, "step %d: invalid sum\n", i);
+			goto err;
+		}
+	}
+
+	/* bulk operations */
+	for (i = 0; i < 200; i++) {
+		if ((data[i] = makesumdata(1000 + (i * 7) % 200)) == NULL) {
+			fprintf(stdout, "out of memory\n");
+			while (i-- > 0)
+				free(data[i]);
+			goto err;
+		}
+	}
+	if (rb_insert_batch(rbt, data, 200) != 0 || check_sum(RB_FIRST(rbt)) < 0) {
+		fprintf(stdout, "batch: invalid sum\n");
+		goto err;
+	}
+
+	query.key = 500;
+	if (rb_split(rbt, &query, &lo, &hi) != 0 || check_sum(RB_FIRST(lo)) < 0 || check_sum(RB_FIRST(hi)) < 0) {
+		fprintf(stdout, "split: invalid sum\n");
+		goto err;
+	}
+
+	if ((pivot = makesumdata(500)) == NULL || rb_join(lo, pivot, hi) != 0 || check_sum(RB_FIRST(lo)) < 0) {
+		fprintf(stdout, "join: invalid sum\n");
+		free(pivot);
+		goto err;
+	}
+
+	query.key = 100;
+	limit.key = 1100;
+	if (rb_delete_range(lo, &query, &limit, NULL, NULL) == 0 || tree_check(lo) != 1 || check_sum(RB_FIRST(lo)) < 0) {
+		fprintf(stdout, "delete range: invalid sum\n");
+		goto err;
+	}
+
+	rb_destroy(rbt);
+	rb_destroy(lo);
+	rb_destroy(hi);
+	return 1;
+
+err:
+	rb_destroy(rbt);
+	if (lo != NULL)
+		rb_destroy(lo);
+	if (hi != NULL)
+		rb_destroy(hi);
+err0:
+	return 0;
+}
+
+/*
+ * count matches in cookie, fail on the 1000th
+ */
+int count_interval(rbinterval *iv, void *cookie)
+{
+	(void) iv;
+	return ++*(int *) cookie == 1000;
+}
+
+int unit_test_interval()
+{
+	rbtree *rbt;
+	rbinterval intervals[500];
+	char alive[500];
+	int i, j, q, found, expected;
+	long start, end;
+
+	if ((rbt = rb_interval_create(NULL)) == NULL) {
+		fprintf(stdout, "create interval tree failed\n");
+		return 0;
+	}
+
+	for (i = 0; i < 500; i++) {
+		intervals[i].start = (i * 37) % 1000;
+		intervals[i].end = intervals[i].start + (i * 13) % 50;
+		if (rb_interval_insert(rbt, &intervals[i]) != &intervals[i]) {
+			fprintf(stdout, "insert %d failed\n", i);
+			goto err;
+		}
+		alive[i] = 1;
+	}
+
+	for (i = 0; i < 500; i += 3) {
+		rb_interval_delete(rbt, &intervals[i]);
+		alive[i] = 0;
+	}
+
+	if (rb_check_black_height(rbt) == 0 || rb_interval_check_max(rbt) == 0) {
+		fprintf(stdout, "invalid interval tree\n");
+		goto err;
+	}
+
+	for (q = 0; q < 200; q++) {
+		start = (q * 97) % 1100 - 50;
+		end = start + (q % 4 == 0 ? 0 : (q * 7) % 120);
+
+		for (expected = 0, j = 0; j < 500; j++)
+			expected += alive[j] && intervals[j].start <= end && intervals[j].end >= start;
+
+		found = 0;
+		if (start == end)
+			rb_interval_stab(rbt, start, count_interval, &found);
+		else
+			rb_interval_overlap(rbt, start, end, count_interval, &found);
+
+		if (found != expected) {
+			fprintf(stdout, "overlap [%ld, %ld]: %d found, %d expected\n", start, end, found, expected);
+			goto err;
+		}
+	}
+
+	/* func stops the walk */
+	found = 990;
+	if (rb_interval_overlap(rbt, -100, 2000, count_interval, &found) == 0 || found != 1000) {
+		fprintf(stdout, "overlap not stopped\n");
+		goto err;
+	}
+
+	rb_destroy(rbt);
+	return 1;
+
+err:
+	rb_destroy(rbt);
+	return 0;
+}
+
+/*
+ * bounds, predecessor and range cursor over the even keys 0..98, twice each with RB_DUP
+ */
+int unit_test_bounds()
+{
+	rbtree *rbt;
+	rbnode *node, *prev;
+	rbrange range;
+	mydata lo, hi;
+	int i, key, copies, count;
+
+	#ifdef RB_DUP
+	copies = 2;
+	#else
+	copies = 1;
+	#endif
+
+	if ((rbt = tree_create()) == NULL) {
+		fprintf(stdout, "create red-black tree failed\n");
+		goto err0;
+	}
+
+	for (i = 0; i < 50 * copies; i++) {
+		if (tree_insert(rbt, (i * 37) % 50 * 2) == NULL) {
+			fprintf(stdout, "insert %d failed\n", (i * 37) % 50 * 2);
+			goto err;
+		}
+	}
+
+	for (key = -1; key <= 100; key++) {
+		lo.key = key;
+
+		node = rb_lower_bound(rbt, &lo);
+		if ((key > 98) != (node == NULL) || (node != NULL && ((mydata *) node->data)->key != (key + 1) / 2 * 2)) {
+			fprintf(stdout, "lower bound %d failed\n", key);
+			goto err;
+		}
+		if (node != NULL && (prev = rb_predecessor(rbt, node)) != NULL && ((mydata *) prev->data)->key >= key) {
+			fprintf(stdout, "lower bound %d: not the first\n", key);
+			goto err;
+		}
+
+		node = rb_upper_bound(rbt, &lo);
+		if ((key >= 98) != (node == NULL) || (node != NULL && ((mydata *) node->data)->key != (key + 2) / 2 * 2)) {
+			fprintf(stdout, "upper bound %d failed\n", key);
+			goto err;
+		}
+	}
+
+	/* predecessor walks the tree backwards */
+	for (node = RB_FIRST(rbt); node->right != RB_NIL(rbt); node = node->right) ;
+	for (count = 0, key = 98; node != NULL; node = rb_predecessor(rbt, node), count++) {
+		if (((mydata *) node->data)->key != key - count / copies * 2) {
+			fprintf(stdout, "predecessor failed\n");
+			goto err;
+		}
+	}
+	if (count != 50 * copies) {
+		fprintf(stdout, "predecessor: %d nodes\n", count);
+		goto err;
+	}
+
+	/* [lo, hi) */
+	lo.key = 10;
+	hi.key = 20;
+	rb_range_init(&range, rbt, &lo, &hi);
+	for (count = 0; (node = rb_range_next(&range)) != NULL; count++) {
+		if (((mydata *) node->data)->key < 10 || ((mydata *) node->data)->key >= 20) {
+			fprintf(stdout, "range: key %d\n", ((mydata *) node->data)->key);
+			goto err;
+		}
+	}
+	if (count != 5 * copies || rb_range_next(&range) != NULL) {
+		fprintf(stdout, "range: %d nodes\n", count);
+		goto err;
+	}
+
+	/* unbounded */
+	rb_range_init(&range, rbt, NULL, &hi);
+	for (count = 0; rb_range_next(&range) != NULL; count++) ;
+	if (count != 10 * copies) {
+		fprintf(stdout, "range to 20: %d nodes\n", count);
+		goto err;
+	}
+	rb_range_init(&range, rbt, &hi, NULL);
+	for (count = 0; rb_range_next(&range) != NULL; count++) ;
+	if (count != 40 * copies) {
+		fprintf(stdout, "range from 20: %d nodes\n", count);
+		goto err;
+	}
+
+	/* empty */
+	rb_range_init(&range, rbt, &hi, &lo);
+	if (rb_range_next(&range) != NULL) {
+		fprintf(stdout, "empty range failed\n");
+		goto err;
+	}
+
+	rb_destroy(rbt);
+	return 1;
+
+err:
+	rb_destroy(rbt);
+err0:
+	return 0;
+}
+
+/*
+ * add key to the sum in cookie
+ */
+int sum_func(void *data, void *cookie)
+{
+	*(long *) cookie += ((mydata *) data)->key;
+	return 0;
+}
+
+int unit_test_cursor()
+{
+	rbtree *rbt;
+	rbnode *node;
+	rbcursor cursor;
+	long sum, apply_sum;
+	int i, key;
+
+	if ((rbt = tree_create()) == NULL) {
+		fprintf(stdout, "create red-black tree failed\n");
+		goto err0;
+	}
+
+	if (rb_cursor_begin(&cursor, rbt) != NULL || rb_cursor_end(&cursor, rbt) != NULL || rb_cursor_next(&cursor) != NULL) {
+		fprintf(stdout, "empty cursor failed\n");
+		goto err;
+	}
+
+	for (i = 0; i < 200; i++) {
+		if (tree_insert(rbt, (i * 37) % 200) == NULL) {
+			fprintf(stdout, "insert %d failed\n", (i * 37) % 200);
+			goto err;
+		}
+	}
+
+	for (sum = 0, key = 0, node = rb_cursor_begin(&cursor, rbt); node != NULL; node = rb_cursor_next(&cursor), key++) {
+		if (((mydata *) node->data)->key != key) {
+			fprintf(stdout, "next: %d, %d expected\n", ((mydata *) node->data)->key, key);
+			goto err;
+		}
+		sum += key;
+	}
+	if (key != 200 || rb_cursor_next(&cursor) != NULL) {
+		fprintf(stdout, "next: %d nodes\n", key);
+		goto err;
+	}
+
+	for (key = 199, node = rb_cursor_end(&cursor, rbt); node != NULL; node = rb_cursor_prev(&cursor), key--) {
+		if (((mydata *) node->data)->key != key) {
+			fprintf(stdout, "prev: %d, %d expected\n", ((mydata *) node->data)->key, key);
+			goto err;
+		}
+	}
+	if (key != -1) {
+		fprintf(stdout, "prev: %d nodes\n", 199 - key);
+		goto err;
+	}
+
+	/* back and forth */
+	rb_cursor_begin(&cursor, rbt);
+	if (((mydata *) rb_cursor_next(&cursor)->data)->key != 1 || ((mydata *) rb_cursor_prev(&cursor)->data)->key != 0 || rb_cursor_prev(&cursor) != NULL) {
+		fprintf(stdout, "back and forth failed\n");
+		goto err;
+	}
+
+	apply_sum = 0;
+	if (RB_APPLY(rbt, sum_func, &apply_sum, INORDER) != 0 || apply_sum != sum) {
+		fprintf(stdout, "apply failed\n");
+		goto err;
+	}
+
+	rb_destroy(rbt);
+	return 1;
+
+err:
+	rb_destroy(rbt);
+err0:
+	return 0;
+}
+
+int unit_test_pop()
+{
+	rbtree *rbt;
+	void *data[200];
+	int i, n, key;
+
+	if ((rbt = tree_create()) == NULL) {
+		fprintf(stdout, "create red-black tree failed\n");
+		goto err0;
+	}
+
+	if (rb_pop_min(rbt) != NULL || rb_pop_max(rbt) != NULL || rb_pop_min_n(rbt, data, 10) != 0) {
+		fprintf(stdout, "pop from empty tree failed\n");
+		goto err;
+	}
+
+	for (i = 0; i < 200; i++) {
+		if (tree_insert(rbt, (i * 37) % 200) == NULL) {
+			fprintf(stdout, "insert %d failed\n", (i * 37) % 200);
+			goto err;
+		}
+	}
+
+	for (i = 0; i < 10; i++) {
+		if ((data[0] = rb_pop_min(rbt)) == NULL || ((mydata *) data[0])->key != i || tree_check(rbt) != 1) {
+			fprintf(stdout, "pop min %d failed\n", i);
+			goto err;
+		}
+		free(data[0]);
+		if ((data[0] = rb_pop_max(rbt)) == NULL || ((mydata *) data[0])->key != 199 - i || tree_check(rbt) != 1) {
+			fprintf(stdout, "pop max %d failed\n", 199 - i);
+			goto err;
+		}
+		free(data[0]);
+	}
+
+	/* 10..189 left, drained in batches of 0, 1, 2, ... */
+	for (key = 10, n = 0; key < 190; n++) {
+		if (rb_pop_min_n(rbt, data, n) != (size_t) (key + n <= 190 ? n : 190 - key) || tree_check(rbt) != 1) {
+			fprintf(stdout, "pop %d at %d failed\n", n, key);
+			goto err;
+		}
+		for (i = 0; i < n && key < 190; i++, key++) {
+			if (((mydata *) data[i])->key != key) {
+				fprintf(stdout, "pop %d: %d, %d expected\n", n, ((mydata *) data[i])->key, key);
+				goto err;
+			}
+			free(data[i]);
+		}
+
+		#ifdef RB_MIN
+		if ((key < 190) != (RB_MINIMAL(rbt) != NULL) || (key < 190 && ((mydata *) RB_MINIMAL(rbt)->data)->key != key)) {
+			fprintf(stdout, "pop %d: invalid min\n", n);
+			goto err;
+		}
+		#endif
+	}
+
+	if (!RB_ISEMPTY(rbt)) {
+		fprintf(stdout, "tree not empty\n");
+		goto err;
+	}
+
+	rb_destroy(rbt);
+	return 1;
+
+err:
+	rb_destroy(rbt);
+err0:
+	return 0;
+}
+
+/*
+ * ascending, descending, nearly sorted and misleading hints
+ */
+int unit_test_insert_hint()
+{
+	rbtree *rbt;
+	rbnode *node, *hint, *nodes[300];
+	mydata *data;
+	#ifdef RB_DUP
+	mydata *dup[3];
+	#endif
+	int i, key, count;
+
+	if ((rbt = tree_create()) == NULL) {
+		fprintf(stdout, "create red-black tree failed\n");
+		goto err0;
+	}
+
+	for (i = 0, hint = NULL; i < 300; i++) {
+		if (i < 100)
+			key = i * 10; /* ascending from the previous node */
+		else if (i < 200)
+			key = 3000 - (i - 100) * 10 - 5; /* descending */
+		else
+			key = (i - 200) * 30 + ((i * 7) % 5) - 2; /* nearly sorted, some hints wrong */
+
+		if ((data = makedata(key)) == NULL || (node = rb_insert_hint(rbt, hint, data)) == NULL) {
+			fprintf(stdout, "insert %d failed\n", key);
+			free(data);
+			goto err;
+		}
+		if (tree_check(rbt) != 1) {
+			fprintf(stdout, "insert %d: invalid tree\n", key);
+			goto err;
+		}
+		nodes[i] = hint = node;
+		if (i == 99)
+			hint = NULL;
+	}
+
+	/* hints far from the key */
+	for (i = 0; i < 50; i++) {
+		key = 5000 + i;
+		if ((data = makedata(key)) == NULL || rb_insert_hint(rbt, nodes[(i * 37) % 300], data) == NULL || tree_check(rbt) != 1) {
+			fprintf(stdout, "insert %d with a distant hint failed\n", key);
+			free(data);
+			goto err;
+		}
+	}
+
+	for (count = 0, key = INT_MIN, node = RB_FIRST(rbt); node->left != RB_NIL(rbt); node = node->left) ;
+	for (; node != NULL; node = rb_successor(rbt, node), count++) {
+		if (((mydata *) node->data)->key < key) {
+			fprintf(stdout, "out of order\n");
+			goto err;
+		}
+		key = ((mydata *) node->data)->key;
+	}
+
+	#ifdef RB_DUP
+	if (count != 350) {
+	#else
+	if (count > 350 || count < 300) {
+	#endif
+		fprintf(stdout, "%d nodes\n", count);
+		goto err;
+	}
+
+	#ifdef RB_DUP
+	/* a new equal key goes after the existing ones whatever the hint */
+	for (i = 0; i < 3; i++) {
+		if ((dup[i] = makedata(-1000)) == NULL || rb_insert_hint(rbt, i == 0 ? NULL : tree_find(rbt, -1000), dup[i]) == NULL) {
+			fprintf(stdout, "insert duplicate failed\n");
+			free(dup[i]);
+			goto err;
+		}
+	}
+	for (i = 0, node = RB_FIRST(rbt); node->left != RB_NIL(rbt); node = node->left) ;
+	for (; i < 3; i++, node = rb_successor(rbt, node)) {
+		if (node->data != dup[i]) {
+			fprintf(stdout, "duplicates out of order\n");
+			goto err;
+		}
+	}
+	#endif
+
+	rb_destroy(rbt);
+	return 1;
+
+err:
+	rb_destroy(rbt);
+err0:
+	return 0;
+}
+
+#define SHARD_THREADS 4
+
+struct shard_job {
+	rbsharded *s;
+	int first; /* keys first, first + step, ... below last */
+	int step;
+	int last;
+	int insert; /* or delete */
+	int errors;
+};
+
+/*
+ * insert or delete a thread's share of the keys
+ */
+void *shard_writer(void *arg)
+{
+	struct shard_job *job = (struct shard_job *) arg;
+	mydata *data, query;
+	int key;
+
+	for (key = job->first; key < job->last; key += job->step) {
+		if (job->insert) {
+			if ((data = makedata(key)) == NULL || rb_shard_insert(job->s, data) != 0) {
+				free(data);
+				job->errors++;
+			}
+		} else {
+			query.key = key;
+			if ((data = rb_shard_delete(job->s, &query)) == NULL)
+				job->errors++;
+			free(data);
+		}
+	}
+
+	return NULL;
+}
+
+int shard_collect(void *data, void *cookie)
+{
+	int *keys = (int *) cookie;
+
+	keys[++keys[0]] = ((mydata *) data)->key;
+	return 0;
+}
+
+/*
+ * every shard is a valid tree within its bounds, and the shards hold count keys in order
+ */
+int shard_check(rbsharded *s, int count)
+{
+	mydata min, max;
+	int *keys, n;
+	size_t i;
+
+	for (i = 0, n = 0; i < s->n; i++) {
+		/* keys from lo up to the next lo, bounds are exclusive without RB_DUP */
+		#ifdef RB_DUP
+		min.key = i == 0 ? INT_MIN : ((mydata *) s->shards[i].lo)->key;
+		max.key = i + 1 == s->n ? INT_MAX : ((mydata *) s->shards[i + 1].lo)->key - 1;
+		#else
+		min.key = i == 0 ? INT_MIN : ((mydata *) s->shards[i].lo)->key - 1;
+		max.key = i + 1 == s->n ? INT_MAX : ((mydata *) s->shards[i + 1].lo)->key;
+		#endif
+		if (rb_check_order(s->shards[i].rbt, &min, &max) != 1 || rb_check_black_height(s->shards[i].rbt) <= 0) {
+			fprintf(stdout, "shard %d: invalid tree\n", (int) i);
+			return 0;
+		}
+		#ifdef RB_RANK
+		if (s->shards[i].count != RB_COUNT(s->shards[i].rbt)) {
+			fprintf(stdout, "shard %d: count %d, %d nodes\n", (int) i, (int) s->shards[i].count, (int) RB_COUNT(s->shards[i].rbt));
+			return 0;
+		}
+		#endif
+		n += s->shards[i].count;
+	}
+
+	if (n != count || rb_shard_count(s) != (size_t) count) {
+		fprintf(stdout, "%d keys, %d expected\n", n, count);
+		return 0;
+	}
+
+	if ((keys = (int *) malloc((count + 1) * sizeof(int))) == NULL) {
+		fprintf(stdout, "out of memory\n");
+		return 0;
+	}
+
+	keys[0] = 0;
+	rb_shard_apply(s, shard_collect, keys);
+	for (n = 2; n <= keys[0] && keys[n - 1] < keys[n]; n++) ;
+	if (keys[0] != count || n <= count) {
+		fprintf(stdout, "apply: %d keys, not in order\n", keys[0]);
+		free(keys);
+		return 0;
+	}
+	if (count > 0 && (((mydata *) rb_shard_min(s))->key != keys[1] || ((mydata *) rb_shard_max(s))->key != keys[count])) {
+		fprintf(stdout, "wrong min or max\n");
+		free(keys);
+		return 0;
+	}
+
+	free(keys);
+	return 1;
+}
+
+int unit_test_shard()
+{
+	struct shard_job jobs[SHARD_THREADS];
+	pthread_t threads[SHARD_THREADS];
+	mydata bounds[3], *b[3], *data, query;
+	rbsharded *s;
+	int i, j, key, started;
+
+	for (i = 0; i < 3; i++) {
+		bounds[i].key = (i + 1) * 250;
+		b[i] = &bounds[i];
+	}
+
+	if ((s = rb_shard_create(compare_func, destroy_func, copy_func, (void **) b, 4)) == NULL) {
+		fprintf(stdout, "create sharded tree failed\n");
+		goto err0;
+	}
+
+	if (rb_shard_min(s) != NULL || rb_shard_max(s) != NULL || rb_shard_rebalance(s) != 0 || shard_check(s, 0) != 1) {
+		fprintf(stdout, "empty sharded tree\n");
+		goto err;
+	}
+
+	/* threads insert interleaved keys below 1000, then delete the even ones */
+	for (j = 0; j < 2; j++) {
+		for (i = 0, started = 0; i < SHARD_THREADS; i++, started++) {
+			jobs[i].s = s;
+			jobs[i].first = j == 0 ? i : i * 2;
+			jobs[i].step = j == 0 ? SHARD_THREADS : SHARD_THREADS * 2;
+			jobs[i].last = 1000;
+			jobs[i].insert = j == 0;
+			jobs[i].errors = 0;
+			if (pthread_create(&threads[i], NULL, shard_writer, &jobs[i]) != 0)
+				break;
+		}
+		for (i = 0; i < started; i++)
+			pthread_join(threads[i], NULL);
+		if (started != SHARD_THREADS) {
+			fprintf(stdout, "create thread failed\n");
+			goto err;
+		}
+		for (i = 0; i < SHARD_THREADS; i++) {
+			if (jobs[i].errors != 0) {
+				fprintf(stdout, "%s failed\n", j == 0 ? "insert" : "delete");
+				goto err;
+			}
+		}
+		if (shard_check(s, j == 0 ? 1000 : 500) != 1)
+			goto err;
+	}
+
+	for (key = 0; key < 6; key++) {
+		query.key = key;
+		if ((rb_shard_find(s, &query) != NULL) != (key % 2 == 1)) {
+			fprintf(stdout, "find %d failed\n", key);
+			goto err;
+		}
+	}
+
+	/* all new keys go to the last shard, then the bounds move up, then the new keys go again */
+	for (j = 0; j < 2; j++) {
+		for (key = 1000; key < 5000; key++) {
+			query.key = key;
+			if (j == 0 ? (data = makedata(key)) == NULL || rb_shard_insert(s, data) != 0 : (data = rb_shard_delete(s, &query)) == NULL) {
+				fprintf(stdout, "%s %d failed\n", j == 0 ? "insert" : "delete", key);
+				free(data);
+				goto err;
+			}
+			if (j == 1)
+				free(data);
+		}
+
+		if (rb_shard_rebalance(s) != 0 || shard_check(s, j == 0 ? 4500 : 500) != 1) {
+			fprintf(stdout, "rebalance failed\n");
+			goto err;
+		}
+		for (i = 0; i < 4; i++) {
+			key = (j == 0 ? 4500 : 500) * (i + 1) / 4 - (j == 0 ? 4500 : 500) * i / 4;
+			if (s->shards[i].count != (size_t) key) {
+				fprintf(stdout, "shard %d: %d keys, %d expected\n", i, (int) s->shards[i].count, key);
+				goto err;
+			}
+		}
+	}
+
+	rb_shard_destroy(s);
+
+	if ((s = rb_shard_create(compare_func, NULL, copy_func, (void **) b, 4)) != NULL) {
+		fprintf(stdout, "create with copy and no destroy\n");
+		goto err;
+	}
+
+	/* a middle shard drained whole: bounds 10, 20, 30 and keys 25, 35 leave shard 2 empty */
+	for (i = 0; i < 3; i++)
+		bounds[i].key = (i + 1) * 10;
+
+	if ((s = rb_shard_create(compare_func, destroy_func, copy_func, (void **) b, 4)) == NULL) {
+		fprintf(stdout, "create sharded tree failed\n");
+		goto err0;
+	}
+
+	for (key = 25; key < 45; key += 10) {
+		if ((data = makedata(key)) == NULL || rb_shard_insert(s, data) != 0) {
+			fprintf(stdout, "insert %d failed\n", key);
+			free(data);
+			goto err;
+		}
+	}
+
+	for (j = 0; j < 2; j++) {
+		if (rb_shard_rebalance(s) != 0 || shard_check(s, j == 0 ? 2 : 0) != 1) {
+			fprintf(stdout, "rebalance failed\n");
+			goto err;
+		}
+		for (i = 0; i < 4; i++) {
+			if (s->shards[i].count != (size_t) (j == 0 ? i % 2 : 0)) {
+				fprintf(stdout, "shard %d: %d keys\n", i, (int) s->shards[i].count);
+				goto err;
+			}
+		}
+		/* then every shard is empty */
+		for (key = 25; key < 45 && j == 0; key += 10) {
+			query.key = key;
+			if (rb_shard_find(s, &query) == NULL || (data = rb_shard_delete(s, &query)) == NULL) {
+				fprintf(stdout, "find %d failed\n", key);
+				goto err;
+			}
+			free(data);
+		}
+	}
+
+	rb_shard_destroy(s);
+	return 1;
+
+err:
+	rb_shard_destroy(s);
+err0:
+	return 0;
+}
+
+#define PERSIST_KEYS 1000
+#define PERSIST_VERSIONS 8
+
+int persist_made = 0, persist_destroyed = 0;
+
+void persist_destroy(void *data)
+{
+	persist_destroyed++;
+	free(data);
+}
+
+/*
+ * cookie is {count, sum of keys}
+ */
+int persist_sum(void *data, void *cookie)
+{
+	long *sum = (long *) cookie;
+
+	sum[0]++;
+	sum[1] += ((mydata *) data)->key;
+	return 0;
+}
+
+struct persist_walk {
+	rbptree *snap;
+	int done;
+	long walks;
+	int errors;
+};
+
+/*
+ * walk a snapshot until done, it must not change under the writer
+ */
+void *persist_reader(void *arg)
+{
+	struct persist_walk *walk = (struct persist_walk *) arg;
+	long sum[2], first[2];
+
+	first[0] = first[1] = 0;
+	rbp_apply(walk->snap, persist_sum, first);
+
+	while (!__atomic_load_n(&walk->done, __ATOMIC_ACQUIRE)) {
+		sum[0] = sum[1] = 0;
+		rbp_apply(walk->snap, persist_sum, sum);
+		if (sum[0] != first[0] || sum[1] != first[1])
+			walk->errors++;
+		__atomic_store_n(&walk->walks, walk->walks + 1, __ATOMIC_RELAXED);
+	}
+
+	return NULL;
+}
+
+int persist_insert(rbptree *t, int key)
+{
+	mydata *data;
+
+	if ((data = makedata(key)) == NULL || rbp_insert(t, data) != 0) {
+		free(data);
+		return 0;
+	}
+
+	persist_made++;
+	return 1;
+}
+
+int unit_test_persist()
+{
+	rbptree *t, *snaps[PERSIST_VERSIONS];
+	long sums[PERSIST_VERSIONS][2], sum[2];
+	struct persist_walk walk;
+	pthread_t thread;
+	mydata query;
+	int i, j, key, failed;
+	#ifndef RB_DUP
+	mydata *data;
+	#endif
+
+	persist_made = persist_destroyed = 0;
+	for (i = 0; i < PERSIST_VERSIONS; i++)
+		snaps[i] = NULL;
+
+	if ((t = rbp_create(compare_func, persist_destroy)) == NULL) {
+		fprintf(stdout, "create persistent tree failed\n");
+		goto err0;
+	}
+
+	/* every version stays as it was while the next ones change */
+	srand(7);
+	for (i = 0; i < PERSIST_VERSIONS; i++) {
+		for (j = 0; j < PERSIST_KEYS; j++) {
+			query.key = key = rand() % (PERSIST_KEYS * 2);
+			if (rand() % 3 == 0 ? rbp_delete(t, &query) != 0 && rbp_find(t, &query) != NULL : !persist_insert(t, key)) {
+				fprintf(stdout, "update %d failed\n", key);
+				goto err;
+			}
+		}
+		if (rbp_check(t) != 1 || (snaps[i] = rbp_snapshot(t)) == NULL) {
+			fprintf(stdout, "version %d: invalid tree\n", i);
+			goto err;
+		}
+		sums[i][0] = sums[i][1] = 0;
+		rbp_apply(t, persist_sum, sums[i]);
+	}
+
+	for (i = 0; i < PERSIST_VERSIONS; i++) {
+		sum[0] = sum[1] = 0;
+		rbp_apply(snaps[i], persist_sum, sum);
+		if (rbp_check(snaps[i]) != 1 || sum[0] != sums[i][0] || sum[1] != sums[i][1]) {
+			fprintf(stdout, "version %d changed\n", i);
+			goto err;
+		}
+	}
+
+	#ifndef RB_DUP
+	/* an update is not seen by the versions before it */
+	query.key = key;
+	data = rbp_find(t, &query);
+	if (!persist_insert(t, key) || rbp_find(t, &query) == data || rbp_find(snaps[PERSIST_VERSIONS - 1], &query) != data) {
+		fprintf(stdout, "update seen by a snapshot\n");
+		goto err;
+	}
+	#endif
+
+	/* release in no particular order, data goes with the last version having it */
+	for (i = 0; i < PERSIST_VERSIONS; i++) {
+		j = (i * 5) % PERSIST_VERSIONS;
+		rbp_release(snaps[j]);
+		snaps[j] = NULL;
+	}
+	sum[0] = 0;
+	rbp_apply(t, persist_sum, sum);
+	if (persist_made - persist_destroyed != sum[0] || rbp_check(t) != 1) {
+		fprintf(stdout, "%d data made, %d destroyed, %ld left\n", persist_made, persist_destroyed, sum[0]);
+		goto err;
+	}
+
+	/* a reader walks a snapshot while the writer empties and refills the tree */
+	if ((walk.snap = rbp_snapshot(t)) == NULL) {
+		fprintf(stdout, "snapshot failed\n");
+		goto err;
+	}
+	walk.done = 0;
+	walk.walks = 0;
+	walk.errors = 0;
+	if (pthread_create(&thread, NULL, persist_reader, &walk) != 0) {
+		fprintf(stdout, "create thread failed\n");
+		rbp_release(walk.snap);
+		goto err;
+	}
+
+	for (i = 0, failed = 0; !failed && (i < 4 || __atomic_load_n(&walk.walks, __ATOMIC_RELAXED) < 10); i++) {
+		for (key = 0; key < PERSIST_KEYS * 2 && !failed; key++) {
+			query.key = key;
+			while (rbp_delete(t, &query) == 0) ;
+		}
+		for (key = 0; key < PERSIST_KEYS && !failed; key++)
+			failed = !persist_insert(t, (key * 37) % PERSIST_KEYS);
+		failed = failed || rbp_check(t) != 1 || t->count != PERSIST_KEYS;
+	}
+
+	__atomic_store_n(&walk.done, 1, __ATOMIC_RELEASE);
+	pthread_join(thread, NULL);
+	rbp_release(walk.snap);
+
+	if (failed || walk.errors != 0) {
+		fprintf(stdout, "snapshot changed under the reader in %d of %ld walks\n", walk.errors, walk.walks);
+		goto err;
+	}
+
+	rbp_release(t);
+	if (persist_made != persist_destroyed) {
+		fprintf(stdout, "%d data made, %d destroyed\n", persist_made, persist_destroyed);
+		goto err0;
+	}
+	return 1;
+
+err:
+	for (i = 0; i < PERSIST_VERSIONS; i++) {
+		if (snaps[i] != NULL)
+			rbp_release(snaps[i]);
+	}
+	rbp_release(t);
+err0:
+	return 0;
+}
+
+#define IO_KEYS 30000
+
+/*
+ * key then padding, long for the keys divisible by 1000 so that payloads outgrow the buffers
+ */
+size_t io_encode(const void *d, void *buf, size_t size, void *cookie)
+{
+	size_t len;
+
+	len = ((mydata *) d)->key % 1000 == 0 ? 100000 : 4 + *(int *) cookie;
+	if (size >= len) {
+		encode_func(d, buf, size, NULL);
+		memset((char *) buf + 4, 0x5a, len - 4);
+	}
+
+	return len;
+}
+
+void *io_decode(const void *buf, size_t size, void *cookie)
+{
+	mydata *data;
+
+	if (size < 4 || (data = (mydata *) decode_func(buf, 4, NULL)) == NULL)
+		return NULL;
+
+	if (size != (size_t) (data->key % 1000 == 0 ? 100000 : 4 + *(int *) cookie) || (size > 4 && ((char *) buf)[size - 1] != 0x5a)) {
+		free(data);
+		return NULL;
+	}
+
+	return data;
+}
+
+/*
+ * first bytes of fp in a new file, with byte flip changed unless negative
+ */
+FILE *io_copy(FILE *fp, long bytes, long flip)
+{
+	FILE *copy;
+	long i;
+	int c;
+
+	if ((copy = tmpfile()) == NULL)
+		return NULL;
+
+	rewind(fp);
+	for (i = 0; i < bytes && (c = getc(fp)) != EOF; i++)
+		putc(i == flip ? c ^ 1 : c, copy);
+	rewind(copy);
+
+	return copy;
+}
+
+int unit_test_io()
+{
+	rbtree *rbt, *loaded;
+	rbnode *node;
+	FILE *fp, *bad;
+	long size, sum, loaded_sum;
+	int i, pad, step;
+
+	pad = 3;
+	loaded = NULL;
+	fp = NULL;
+
+	if ((rbt = tree_create()) == NULL) {
+		fprintf(stdout, "create red-black tree failed\n");
+		goto err0;
+	}
+
+	/* empty, a few and many keys */
+	for (step = 0; step < 3; step++) {
+		for (i = step == 0 ? 0 : step == 1 ? 1 : 30; i < (step == 0 ? 0 : step == 1 ? 30 : IO_KEYS); i++) {
+			if (tree_insert(rbt, i * 7 % IO_KEYS) == NULL) {
+				fprintf(stdout, "insert %d failed\n", i * 7 % IO_KEYS);
+				goto err;
+			}
+		}
+
+		if ((fp = tmpfile()) == NULL || rb_save(rbt, fp, io_encode, &pad) != 0) {
+			fprintf(stdout, "save failed\n");
+			goto err;
+		}
+		/* other data may follow and the stream is left just past the trailer, the last file is kept whole for the tests below */
+		size = ftell(fp);
+		if (step < 2 && fputs("more", fp) == EOF) {
+			fprintf(stdout, "write failed\n");
+			goto err;
+		}
+		rewind(fp);
+
+		if ((loaded = tree_create()) == NULL || rb_load(loaded, fp, io_decode, &pad) != 0 || tree_check(loaded) != 1 || ftell(fp) != size) {
+			fprintf(stdout, "load %d failed\n", step);
+			goto err;
+		}
+
+		sum = loaded_sum = 0;
+		RB_APPLY(rbt, sum_func, &sum, INORDER);
+		RB_APPLY(loaded, sum_func, &loaded_sum, INORDER);
+		for (i = 0; i < IO_KEYS; i += 101) {
+			if ((tree_find(rbt, i) == NULL) != (tree_find(loaded, i) == NULL))
+				break;
+		}
+		if (sum != loaded_sum || i < IO_KEYS) {
+			fprintf(stdout, "load %d: different data\n", step);
+			goto err;
+		}
+
+		/* a non-empty tree is refused */
+		rewind(fp);
+		if (step > 0 && rb_load(loaded, fp, io_decode, &pad) == 0) {
+			fprintf(stdout, "load %d: non-empty tree accepted\n", step);
+			goto err;
+		}
+
+		rb_destroy(loaded);
+		loaded = NULL;
+		if (step < 2) {
+			fclose(fp);
+			fp = NULL;
+		}
+	}
+
+	/* truncation, a changed byte anywhere, another version or payloads of another kind are refused */
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	for (step = 0; step < 6; step++) {
+		if (step == 0)
+			bad = io_copy(fp, size - 1, -1);
+		else if (step == 1)
+			bad = io_copy(fp, size / 2, -1);
+		else if (step == 2)
+			bad = io_copy(fp, size, 4);
+		else if (step == 3)
+			bad = io_copy(fp, size, size / 3);
+		else
+			bad = io_copy(fp, size, step == 4 ? size - 1 : -1);
+		if (bad == NULL || (loaded = tree_create()) == NULL) {
+			fprintf(stdout, "out of memory\n");
+			if (bad != NULL)
+				fclose(bad);
+			goto err;
+		}
+
+		pad = step == 5 ? 2 : 3;
+		if (rb_load(loaded, bad, io_decode, &pad) == 0 || !RB_ISEMPTY(loaded)) {
+			fprintf(stdout, "bad file %d accepted\n", step);
+			fclose(bad);
+			goto err;
+		}
+
+		fclose(bad);
+		rb_destroy(loaded);
+		loaded = NULL;
+	}
+
+	/* a corrupt length of 2^56 bytes in front of a short payload is refused without asking for that much */
+	if ((bad = tmpfile()) == NULL || (loaded = tree_create()) == NULL) {
+		fprintf(stdout, "out of memory\n");
+		if (bad != NULL)
+			fclose(bad);
+		goto err;
+	}
+	fwrite("RBT\0\1\0\0\0\377\377\377\377\377\377\377\177\0\0\0\0", 1, 20, bad);
+	rewind(bad);
+	if (rb_load(loaded, bad, io_decode, &pad) == 0 || !RB_ISEMPTY(loaded)) {
+		fprintf(stdout, "corrupt length accepted\n");
+		fclose(bad);
+		goto err;
+	}
+	fclose(bad);
+	rb_destroy(loaded);
+	loaded = NULL;
+
+	/* the file is intact */
+	pad = 3;
+	rewind(fp);
+	if ((loaded = tree_create()) == NULL || rb_load(loaded, fp, io_decode, &pad) != 0 || \
+		(node = tree_find(loaded, IO_KEYS - 1)) == NULL || ((mydata *) node->data)->key != IO_KEYS - 1) {
+		fprintf(stdout, "reload failed\n");
+		goto err;
+	}
+
+	fclose(fp);
+	rb_destroy(loaded);
+	rb_destroy(rbt);
+	return 1;
+
+err:
+	if (fp != NULL)
+		fclose(fp);
+	if (loaded != NULL)
+		rb_destroy(loaded);
+	rb_destroy(rbt);
+err0:
+	return 0;
+}
+
+#define MAPPED_KEYS 10000
+
+/*
+ * cookie is {count, last key}, keys must come in increasing order
+ */
+int mapped_collect(const void *payload, size_t size, void *cookie)
+{
+	int *state = (int *) cookie;
+	mydata *data;
+
+	if ((data = (mydata *) decode_func(payload, size, NULL)) == NULL)
+		return 1;
+	if (state[0]++ > 0 && data->key <= state[1]) {
+		free(data);
+		return 2;
+	}
+	state[1] = data->key;
+	free(data);
+	return 0;
+}
+
+int mapped_count(const void *payload, size_t size, void *cookie)
+{
+	(void) payload;
+	(void) size;
+	return ++*(long *) cookie > MAPPED_KEYS * 2; /* a walk gone round in circles */
+}
+
+/*
+ * overwrite the byte at of the file at path, or truncate it there if byte is negative
+ * return non-zero if error
+ */
+int mapped_change(const char *path, long at, int byte)
+{
+	FILE *fp;
+	int err;
+
+	if (byte < 0)
+		return truncate(path, at);
+
+	if ((fp = fopen(path, "r+b")) == NULL)
+		return 1;
+	err = fseek(fp, at, SEEK_SET) != 0 || putc(byte, fp) == EOF;
+	return fclose(fp) != 0 || err;
+}
+
+int unit_test_mapped()
+{
+	char path[] = "/tmp/rb_mappedXXXXXX";
+	rbtree *rbt;
+	rbmtree *t;
+	mydata query;
+	const void *payload;
+	size_t size;
+	int i, fd, state[2];
+	long length, visits;
+	uint64_t root;
+	unsigned char link[8];
+
+	t = NULL;
+	if ((fd = mkstemp(path)) < 0) {
+		fprintf(stdout, "create file failed\n");
+		goto err0;
+	}
+	close(fd);
+
+	if ((rbt = tree_create()) == NULL) {
+		fprintf(stdout, "create red-black tree failed\n");
+		goto err1;
+	}
+
+	/* an empty tree maps too */
+	if (rb_save_mapped(rbt, path, encode_func, NULL) != 0 || (t = rb_open_mapped(path, compare_payload_func)) == NULL || \
+		t->count != 0 || rb_check_mapped(t) != 1) {
+		fprintf(stdout, "map empty tree failed\n");
+		goto err;
+	}
+	query.key = 0;
+	state[0] = 0;
+	if (rb_find_mapped(t, &query, NULL) != NULL || rb_apply_mapped(t, mapped_collect, state) != 0 || state[0] != 0) {
+		fprintf(stdout, "empty mapped tree not empty\n");
+		goto err;
+	}
+
+	for (i = 0; i < MAPPED_KEYS; i++) {
+		if (tree_insert(rbt, (i * 7919) % MAPPED_KEYS * 2) == NULL) {
+			fprintf(stdout, "insert failed\n");
+			goto err;
+		}
+	}
+
+	/* saving over a mapped file replaces it, the old mapping still reads the old tree */
+	if (rb_save_mapped(rbt, path, encode_func, NULL) != 0 || t->count != 0 || rb_check_mapped(t) != 1) {
+		fprintf(stdout, "save over mapped tree failed\n");
+		goto err;
+	}
+	rb_close_mapped(t);
+
+	if ((t = rb_open_mapped(path, compare_payload_func)) == NULL || t->count != MAPPED_KEYS || rb_check_mapped(t) != 1) {
+		fprintf(stdout, "map tree failed\n");
+		goto err;
+	}
+
+	/* every key is found in place, no other is */
+	for (i = -1; i <= MAPPED_KEYS * 2; i++) {
+		query.key = i;
+		payload = rb_find_mapped(t, &query, &size);
+		if ((payload != NULL) != (i >= 0 && i < MAPPED_KEYS * 2 && i % 2 == 0) || \
+			(payload != NULL && (size != 4 || (uintptr_t) payload % 8 != 0 || compare_payload_func(&query, payload, size) != 0))) {
+			fprintf(stdout, "find %d failed\n", i);
+			goto err;
+		}
+	}
+
+	state[0] = 0;
+	if (rb_apply_mapped(t, mapped_collect, state) != 0 || state[0] != MAPPED_KEYS) {
+		fprintf(stdout, "apply: %d keys, not in order\n", state[0]);
+		goto err;
+	}
+	length = (long) t->length;
+	root = t->root;
+	rb_close_mapped(t);
+	t = NULL;
+
+	/* another version, a bad link or a truncated file is refused */
+	if (mapped_change(path, 4, RB_MMAP_VERSION + 1) != 0 || (t = rb_open_mapped(path, compare_payload_func)) != NULL) {
+		fprintf(stdout, "another version accepted\n");
+		goto err;
+	}
+	if (mapped_change(path, 4, RB_MMAP_VERSION) != 0 || (t = rb_open_mapped(path, compare_payload_func)) == NULL) {
+		fprintf(stdout, "reopen failed\n");
+		goto err;
+	}
+	rb_close_mapped(t);
+	t = NULL;
+
+	if (mapped_change(path, length - sizeof(rbmnode) + 1, 0x7f) != 0 || (t = rb_open_mapped(path, compare_payload_func)) == NULL || \
+		rb_check_mapped(t) != 0) {
+		fprintf(stdout, "bad link accepted\n");
+		goto err;
+	}
+	rb_close_mapped(t);
+	t = NULL;
+
+	/* the root's right link back to the root */
+	memcpy(link, &root, sizeof(link));
+	for (i = 0; i < 8; i++) {
+		if (mapped_change(path, (long) root + offsetof(rbmnode, right) + i, link[i]) != 0) {
+			fprintf(stdout, "change failed\n");
+			goto err;
+		}
+	}
+	visits = 0;
+	if ((t = rb_open_mapped(path, compare_payload_func)) == NULL || rb_apply_mapped(t, mapped_count, &visits) != -1 || rb_check_mapped(t) != 0) {
+		fprintf(stdout, "cycle accepted after %ld payloads\n", visits);
+		goto err;
+	}
+	rb_close_mapped(t);
+	t = NULL;
+
+	if (mapped_change(path, length - 1, -1) != 0 || (t = rb_open_mapped(path, compare_payload_func)) != NULL) {
+		fprintf(stdout, "truncated file accepted\n");
+		goto err;
+	}
+
+	rb_destroy(rbt);
+	unlink(path);
+	return 1;
+
+err:
+	if (t != NULL)
+		rb_close_mapped(t);
+	rb_destroy(rbt);
+err1:
+	unlink(path);
+err0:
+	return 0;
+}
+
+#ifdef RB_PARALLEL
+#define PARALLEL_KEYS 20000
+#define PARALLEL_THREADS 4
+
+int parallel_sum(void *data, void *cookie)
+{
+	__atomic_add_fetch((long *) cookie, ((mydata *) data)->key, __ATOMIC_RELAXED);
+	return 0;
+}
+
+int parallel_stop(void *data, void *cookie)
+{
+	return ((mydata *) data)->key == *(int *) cookie ? 7 : 0;
+}
+
+/*
+ * build, apply and destroy with threads on plain, pooled and augmented trees
+ */
+int unit_test_parallel()
+{
+	rbtree *rbt;
+	void **data;
+	long sum;
+	int i, kind, key;
+
+	if ((data = (void **) malloc(PARALLEL_KEYS * sizeof(void *))) == NULL) {
+		fprintf(stdout, "out of memory\n");
+		goto err0;
+	}
+
+	for (kind = 0; kind < 3; kind++) {
+		if (kind == 0)
+			rbt = tree_create();
+		else if (kind == 1)
+			rbt = rb_create_pool(compare_func, destroy_func, 64);
+		else
+			rbt = rb_create_augment(compare_func, destroy_func, augment_sum_func);
+		if (rbt == NULL) {
+			fprintf(stdout, "create red-black tree failed\n");
+			goto err1;
+		}
+
+		for (i = 0; i < PARALLEL_KEYS; i++) {
+			data[i] = kind == 2 ? (void *) makesumdata(i * 2) : (void *) makedata(i * 2);
+			if (data[i] == NULL) {
+				fprintf(stdout, "out of memory\n");
+				while (i-- > 0)
+					free(data[i]);
+				goto err;
+			}
+		}
+
+		/* unsorted data is refused and nothing is kept */
+		key = ((mydata *) data[PARALLEL_KEYS - 2])->key;
+		((mydata *) data[PARALLEL_KEYS - 2])->key = PARALLEL_KEYS * 2;
+		if (rb_build_sorted_parallel(rbt, data, PARALLEL_KEYS, PARALLEL_THREADS) == 0 || !RB_ISEMPTY(rbt)) {
+			fprintf(stdout, "kind %d: unsorted data accepted\n", kind);
+			goto err;
+		}
+		((mydata *) data[PARALLEL_KEYS - 2])->key = key;
+
+		if (rb_build_sorted_parallel(rbt, data, PARALLEL_KEYS, PARALLEL_THREADS) != 0 || tree_check(rbt) != 1) {
+			fprintf(stdout, "kind %d: build failed\n", kind);
+			for (i = 0; i < PARALLEL_KEYS; i++)
+				free(data[i]);
+			goto err;
+		}
+		if (kind == 2 && check_sum(RB_FIRST(rbt)) < 0) {
+			fprintf(stdout, "invalid sum\n");
+			goto err;
+		}
+		#ifdef RB_MIN
+		if (RB_MINIMAL(rbt) != tree_find(rbt, 0)) {
+			fprintf(stdout, "kind %d: invalid min\n", kind);
+			goto err;
+		}
+		#endif
+		for (i = 0; i < PARALLEL_KEYS; i += 97) {
+			if (tree_find(rbt, i * 2) == NULL || tree_find(rbt, i * 2)->data != data[i]) {
+				fprintf(stdout, "kind %d: find %d failed\n", kind, i * 2);
+				goto err;
+			}
+		}
+
+		sum = 0;
+		if (rb_apply_parallel(rbt, parallel_sum, &sum, PARALLEL_THREADS) != 0 || sum != (long) PARALLEL_KEYS * (PARALLEL_KEYS - 1)) {
+			fprintf(stdout, "kind %d: apply sum %ld\n", kind, sum);
+			goto err;
+		}
+		key = 777 * 2;
+		if (rb_apply_parallel(rbt, parallel_stop, &key, PARALLEL_THREADS) != 7) {
+			fprintf(stdout, "kind %d: apply error lost\n", kind);
+			goto err;
+		}
+
+		/* the built tree is an ordinary tree */
+		if (kind != 2 && (tree_delete(rbt, 1000) != 1 || tree_insert(rbt, 1001) == NULL || tree_check(rbt) != 1)) {
+			fprintf(stdout, "kind %d: update failed\n", kind);
+			goto err;
+		}
+
+		rb_destroy_parallel(rbt, PARALLEL_THREADS);
+	}
+
+	/* too few threads or data run in the caller alone */
+	if ((rbt = tree_create()) == NULL) {
+		fprintf(stdout, "create red-black tree failed\n");
+		goto err1;
+	}
+	for (i = 0; i < 100; i++) {
+		if ((data[i] = makedata(i)) == NULL) {
+			fprintf(stdout, "out of memory\n");
+			while (i-- > 0)
+				free(data[i]);
+			goto err;
+		}
+	}
+	sum = 0;
+	if (rb_build_sorted_parallel(rbt, data, 100, PARALLEL_THREADS) != 0 || rb_apply_parallel(rbt, parallel_sum, &sum, 1) != 0 || sum != 4950 || tree_check(rbt) != 1) {
+		fprintf(stdout, "small build failed\n");
+		goto err;
+	}
+	rb_destroy_parallel(rbt, 1);
+
+	free(data);
+	return 1;
+
+err:
+	rb_destroy(rbt);
+err1:
+	free(data);
+err0:
+	return 0;
+}
+#endif
+
+#ifdef RB_RCU
+#define RCU_READERS 3
+#define RCU_KEYS 1000
+
+struct rcu_state {
+	rbtree *rbt;
+	int done;
+	long lookups;
+	int errors;
+};
+
+/*
+ * look up random keys until done, the even ones are never deleted
+ */
+void *rcu_reader(void *arg)
+{
+	struct rcu_state *state = (struct rcu_state *) arg;
+	unsigned int seed = (unsigned int) (uintptr_t) arg;
+	rbreader reader;
+	rbnode *node;
+	mydata query;
+
+	rb_rcu_register(state->rbt, &reader);
+
+	while (!__atomic_load_n(&state->done, __ATOMIC_ACQUIRE)) {
+		query.key = rand_r(&seed) % (RCU_KEYS * 2);
+
+		rb_rcu_read_lock(&reader);
+		node = rb_find_rcu(state->rbt, &query);
+		if (node == NULL ? query.key % 2 == 0 : ((mydata *) node->data)->key != query.key)
+			state->errors++;
+		rb_rcu_read_unlock(&reader);
+
+		__atomic_store_n(&state->lookups, state->lookups + 1, __ATOMIC_RELAXED);
+	}
+
+	rb_rcu_unregister(&reader);
+	return NULL;
+}
+
+int unit_test_rcu()
+{
+	struct rcu_state state[RCU_READERS];
+	pthread_t threads[RCU_READERS];
+	rbreader reader;
+	rbtree *rbt;
+	rbnode *node;
+	mydata query;
+	long lookups;
+	int i, round, started, failed;
+
+	if ((rbt = tree_create()) == NULL) {
+		fprintf(stdout, "create red-black tree failed\n");
+		goto err0;
+	}
+
+	for (i = 0; i < RCU_KEYS; i++) {
+		if (tree_insert(rbt, i * 2) == NULL) {
+			fprintf(stdout, "insert %d failed\n", i * 2);
+			goto err;
+		}
+	}
+
+	/* a node found in a read section outlives its deletion until the section ends */
+	rb_rcu_register(rbt, &reader);
+	rb_rcu_read_lock(&reader);
+	query.key = 10;
+	if ((node = rb_find_rcu(rbt, &query)) == NULL || tree_delete(rbt, 10) != 1) {
+		fprintf(stdout, "find and delete failed\n");
+		goto err;
+	}
+	if (rb_rcu_reclaim(rbt) == 0 || rb_rcu_reclaim(rbt) != 0 || ((mydata *) node->data)->key != 10) {
+		fprintf(stdout, "node reclaimed under a reader\n");
+		goto err;
+	}
+	query.key = 11;
+	if (rb_find_rcu(rbt, &query) != NULL) {
+		fprintf(stdout, "found a missing key\n");
+		goto err;
+	}
+	rb_rcu_read_unlock(&reader);
+	if (rb_rcu_reclaim(rbt) == 0) {
+		fprintf(stdout, "reader still holds the epoch\n");
+		goto err;
+	}
+	rb_rcu_unregister(&reader);
+	if (tree_insert(rbt, 10) == NULL) {
+		fprintf(stdout, "insert 10 failed\n");
+		goto err;
+	}
+
+	/* readers race with one writer inserting and deleting the odd keys */
+	for (i = started = 0; i < RCU_READERS; i++, started++) {
+		state[i].rbt = rbt;
+		state[i].done = 0;
+		state[i].lookups = 0;
+		state[i].errors = 0;
+		if (pthread_create(&threads[i], NULL, rcu_reader, &state[i]) != 0) {
+			fprintf(stdout, "create thread failed\n");
+			break;
+		}
+	}
+
+	failed = started != RCU_READERS;
+	for (round = 0, lookups = 0; !failed && (round < 20 || lookups < 10000); round++) {
+		for (i = 0; i < RCU_KEYS && !failed; i++)
+			failed = tree_insert(rbt, ((i * 37) % RCU_KEYS) * 2 + 1) == NULL;
+		for (i = 0; i < RCU_KEYS && !failed; i++)
+			failed = tree_delete(rbt, ((i * 53) % RCU_KEYS) * 2 + 1) != 1;
+		#ifndef RB_DUP
+		/* replace the data of the even keys under the readers */
+		for (i = 0; i < RCU_KEYS && !failed; i += 7)
+			failed = tree_insert(rbt, i * 2) == NULL;
+		#endif
+
+		for (i = 0, lookups = LONG_MAX; i < RCU_READERS; i++) {
+			if (__atomic_load_n(&state[i].lookups, __ATOMIC_RELAXED) < lookups)
+				lookups = __atomic_load_n(&state[i].lookups, __ATOMIC_RELAXED);
+		}
+	}
+
+	for (i = 0; i < started; i++) {
+		__atomic_store_n(&state[i].done, 1, __ATOMIC_RELEASE);
+		pthread_join(threads[i], NULL);
+	}
+
+	if (failed)
+		goto err;
+
+	for (i = 0; i < RCU_READERS; i++) {
+		if (state[i].errors != 0) {
+			fprintf(stdout, "reader %d: %d wrong lookups of %ld\n", i, state[i].errors, state[i].lookups);
+			goto err;
+		}
+	}
+
+	rb_rcu_synchronize(rbt);
+	if (tree_check(rbt) != 1 || rbt->retired[0] != NULL || rbt->retired[1] != NULL) {
+		fprintf(stdout, "invalid tree\n");
+		goto err;
+	}
+
+	rb_destroy(rbt);
+	return 1;
+
+err:
+	rb_destroy(rbt);
+err0:
+	return 0;
+}
+#endif
+
+#ifdef RB_STATS
+/*
+ * counters against what a known sequence of operations must do
+ */
+int unit_test_stats()
+{
+	rbtree *rbt, *lo, *hi;
+	rbnode *node;
+	rbstats st, lo_st, hi_st;
+	mydata query, limit;
+	void *data[64];
+	int i, n, height;
+
+	n = 1000;
+	for (height = 0; (1 << height) <= n; height++) ;
+	height *= 2; /* the height is at most 2 * log2(n + 1) */
+
+	if ((rbt = rb_create(compare_func, destroy_func)) == NULL) {
+		fprintf(stdout, "create red-black tree failed\n");
+		goto err0;
+	}
+
+	rb_stats_get(rbt, &st);
+	if (st.compares != 0 || st.rotations != 0 || st.insert_repairs != 0 || st.delete_repairs != 0 || \
+		st.allocs != 0 || st.searches != 0 || st.depth != 0 || st.max_depth != 0) {
+		fprintf(stdout, "counters not zero\n");
+		goto err;
+	}
+
+	/* ascending keys lean right, every repair up the right spine rotates */
+	for (i = 0; i < n; i++) {
+		if (rb_insert(rbt, makedata(i)) == NULL) {
+			fprintf(stdout, "insert failed\n");
+			goto err;
+		}
+	}
+
+	rb_stats_get(rbt, &st);
+	if (st.allocs != (unsigned long) n || st.compares == 0 || st.rotations == 0 || st.insert_repairs < st.rotations / 2 || st.delete_repairs != 0) {
+		fprintf(stdout, "insert: %lu allocs, %lu compares, %lu rotations, %lu repairs\n", st.allocs, st.compares, st.rotations, st.insert_repairs);
+		goto err;
+	}
+
+	/* a lookup compares once per node on its way down */
+	rb_stats_reset(rbt);
+	query.key = n / 3;
+	if (rb_find(rbt, &query) == NULL) {
+		fprintf(stdout, "find failed\n");
+		goto err;
+	}
+	query.key = n;
+	if (rb_find(rbt, &query) != NULL) {
+		fprintf(stdout, "found a missing key\n");
+		goto err;
+	}
+
+	rb_stats_get(rbt, &st);
+	if (st.searches != 2 || st.compares != st.depth || st.depth < 2 || st.max_depth > (unsigned long) height || st.max_depth * 2 < st.depth || \
+		st.rotations != 0 || st.allocs != 0) {
+		fprintf(stdout, "find: %lu searches, %lu compares, depth %lu, max %lu\n", st.searches, st.compares, st.depth, st.max_depth);
+		goto err;
+	}
+
+	/* the deletes and their lookups, nothing allocated */
+	rb_stats_reset(rbt);
+	for (i = 0; i < n; i++) {
+		query.key = i;
+		if ((node = rb_find(rbt, &query)) == NULL) {
+			fprintf(stdout, "find failed\n");
+			goto err;
+		}
+		rb_delete(rbt, node, 0);
+	}
+
+	rb_stats_get(rbt, &st);
+	if (st.searches != (unsigned long) n || st.compares != st.depth || st.max_depth > (unsigned long) height || st.delete_repairs == 0 || st.insert_repairs != 0 || st.allocs != 0) {
+		fprintf(stdout, "delete: %lu searches, %lu compares, %lu repairs, %lu allocs\n", st.searches, st.compares, st.delete_repairs, st.allocs);
+		goto err;
+	}
+
+	/* a sorted build allocates every node and compares only neighbours */
+	rb_stats_reset(rbt);
+	for (i = 0; i < 64; i++)
+		data[i] = makedata(i);
+	if (rb_build_sorted(rbt, data, 64) != 0) {
+		fprintf(stdout, "build failed\n");
+		goto err;
+	}
+
+	rb_stats_get(rbt, &st);
+	if (st.allocs != 64 || st.compares != 63 || st.rotations != 0 || st.insert_repairs != 0 || st.searches != 0) {
+		fprintf(stdout, "build: %lu allocs, %lu compares\n", st.allocs, st.compares);
+		goto err;
+	}
+
+	/* 64 ascending keys, splitting off the last joins pieces of unequal height, which repairs */
+	rb_destroy(rbt);
+	if ((rbt = rb_create(compare_func, destroy_func)) == NULL) {
+		fprintf(stdout, "create red-black tree failed\n");
+		goto err0;
+	}
+	for (i = 0; i < 64; i++) {
+		if (rb_insert(rbt, makedata(i)) == NULL) {
+			fprintf(stdout, "insert failed\n");
+			goto err;
+		}
+	}
+
+	/* the split is the work of the tree split, the pieces start from zero */
+	rb_stats_reset(rbt);
+	query.key = 63;
+	if (rb_split(rbt, &query, &lo, &hi) != 0) {
+		fprintf(stdout, "split failed\n");
+		goto err;
+	}
+
+	rb_stats_get(rbt, &st);
+	rb_stats_get(lo, &lo_st);
+	rb_stats_get(hi, &hi_st);
+	if (st.searches != 1 || st.compares != st.depth || st.insert_repairs == 0 || \
+		lo_st.insert_repairs + lo_st.rotations + lo_st.compares != 0 || hi_st.insert_repairs + hi_st.rotations + hi_st.compares != 0) {
+		fprintf(stdout, "split: %lu searches, %lu compares, %lu repairs\n", st.searches, st.compares, st.insert_repairs);
+		goto err1;
+	}
+
+	/* a range delete searches for both ends, the second in a piece split off, and compares the first with hi */
+	query.key = 30;
+	limit.key = 40;
+	if (rb_delete_range(lo, &query, &limit, NULL, NULL) != 11) {
+		fprintf(stdout, "delete range failed\n");
+		goto err1;
+	}
+
+	rb_stats_get(lo, &lo_st);
+	if (lo_st.searches != 2 || lo_st.compares != lo_st.depth + 1) {
+		fprintf(stdout, "delete range: %lu searches, %lu compares, depth %lu\n", lo_st.searches, lo_st.compares, lo_st.depth);
+		goto err1;
+	}
+
+	rb_destroy(lo);
+	rb_destroy(hi);
+
+	rb_destroy(rbt);
+	return 1;
+
+err1:
+	rb_destroy(lo);
+	rb_destroy(hi);
+err:
+	rb_destroy(rbt);
+err0:
+	return 0;
+}
+#endif
@@ -1,3 +1,4 @@
 #!/bin/bash
 
-gcc rb.c rb_data.c rb_test.c && time ./a.out
+gcc -pthread rb.c rb_data.c rb_index.c rb_interval.c rb_shard.c rb_persist.c rb_io.c rb_mmap.c rb_test.c && time ./a.out && \
+gcc -DRB_COMPACT -DRB_RANK -DRB_MAX -DRB_RCU -DRB_PARALLEL -DRB_STATS -pthread rb.c rb_data.c rb_index.c rb_interval.c rb_shard.c rb_persist.c rb_io.c rb_mmap.c rb_test.c && time ./a.out